@@ -0,0 +1,343 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__ASYNCAPPENDER_H_
+#define BINFMT__ASYNCAPPENDER_H_
+
+#include <future>
+#include <memory>
+#include <optional>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Bounded lock-free queue for many producers and a single consumer.
+ * Every cell carries a sequence number which tells producers whether it is
+ * free and the consumer whether it was published (Vyukov's bounded queue).
+ * @tparam T
+ */
+template <typename T> class BoundedMPSCQueue {
+  struct Cell {
+    std::atomic<uint64_t> sequence;
+    T data;
+  };
+
+  const uint64_t m_u64Mask;
+  std::unique_ptr<Cell[]> m_pCells;
+  alignas(64) std::atomic<uint64_t> m_u64EnqueuePos{0};
+  alignas(64) uint64_t m_u64DequeuePos = 0;
+
+  static uint64_t roundDownToPowerOfTwo(uint64_t i_u64Value) {
+    uint64_t r = 2;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (r * 2 <= i_u64Value) {
+      r *= 2;
+    }
+    return r;
+  }
+
+public:
+  //! @param i_u64Capacity rounded down to a power of two, at least 2
+  explicit BoundedMPSCQueue(uint64_t i_u64Capacity)
+      : m_u64Mask(roundDownToPowerOfTwo(i_u64Capacity) - 1),
+        m_pCells(new Cell[m_u64Mask + 1]) {
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint64_t i = 0; i <= m_u64Mask; i++) {
+      m_pCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  //! @return false if the queue is full
+  bool tryPush(T &&i_Value) {
+    uint64_t pos = m_u64EnqueuePos.load(std::memory_order_relaxed);
+    Cell *cell = nullptr;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (true) {
+      cell = &m_pCells[pos & m_u64Mask];
+      uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(sequence - pos);
+      if (diff == 0) {
+        if (m_u64EnqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_u64EnqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(i_Value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  //! Consumer only. @return false if the next cell was not published yet
+  bool tryPop(T &o_Value) {
+    Cell &cell = m_pCells[m_u64DequeuePos & m_u64Mask];
+    if (cell.sequence.load(std::memory_order_acquire) != m_u64DequeuePos + 1) {
+      return false;
+    }
+    o_Value = std::move(cell.data);
+    cell.sequence.store(m_u64DequeuePos + m_u64Mask + 1,
+                        std::memory_order_release);
+    m_u64DequeuePos++;
+    return true;
+  }
+
+  //! @return number of slots claimed by producers so far
+  [[nodiscard]] uint64_t getEnqueuedCount() const {
+    return m_u64EnqueuePos.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]] uint64_t getCapacity() const { return m_u64Mask + 1; }
+};
+
+enum class Backpressure {
+  //! append waits until the writer made room
+  Block,
+  //! append fails with ErrorCode::QUEUE_FULL
+  Reject,
+};
+
+struct AsyncAppenderOptions {
+  //! upper bound for the memory of the queue, decides its capacity
+  size_t maxQueueBytes = 8 * 1024 * 1024;
+  //! most records written by one vector append
+  uint32_t maxBatchSize = 4096;
+  Backpressure backpressure = Backpressure::Block;
+  //! how long the idle writer sleeps before it polls the queue again
+  std::chrono::microseconds idleInterval{1000};
+};
+
+/*!
+ * Moves appends off the calling thread. Producers push into a lock-free
+ * bounded queue, a dedicated writer thread drains it in batches through the
+ * vector append of the BinaryFile, so one pwrite and, depending on the
+ * DurabilityPolicy, one sync cover a whole batch.
+ * The BinaryFile must not be appended to directly while the appender lives.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class AsyncAppender {
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  struct Record {
+    ContainerType container;
+    std::optional<std::promise<ErrorCode>> promise;
+  };
+
+  File &m_File;
+  AsyncAppenderOptions m_Options;
+  BoundedMPSCQueue<Record> m_Queue;
+
+  std::atomic<bool> m_bClosed{false};
+  std::atomic<uint32_t> m_u32ActiveProducers{0};
+  std::atomic<bool> m_bWriterWaiting{false};
+  std::atomic<uint32_t> m_u32BlockedProducers{0};
+
+  std::mutex m_Mutex;
+  std::condition_variable m_WriterCondition;
+  std::condition_variable m_SpaceCondition;
+  std::condition_variable m_WrittenCondition;
+  uint64_t m_u64Written = 0;
+  bool m_bStop = false;
+  ErrorCode m_LastError = ErrorCode::OK;
+  std::thread m_Writer;
+
+  void wakeWriter() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_bWriterWaiting.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_WriterCondition.notify_one();
+    }
+  }
+
+  ErrorCode push(Record &&i_Record) {
+    m_u32ActiveProducers++;
+    ErrorCode r = ErrorCode::OK;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (true) {
+      if (m_bClosed.load()) {
+        r = ErrorCode::CLOSED;
+        break;
+      }
+      if (m_Queue.tryPush(std::move(i_Record))) {
+        break;
+      }
+      if (m_Options.backpressure == Backpressure::Reject) {
+        r = ErrorCode::QUEUE_FULL;
+        break;
+      }
+      wakeWriter();
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_u32BlockedProducers++;
+      m_SpaceCondition.wait_for(lock, m_Options.idleInterval);
+      m_u32BlockedProducers--;
+    }
+    m_u32ActiveProducers--;
+    if (r == ErrorCode::OK) {
+      wakeWriter();
+    }
+    return r;
+  }
+
+  void runWriter() {
+    std::vector<ContainerType> batch;
+    std::vector<std::promise<ErrorCode>> promises;
+    batch.reserve(m_Options.maxBatchSize);
+    Record record;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (true) {
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      while (batch.size() < m_Options.maxBatchSize && m_Queue.tryPop(record)) {
+        batch.emplace_back(record.container);
+        if (record.promise) {
+          promises.emplace_back(std::move(*record.promise));
+          record.promise.reset();
+        }
+      }
+
+      if (batch.empty()) {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if (m_bStop && m_u64Written == m_Queue.getEnqueuedCount()) {
+          return;
+        }
+        m_bWriterWaiting.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_u64Written == m_Queue.getEnqueuedCount()) {
+          m_WriterCondition.wait_for(lock, m_Options.idleInterval);
+        }
+        m_bWriterWaiting.store(false);
+        continue;
+      }
+
+      size_t count = batch.size();
+      ErrorCode r = m_File.append(batch);
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (auto &promise : promises) {
+        promise.set_value(r);
+      }
+      promises.clear();
+      batch.clear();
+
+      {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_u64Written += count;
+        if (r != ErrorCode::OK) {
+          m_LastError = r;
+        }
+      }
+      m_WrittenCondition.notify_all();
+      if (m_u32BlockedProducers.load() > 0) {
+        m_SpaceCondition.notify_all();
+      }
+    }
+  }
+
+public:
+  explicit AsyncAppender(File &i_File,
+                         AsyncAppenderOptions i_Options = AsyncAppenderOptions{})
+      : m_File(i_File), m_Options(i_Options),
+        m_Queue(std::max<size_t>(
+            i_Options.maxQueueBytes / (sizeof(Record) + sizeof(uint64_t)), 2)) {
+    m_Writer = std::thread(&AsyncAppender::runWriter, this);
+  }
+
+  AsyncAppender(const AsyncAppender &) = delete;
+  AsyncAppender &operator=(const AsyncAppender &) = delete;
+
+  ~AsyncAppender() { (void)drain(); }
+
+  /*!
+   * Queue i_Entry without waiting for it to be written
+   * @param i_Entry
+   * @return ErrorCode::OK, ErrorCode::QUEUE_FULL with Backpressure::Reject or
+   * ErrorCode::CLOSED after drain()
+   */
+  ErrorCode append(const EntryType &i_Entry) {
+    return push(Record{ContainerType(i_Entry), std::nullopt});
+  }
+
+  /*!
+   * Queue i_Entry and get notified once its batch was appended
+   * @param i_Entry
+   * @return future of the ErrorCode of the vector append which wrote the
+   * entry, or of the reason it was not queued
+   */
+  std::future<ErrorCode> appendWithFuture(const EntryType &i_Entry) {
+    std::promise<ErrorCode> promise;
+    auto future = promise.get_future();
+    Record record{ContainerType(i_Entry), std::move(promise)};
+    ErrorCode r = push(std::move(record));
+    if (r != ErrorCode::OK) {
+      record.promise->set_value(r);
+    }
+    return future;
+  }
+
+  /*!
+   * Wait until everything queued before this call was appended, then sync
+   * the file
+   * @param o_pErrorCode
+   * @return false if an append or the sync failed
+   */
+  bool flush(ErrorCode *o_pErrorCode = nullptr) {
+    uint64_t target = m_Queue.getEnqueuedCount();
+    ErrorCode r = ErrorCode::OK;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_WriterCondition.notify_one();
+      m_WrittenCondition.wait(lock, [this, target] {
+        return m_u64Written >= target;
+      });
+      r = std::exchange(m_LastError, ErrorCode::OK);
+    }
+    if (r == ErrorCode::OK) {
+      (void)m_File.flush(&r);
+    }
+    if (o_pErrorCode != nullptr) {
+      *o_pErrorCode = r;
+    }
+    return r == ErrorCode::OK;
+  }
+
+  /*!
+   * Stop accepting records, write out everything queued, stop the writer
+   * thread and sync. Called by the destructor.
+   * @param o_pErrorCode
+   * @return false if an append or the sync failed
+   */
+  bool drain(ErrorCode *o_pErrorCode = nullptr) {
+    if (m_bClosed.exchange(true)) {
+      return true;
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (m_u32ActiveProducers.load() > 0) {
+      m_SpaceCondition.notify_all();
+      std::this_thread::yield();
+    }
+    bool bOk = flush(o_pErrorCode);
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_bStop = true;
+    }
+    m_WriterCondition.notify_one();
+    m_Writer.join();
+    return bOk;
+  }
+
+  //! @return number of records the queue can hold
+  [[nodiscard]] uint64_t getQueueCapacity() const {
+    return m_Queue.getCapacity();
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__ASYNCAPPENDER_H_
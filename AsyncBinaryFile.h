@@ -0,0 +1,345 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__ASYNCBINARYFILE_H_
+#define BINFMT__ASYNCBINARYFILE_H_
+
+#if __cplusplus < 202002L
+#error "AsyncBinaryFile.h requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+
+#include "ThreadPool.h"
+#include "binfmt.h"
+
+namespace binfmt {
+
+template <typename T> class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+  std::coroutine_handle<> m_Continuation = std::noop_coroutine();
+  std::exception_ptr m_Exception;
+
+  //! Resumes whoever awaited the task without growing the stack
+  struct FinalAwaiter {
+    [[nodiscard]] bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> i_Handle) noexcept {
+      return i_Handle.promise().m_Continuation;
+    }
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+  void unhandled_exception() { m_Exception = std::current_exception(); }
+
+  void rethrow() const {
+    if (m_Exception) {
+      std::rethrow_exception(m_Exception);
+    }
+  }
+};
+
+template <typename T> struct TaskPromise : TaskPromiseBase {
+  std::optional<T> m_Value;
+
+  Task<T> get_return_object();
+  void return_value(T i_Value) { m_Value.emplace(std::move(i_Value)); }
+  T result() {
+    rethrow();
+    return std::move(*m_Value);
+  }
+};
+
+template <> struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object();
+  void return_void() const {}
+  void result() const { rethrow(); }
+};
+
+//! Fire and forget coroutine, its frame frees itself when it finishes
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() const { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() const {}
+    void unhandled_exception() const { std::terminate(); }
+  };
+};
+
+} // namespace detail
+
+/*!
+ * Lazily started coroutine, runs when it is co_awaited and resumes the
+ * awaiting coroutine once it finished
+ * @tparam T
+ */
+template <typename T = void> class [[nodiscard]] Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+
+private:
+  std::coroutine_handle<promise_type> m_Handle;
+
+public:
+  explicit Task(std::coroutine_handle<promise_type> i_Handle)
+      : m_Handle(i_Handle) {}
+
+  Task(Task &&i_Other) noexcept
+      : m_Handle(std::exchange(i_Other.m_Handle, nullptr)) {}
+  Task &operator=(Task &&i_Other) noexcept {
+    if (this != &i_Other) {
+      if (m_Handle) {
+        m_Handle.destroy();
+      }
+      m_Handle = std::exchange(i_Other.m_Handle, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    if (m_Handle) {
+      m_Handle.destroy();
+    }
+  }
+
+  [[nodiscard]] bool await_ready() const noexcept {
+    return !m_Handle || m_Handle.done();
+  }
+
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<> i_Continuation) noexcept {
+    m_Handle.promise().m_Continuation = i_Continuation;
+    return m_Handle;
+  }
+
+  T await_resume() { return m_Handle.promise().result(); }
+};
+
+namespace detail {
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+} // namespace detail
+
+/*!
+ * Start i_Task without waiting for it, i_Callback receives its result
+ * @tparam T
+ * @param i_Task
+ * @param i_Callback runs on whichever thread finished the task
+ */
+template <typename T, typename Callback>
+void spawn(Task<T> i_Task, Callback i_Callback) {
+  [](Task<T> task, Callback callback) -> detail::DetachedTask {
+    if constexpr (std::is_void_v<T>) {
+      co_await task;
+      callback();
+    } else {
+      callback(co_await task);
+    }
+  }(std::move(i_Task), std::move(i_Callback));
+}
+
+//! Block the calling thread until i_Task finished, rethrows its exception
+template <typename T> T syncWait(Task<T> i_Task) {
+  std::promise<T> promise;
+  auto future = promise.get_future();
+  [](Task<T> task, std::promise<T> &result) -> detail::DetachedTask {
+    try {
+      if constexpr (std::is_void_v<T>) {
+        co_await task;
+        result.set_value();
+      } else {
+        result.set_value(co_await task);
+      }
+    } catch (...) {
+      result.set_exception(std::current_exception());
+    }
+  }(std::move(i_Task), promise);
+  return future.get();
+}
+
+//! co_await to continue on the given executor
+struct ScheduleAwaiter {
+  Executor &m_Executor;
+
+  [[nodiscard]] bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> i_Handle) const {
+    m_Executor.post([i_Handle] { i_Handle.resume(); });
+  }
+  void await_resume() const noexcept {}
+};
+
+/*!
+ * Awaitable front end of a BinaryFile. Every operation runs on the executor,
+ * appends go through appendConcurrent and then suspend until their record is
+ * durable, so with DurabilityPolicy::GroupCommit no worker thread is blocked
+ * on fsync while thousands of appends are in flight.
+ * The BinaryFile must not be appended to through its synchronous API at the
+ * same time, and every task has to finish before this object is destroyed.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class AsyncBinaryFile {
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  File &m_File;
+  std::unique_ptr<ThreadPool> m_pOwnedPool;
+  Executor &m_Executor;
+
+  //! Suspends until the file reports i_u64Sequence durable
+  struct DurableAwaiter {
+    File &m_File;
+    Executor &m_Executor;
+    uint64_t m_u64Sequence;
+    bool m_bOk = true;
+
+    [[nodiscard]] bool await_ready() const noexcept {
+      return m_File.getDurableSequence() >= m_u64Sequence;
+    }
+    void await_suspend(std::coroutine_handle<> i_Handle) {
+      m_File.notifyWhenDurable(m_u64Sequence, [this, i_Handle](bool i_bOk) {
+        m_bOk = i_bOk;
+        m_Executor.post([i_Handle] { i_Handle.resume(); });
+      });
+    }
+    [[nodiscard]] bool await_resume() const noexcept { return m_bOk; }
+  };
+
+public:
+  /*!
+   * Run on a built-in ThreadPool
+   * @param i_File
+   * @param i_u32ThreadCount defaults to std::thread::hardware_concurrency
+   */
+  explicit AsyncBinaryFile(File &i_File, uint32_t i_u32ThreadCount = 0)
+      : m_File(i_File),
+        m_pOwnedPool(std::make_unique<ThreadPool>(i_u32ThreadCount)),
+        m_Executor(*m_pOwnedPool) {}
+
+  //! Run on a user supplied executor which has to outlive this object
+  AsyncBinaryFile(File &i_File, Executor &i_Executor)
+      : m_File(i_File), m_Executor(i_Executor) {}
+
+  AsyncBinaryFile(const AsyncBinaryFile &) = delete;
+  AsyncBinaryFile &operator=(const AsyncBinaryFile &) = delete;
+
+  [[nodiscard]] File &getFile() { return m_File; }
+  [[nodiscard]] Executor &getExecutor() { return m_Executor; }
+
+  //! co_await schedule() to hop onto the executor
+  [[nodiscard]] ScheduleAwaiter schedule() { return {m_Executor}; }
+
+  /*!
+   * Append and resume once the container is durable
+   * @param i_Container
+   * @return ErrorCode::OK, or the error of the write / sync
+   */
+  Task<ErrorCode> append(ContainerType i_Container) {
+    co_await schedule();
+    uint64_t sequence = 0;
+    ErrorCode r = m_File.appendConcurrent(i_Container, &sequence);
+    if (r != ErrorCode::OK) {
+      co_return r;
+    }
+    bool bOk = co_await DurableAwaiter{m_File, m_Executor, sequence};
+    co_return bOk ? ErrorCode::OK : ErrorCode::SYNC_ERROR;
+  }
+
+  Task<ErrorCode> append(EntryType i_Entry) {
+    return append(ContainerType(i_Entry));
+  }
+
+  /*!
+   * @param i_u32Index
+   * @param o_Container has to stay valid until the task finished
+   * @return ErrorCode::OK, ErrorCode::READ_ERROR or ErrorCode::ENTRY_REMOVED
+   * if the read filter of the file hides it
+   */
+  Task<ErrorCode> getEntry(uint32_t i_u32Index, ContainerType &o_Container) {
+    co_await schedule();
+    ErrorCode r = ErrorCode::OK;
+    if (!m_File.getEntry(i_u32Index, o_Container, &r) &&
+        r == ErrorCode::OK) {
+      r = ErrorCode::READ_ERROR;
+    }
+    co_return r;
+  }
+
+  /*!
+   * @param o_Containers has to stay valid until the task finished
+   * @param i_u32Index
+   * @param i_u32Count
+   * @return ErrorCode::OK or ErrorCode::READ_ERROR
+   */
+  Task<ErrorCode> getEntriesFrom(std::vector<ContainerType> &o_Containers,
+                                 uint32_t i_u32Index, uint32_t i_u32Count) {
+    co_await schedule();
+    ErrorCode r = ErrorCode::OK;
+    if (!m_File.getEntriesFrom(o_Containers, i_u32Index, i_u32Count, &r) &&
+        r == ErrorCode::OK) {
+      r = ErrorCode::READ_ERROR;
+    }
+    co_return r;
+  }
+
+  /*!
+   * Read [i_u32Begin, i_u32End) in chunks, every chunk is a separate job on
+   * the executor so long scans do not hold on to a worker
+   * @param i_Callback runs on the executor
+   * @param i_u32Begin
+   * @param i_u32End 0 means up to the stored entry count
+   * @param i_u32ChunkSize 0 is read as 1
+   * @return ErrorCode::OK or ErrorCode::READ_ERROR
+   */
+  Task<ErrorCode> getEntriesChunked(
+      std::function<void(const std::vector<ContainerType> &)> i_Callback,
+      uint32_t i_u32Begin = 0, uint32_t i_u32End = 0,
+      uint32_t i_u32ChunkSize = 100000) {
+    if (i_u32End == 0) {
+      i_u32End = m_File.getStoredEntryCount();
+    }
+    i_u32ChunkSize = std::max(i_u32ChunkSize, 1U);
+    std::vector<ContainerType> chunk;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (i_u32Begin < i_u32End) {
+      co_await schedule();
+      uint32_t count = std::min(i_u32ChunkSize, i_u32End - i_u32Begin);
+      ErrorCode r = ErrorCode::OK;
+      if (!m_File.getEntriesFrom(chunk, i_u32Begin, count, &r)) {
+        co_return r == ErrorCode::OK ? ErrorCode::READ_ERROR : r;
+      }
+      if (!chunk.empty()) {
+        i_Callback(chunk);
+      }
+      i_u32Begin += count;
+    }
+    co_return ErrorCode::OK;
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__ASYNCBINARYFILE_H_
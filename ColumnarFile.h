@@ -0,0 +1,322 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__COLUMNARFILE_H_
+#define BINFMT__COLUMNARFILE_H_
+
+#include <tuple>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Struct-of-arrays storage: every declared field of EntryType lives in a
+ * BinaryFile of its own (<path>.<field index>) without checksums, so a column
+ * is one contiguous array of that field. Rows are appended as EntryType and
+ * scanColumns hands out plain field arrays, aggregating one field only reads
+ * that field.
+ * Members which are not declared are not stored. Row indices are logical,
+ * 0 is the oldest stored row. Reads are not synchronized with appends.
+ * On open, rows which only some columns got (a crash during append) are
+ * dropped; that is not possible once a ring has wrapped and reported as
+ * ErrorCode::TRUNCATE_ERROR.
+ * @tparam HeaderType every column file gets a copy
+ * @tparam EntryType default constructible
+ * @tparam Fields pointers to the stored members of EntryType, e.g.
+ * &MyPODEntry::temperature
+ */
+template <typename HeaderType, typename EntryType, auto... Fields>
+class ColumnarFile {
+  template <typename Class, typename Member>
+  static Member getMemberType(Member Class::*);
+
+public:
+  template <auto Field>
+  using FieldType = decltype(getMemberType(Field));
+
+  template <auto Field>
+  using ColumnContainer = BinaryEntryContainer<FieldType<Field>, NoChecksum>;
+
+  template <auto Field>
+  using Column =
+      BinaryFile<HeaderType, FieldType<Field>, ColumnContainer<Field>>;
+
+private:
+  static_assert(sizeof...(Fields) > 0, "declare at least one field");
+  static_assert((std::is_member_object_pointer_v<decltype(Fields)> && ...),
+                "fields have to be pointers to members of EntryType");
+  static_assert(((sizeof(ColumnContainer<Fields>) ==
+                  sizeof(FieldType<Fields>)) &&
+                 ...),
+                "a column has to be a plain array of its field");
+
+  template <auto A, auto B> static constexpr bool isSameField() {
+    if constexpr (std::is_same_v<decltype(A), decltype(B)>) {
+      return A == B;
+    } else {
+      return false;
+    }
+  }
+
+  //! @return how often Field is declared
+  template <auto Field> static constexpr size_t countField() {
+    return (static_cast<size_t>(isSameField<Field, Fields>()) + ...);
+  }
+
+  //! @return position of Field in Fields, sizeof...(Fields) if not declared
+  template <auto Field> static constexpr size_t getFieldIndex() {
+    size_t r = sizeof...(Fields);
+    size_t i = 0;
+    ((isSameField<Field, Fields>() && r == sizeof...(Fields) ? r = i++ : i++),
+     ...);
+    return r;
+  }
+
+  //! Chunk buffer of one column, reused across reads
+  template <auto Field> struct ColumnBuffer {
+    std::vector<ColumnContainer<Field>> containers;
+
+    Span<ColumnContainer<Field>> get(size_t i_szCount) {
+      if (containers.size() < i_szCount) {
+        containers.resize(i_szCount);
+      }
+      return Span<ColumnContainer<Field>>(containers.data(), i_szCount);
+    }
+
+    Span<const FieldType<Field>> getValues(size_t i_szCount) const {
+      return Span<const FieldType<Field>>(
+          reinterpret_cast<const FieldType<Field> *>(containers.data()),
+          i_szCount);
+    }
+  };
+
+  std::tuple<std::unique_ptr<Column<Fields>>...> m_Columns;
+  ErrorCode m_ErrorCode = ErrorCode::OK;
+  // serializes appends so every column gets the rows in the same order
+  std::mutex m_Mutex;
+  std::tuple<ColumnBuffer<Fields>...> m_Scratch;
+
+  template <typename Function> bool forEachColumn(Function i_Function) {
+    return std::apply(
+        [&i_Function](auto &...columns) { return (i_Function(*columns) && ...); },
+        m_Columns);
+  }
+
+  //! @return rows every column stores
+  uint32_t getRecordCount() {
+    uint64_t r = UINT32_MAX;
+    forEachColumn([&r](auto &i_Column) {
+      r = std::min(r, i_Column.getEntryCount());
+      return true;
+    });
+    return static_cast<uint32_t>(r);
+  }
+
+  //! Drop the records past i_u32Count of every column
+  bool truncateColumns(uint32_t i_u32Count) {
+    bool bOk = true;
+    forEachColumn([&bOk, i_u32Count](auto &i_Column) {
+      const uint64_t count = i_Column.getEntryCount();
+      if (count > i_u32Count) {
+        bOk = i_Column.removeEntriesAtEnd(
+                  static_cast<uint32_t>(count - i_u32Count)) &&
+              bOk;
+      }
+      return true;
+    });
+    return bOk;
+  }
+
+  void initialize() {
+    forEachColumn([this](auto &i_Column) {
+      if (m_ErrorCode == ErrorCode::OK) {
+        m_ErrorCode = i_Column.getErrorCode();
+      }
+      return true;
+    });
+    if (m_ErrorCode == ErrorCode::OK && !truncateColumns(getRecordCount())) {
+      m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+    }
+  }
+
+  template <auto Field>
+  bool appendColumn(Span<const EntryType> i_Entries, ErrorCode &o_ErrorCode) {
+    auto containers =
+        std::get<ColumnBuffer<Field>>(m_Scratch).get(i_Entries.size());
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (size_t i = 0; i < i_Entries.size(); i++) {
+      containers[i].entry = i_Entries[i].*Field;
+    }
+    o_ErrorCode = getColumn<Field>().append(
+        Span<const ColumnContainer<Field>>(containers.data(),
+                                           containers.size()));
+    return o_ErrorCode == ErrorCode::OK;
+  }
+
+public:
+  ColumnarFile(const Path &i_Path, HeaderType i_Header,
+               BinaryFileOptions i_Options = BinaryFileOptions{})
+      : m_Columns(std::make_unique<Column<Fields>>(
+            getColumnPath(i_Path, getFieldIndex<Fields>()), i_Header,
+            i_Options)...) {
+    // two columns of one field would share a file
+    static_assert(((countField<Fields>() == 1) && ...),
+                  "declare every field once");
+    initialize();
+  }
+
+  ColumnarFile(const ColumnarFile &) = delete;
+  ColumnarFile &operator=(const ColumnarFile &) = delete;
+
+  //! @return path of the file holding the i_szIndex-th declared field
+  static Path getColumnPath(const Path &i_Path, size_t i_szIndex) {
+    return i_Path.string() + "." + std::to_string(i_szIndex);
+  }
+
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+
+  //! The BinaryFile holding Field, e.g. for a ZoneMap over one column
+  template <auto Field> Column<Field> &getColumn() {
+    constexpr size_t index = getFieldIndex<Field>();
+    static_assert(index < sizeof...(Fields), "field is not declared");
+    return *std::get<index>(m_Columns);
+  }
+
+  //! @return number of stored rows, capped by maxEntries
+  uint32_t getRowCount() {
+    uint32_t r = UINT32_MAX;
+    forEachColumn([&r](auto &i_Column) {
+      r = std::min(r, i_Column.getStoredEntryCount());
+      return true;
+    });
+    return r;
+  }
+
+  /*!
+   * Append rows, each column gets one write of its field. If a column fails,
+   * the rows are removed from the columns which already took them.
+   * @param i_Entries
+   * @return ErrorCode::OK, the error of the failed column or getErrorCode()
+   * if the columns may not line up anymore
+   */
+  ErrorCode append(Span<const EntryType> i_Entries) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_ErrorCode != ErrorCode::OK) {
+      return m_ErrorCode;
+    }
+    const uint32_t count = getRecordCount();
+    ErrorCode r = ErrorCode::OK;
+    if (!(appendColumn<Fields>(i_Entries, r) && ...) &&
+        !truncateColumns(count)) {
+      m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+    }
+    return r;
+  }
+
+  ErrorCode append(const std::vector<EntryType> &i_Entries) {
+    return append(Span<const EntryType>(i_Entries.data(), i_Entries.size()));
+  }
+
+  ErrorCode append(const EntryType &i_Entry) {
+    return append(Span<const EntryType>(&i_Entry, 1));
+  }
+
+  /*!
+   * Read the selected columns of i_u32Count rows chunk by chunk, reusing one
+   * buffer per column. The callback gets one contiguous array per selected
+   * field, all of the same length, e.g.
+   * scanColumns<&MyPODEntry::temperature>([](Span<const float> i_Values) {})
+   * @tparam Selected declared fields to read
+   * @param i_Callback
+   * @param i_u32First logical row to start at
+   * @param i_u32Count 0 means up to the newest row
+   * @param i_u32ChunkSize rows per callback
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a read failed
+   */
+  template <auto... Selected, typename Callback>
+  bool scanColumns(Callback i_Callback, uint32_t i_u32First = 0,
+                   uint32_t i_u32Count = 0, uint32_t i_u32ChunkSize = 65536,
+                   ErrorCode *o_pErrorCode = nullptr) {
+    static_assert(sizeof...(Selected) > 0, "select at least one field");
+    const uint32_t rows = getRowCount();
+    if (i_u32Count == 0) {
+      i_u32Count = i_u32First < rows ? rows - i_u32First : 0;
+    }
+    if (static_cast<uint64_t>(i_u32First) + i_u32Count > rows) {
+      return false;
+    }
+    i_u32ChunkSize = std::max(i_u32ChunkSize, 1U);
+    std::tuple<ColumnBuffer<Selected>...> buffers;
+
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint32_t done = 0; done < i_u32Count;) {
+      const uint32_t count = std::min(i_u32ChunkSize, i_u32Count - done);
+      if (!(getColumn<Selected>().getLogicalEntriesInto(
+                std::get<ColumnBuffer<Selected>>(buffers).get(count),
+                i_u32First + done, o_pErrorCode) &&
+            ...)) {
+        return false;
+      }
+      i_Callback(std::get<ColumnBuffer<Selected>>(buffers).getValues(count)...);
+      done += count;
+    }
+    return true;
+  }
+
+  /*!
+   * Reassemble rows, members which are not declared are value initialized
+   * @param o_Entries resized to i_u32Count
+   * @param i_u32First logical row
+   * @param i_u32Count
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a read failed
+   */
+  bool getEntries(std::vector<EntryType> &o_Entries, uint32_t i_u32First,
+                  uint32_t i_u32Count, ErrorCode *o_pErrorCode = nullptr) {
+    o_Entries.assign(i_u32Count, EntryType{});
+    size_t row = 0;
+    return i_u32Count == 0 ||
+           scanColumns<Fields...>(
+               [&o_Entries, &row](Span<const FieldType<Fields>>... i_Values) {
+                 const size_t count = std::get<0>(std::tie(i_Values...)).size();
+                 // NOLINTNEXTLINE(altera-unroll-loops)
+                 for (size_t i = 0; i < count; i++) {
+                   ((o_Entries[row + i].*Fields = i_Values[i]), ...);
+                 }
+                 row += count;
+               },
+               i_u32First, i_u32Count, 65536, o_pErrorCode);
+  }
+
+  bool getEntry(uint32_t i_u32Row, EntryType &o_Entry,
+                ErrorCode *o_pErrorCode = nullptr) {
+    std::vector<EntryType> entries;
+    if (!getEntries(entries, i_u32Row, 1, o_pErrorCode)) {
+      return false;
+    }
+    o_Entry = entries.front();
+    return true;
+  }
+
+  bool clear() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return forEachColumn([](auto &i_Column) { return i_Column.clear(); });
+  }
+
+  bool deleteFiles() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    bool bOk = true;
+    forEachColumn([&bOk](auto &i_Column) {
+      bOk = i_Column.deleteFile() && bOk;
+      return true;
+    });
+    return bOk;
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__COLUMNARFILE_H_
@@ -0,0 +1,367 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__COMPRESSEDSEGMENT_H_
+#define BINFMT__COMPRESSEDSEGMENT_H_
+
+#include "Lz4.h"
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Read-only, block compressed copy of a BinaryFile which is no longer
+ * appended to. Containers are grouped into blocks of blockSize, every block
+ * is compressed with LZ4 on its own and a table of block offsets at the end
+ * of the file lets getEntry decompress just the block it needs.
+ * Layout: SegmentHeader, the HeaderType of the source, the blocks, the block
+ * offset table. Blocks which do not shrink are stored as they are.
+ * Indices are logical, 0 is the oldest container of the source.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class CompressedSegment {
+public:
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  struct SegmentHeader {
+    uint32_t magic{0x43534547};
+    uint32_t version{0x0001};
+    uint32_t containerSize{sizeof(ContainerType)};
+    uint32_t blockSize{0};
+    uint64_t count{0};
+    //! byte offset of blockCount + 1 uint64_t, block b is [b, b + 1)
+    uint64_t tableOffset{0};
+  };
+
+private:
+  Path m_Path;
+  int32_t m_Fd = -1;
+  ErrorCode m_ErrorCode = ErrorCode::OK;
+  SegmentHeader m_Header;
+  HeaderType m_SourceHeader;
+  std::vector<uint64_t> m_BlockOffsets;
+
+  // the block decompressed last, getEntry in order hits it
+  std::mutex m_Mutex;
+  uint64_t m_u64CachedBlock = UINT64_MAX;
+  std::vector<ContainerType> m_CachedBlock;
+
+  static constexpr off_t getFirstBlockOffset() {
+    return static_cast<off_t>(sizeof(SegmentHeader) + sizeof(HeaderType));
+  }
+
+  static bool writeAt(int32_t i_Fd, const void *i_pData, size_t i_szSize,
+                      off_t i_Offset) {
+    return pwrite(i_Fd, i_pData, i_szSize, i_Offset) ==
+           static_cast<ssize_t>(i_szSize);
+  }
+
+  void open() {
+    m_Fd = ::open(m_Path.c_str(), O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+    if (m_Fd < 0) {
+      m_ErrorCode = ErrorCode::OPEN_ERROR;
+      return;
+    }
+    const SegmentHeader expected;
+    if (pread(m_Fd, &m_Header, sizeof(m_Header), 0) !=
+            static_cast<ssize_t>(sizeof(m_Header)) ||
+        pread(m_Fd, &m_SourceHeader, sizeof(m_SourceHeader),
+              sizeof(m_Header)) != static_cast<ssize_t>(sizeof(HeaderType))) {
+      m_ErrorCode = ErrorCode::READ_ERROR;
+      return;
+    }
+    if (m_Header.magic != expected.magic ||
+        m_Header.version != expected.version ||
+        m_Header.containerSize != expected.containerSize ||
+        m_Header.blockSize == 0) {
+      m_ErrorCode = ErrorCode::MAGIC_MISMATCH;
+      return;
+    }
+    m_BlockOffsets.resize(getBlockCount() + 1);
+    auto expectedReadSize =
+        static_cast<ssize_t>(m_BlockOffsets.size() * sizeof(uint64_t));
+    if (pread(m_Fd, m_BlockOffsets.data(), expectedReadSize,
+              static_cast<off_t>(m_Header.tableOffset)) != expectedReadSize) {
+      m_ErrorCode = ErrorCode::READ_ERROR;
+    }
+  }
+
+  /*!
+   * Decompress block i_u64Block into o_Containers
+   * @return false if the read failed or the block is corrupt
+   */
+  bool readBlock(uint64_t i_u64Block, std::vector<ContainerType> &o_Containers,
+                 std::vector<char> &io_Buffer, ErrorCode *o_pErrorCode) {
+    const uint64_t first = i_u64Block * m_Header.blockSize;
+    o_Containers.resize(
+        std::min<uint64_t>(m_Header.blockSize, m_Header.count - first));
+    const size_t rawSize = o_Containers.size() * sizeof(ContainerType);
+    const size_t storedSize =
+        m_BlockOffsets[i_u64Block + 1] - m_BlockOffsets[i_u64Block];
+    const auto offset = static_cast<off_t>(m_BlockOffsets[i_u64Block]);
+    char *raw = reinterpret_cast<char *>(o_Containers.data());
+
+    bool bOk = false;
+    if (storedSize == rawSize) {
+      bOk = pread(m_Fd, raw, rawSize, offset) == static_cast<ssize_t>(rawSize);
+    } else if (storedSize < rawSize) {
+      io_Buffer.resize(storedSize);
+      bOk = pread(m_Fd, io_Buffer.data(), storedSize, offset) ==
+                static_cast<ssize_t>(storedSize) &&
+            lz4::decompress(io_Buffer.data(), storedSize, raw, rawSize);
+    }
+    if (!bOk && o_pErrorCode != nullptr) {
+      *o_pErrorCode = ErrorCode::READ_ERROR;
+    }
+    return bOk;
+  }
+
+public:
+  //! Open a segment written by write
+  explicit CompressedSegment(Path i_Path) : m_Path(std::move(i_Path)) {
+    open();
+  }
+
+  CompressedSegment(const CompressedSegment &) = delete;
+  CompressedSegment &operator=(const CompressedSegment &) = delete;
+
+  ~CompressedSegment() {
+    if (m_Fd >= 0) {
+      close(m_Fd);
+    }
+  }
+
+  /*!
+   * Compress every stored container of i_Source, oldest first. The segment
+   * is written next to i_Path and renamed into place once it is synced.
+   * @param i_Source must not be appended to meanwhile
+   * @param i_Path
+   * @param i_u32BlockSize containers per block
+   * @param o_pErrorCode
+   * @return false if reading the source or writing the segment failed
+   */
+  static bool write(File &i_Source, const Path &i_Path,
+                    uint32_t i_u32BlockSize = 1024,
+                    ErrorCode *o_pErrorCode = nullptr) {
+    const Path temporary = i_Path.string() + ".tmp";
+    int32_t fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                        0644); // NOLINT(hicpp-signed-bitwise)
+    if (fd < 0) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::OPEN_ERROR;
+      }
+      return false;
+    }
+
+    SegmentHeader header;
+    header.blockSize = std::max(i_u32BlockSize, 1U);
+    const HeaderType sourceHeader = i_Source.getHeader();
+    std::vector<uint64_t> offsets{
+        static_cast<uint64_t>(getFirstBlockOffset())};
+    std::vector<char> compressed;
+    ErrorCode r = ErrorCode::OK;
+    bool bWritten = true;
+    auto writeBlock = [&](Span<const ContainerType> i_Block) {
+      const auto *raw = reinterpret_cast<const char *>(i_Block.data());
+      const size_t rawSize = i_Block.size_bytes();
+      compressed.resize(lz4::compressBound(rawSize));
+      size_t size =
+          lz4::compress(raw, rawSize, compressed.data(), compressed.size());
+      if (size == 0 || size >= rawSize) {
+        size = rawSize;
+      } else {
+        raw = compressed.data();
+      }
+      bWritten =
+          writeAt(fd, raw, size, static_cast<off_t>(offsets.back()));
+      offsets.emplace_back(offsets.back() + size);
+      header.count += i_Block.size();
+    };
+    // chunks come short if a read filter hides containers, every block but
+    // the last has to hold exactly blockSize of them
+    std::vector<ContainerType> pending;
+    pending.reserve(header.blockSize);
+    bool bRead = i_Source.getLogicalEntriesChunked(
+        [&](Span<const ContainerType> i_Chunk) {
+          // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+          for (size_t i = 0; i < i_Chunk.size() && bWritten;) {
+            const size_t count = std::min<size_t>(
+                i_Chunk.size() - i, header.blockSize - pending.size());
+            pending.insert(pending.end(), i_Chunk.begin() + i,
+                           i_Chunk.begin() + i + count);
+            i += count;
+            if (pending.size() == header.blockSize) {
+              writeBlock(pending);
+              pending.clear();
+            }
+          }
+        },
+        0, 0, header.blockSize, &r);
+    if (bRead && bWritten && !pending.empty()) {
+      writeBlock(pending);
+    }
+
+    header.tableOffset = offsets.back();
+    bool bOk =
+        bRead && bWritten &&
+        writeAt(fd, offsets.data(), offsets.size() * sizeof(uint64_t),
+                static_cast<off_t>(header.tableOffset)) &&
+        writeAt(fd, &header, sizeof(header), 0) &&
+        writeAt(fd, &sourceHeader, sizeof(sourceHeader), sizeof(header)) &&
+        fsync(fd) == 0;
+    close(fd);
+    if (bOk) {
+      std::error_code error;
+      std::filesystem::rename(temporary, i_Path, error);
+      bOk = !error;
+    }
+    if (!bOk) {
+      std::error_code error;
+      std::filesystem::remove(temporary, error);
+      if (r == ErrorCode::OK) {
+        r = bRead ? ErrorCode::WRITE_ERROR : ErrorCode::READ_ERROR;
+      }
+    }
+    if (o_pErrorCode != nullptr && r != ErrorCode::OK) {
+      *o_pErrorCode = r;
+    }
+    return bOk;
+  }
+
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+
+  [[nodiscard]] bool isOpen() const { return m_ErrorCode == ErrorCode::OK; }
+
+  //! @return header of the file the segment was written from
+  [[nodiscard]] const HeaderType &getSourceHeader() const {
+    return m_SourceHeader;
+  }
+
+  [[nodiscard]] uint64_t getEntryCount() const { return m_Header.count; }
+
+  [[nodiscard]] uint32_t getBlockSize() const { return m_Header.blockSize; }
+
+  [[nodiscard]] uint64_t getBlockCount() const {
+    return (m_Header.count + m_Header.blockSize - 1) / m_Header.blockSize;
+  }
+
+  //! @return bytes taken by the blocks, without headers and table
+  [[nodiscard]] uint64_t getCompressedSize() const {
+    return m_BlockOffsets.empty()
+               ? 0
+               : m_BlockOffsets.back() - m_BlockOffsets.front();
+  }
+
+  /*!
+   * Decompresses only the block holding i_u64Index, unless it is the block
+   * the last call needed
+   * @param i_u64Index
+   * @param o_Container
+   * @param o_pErrorCode
+   * @return false if i_u64Index is not stored or the block could not be read
+   */
+  bool getEntry(uint64_t i_u64Index, ContainerType &o_Container,
+                ErrorCode *o_pErrorCode = nullptr) {
+    if (!isOpen() || i_u64Index >= m_Header.count) {
+      return false;
+    }
+    const uint64_t block = i_u64Index / m_Header.blockSize;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (block != m_u64CachedBlock) {
+      std::vector<char> buffer;
+      m_u64CachedBlock = UINT64_MAX;
+      if (!readBlock(block, m_CachedBlock, buffer, o_pErrorCode)) {
+        return false;
+      }
+      m_u64CachedBlock = block;
+    }
+    o_Container = m_CachedBlock[i_u64Index % m_Header.blockSize];
+    return true;
+  }
+
+  /*!
+   * @param o_Containers resized to i_u64Count
+   * @param i_u64First
+   * @param i_u64Count
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a block could not be read
+   */
+  bool getEntries(std::vector<ContainerType> &o_Containers,
+                  uint64_t i_u64First, uint64_t i_u64Count,
+                  ErrorCode *o_pErrorCode = nullptr) {
+    if (!isOpen() || i_u64First + i_u64Count > m_Header.count) {
+      return false;
+    }
+    o_Containers.resize(i_u64Count);
+    std::vector<ContainerType> block;
+    std::vector<char> buffer;
+    uint64_t done = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (done < i_u64Count) {
+      const uint64_t index = i_u64First + done;
+      if (!readBlock(index / m_Header.blockSize, block, buffer,
+                     o_pErrorCode)) {
+        return false;
+      }
+      const uint64_t offset = index % m_Header.blockSize;
+      const uint64_t count =
+          std::min<uint64_t>(block.size() - offset, i_u64Count - done);
+      std::copy_n(block.begin() + offset, count, o_Containers.begin() + done);
+      done += count;
+    }
+    return true;
+  }
+
+  /*!
+   * Decompress one block after the other, reusing one buffer
+   * @param i_Callback gets each block in order
+   * @param o_pErrorCode
+   * @return false if a block could not be read
+   */
+  bool getEntriesChunked(
+      const std::function<void(Span<const ContainerType>)> &i_Callback,
+      ErrorCode *o_pErrorCode = nullptr) {
+    if (!isOpen()) {
+      return false;
+    }
+    std::vector<ContainerType> block;
+    std::vector<char> buffer;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint64_t i = 0; i < getBlockCount(); i++) {
+      if (!readBlock(i, block, buffer, o_pErrorCode)) {
+        return false;
+      }
+      i_Callback(Span<const ContainerType>(block.data(), block.size()));
+    }
+    return true;
+  }
+
+  /*!
+   * Append every container to o_File, e.g. to restore a segment
+   * @param o_File
+   * @param o_pErrorCode
+   * @return false if a block could not be read or an append failed
+   */
+  bool appendTo(File &o_File, ErrorCode *o_pErrorCode = nullptr) {
+    ErrorCode r = ErrorCode::OK;
+    bool bOk = getEntriesChunked(
+        [&o_File, &r](Span<const ContainerType> i_Block) {
+          if (r == ErrorCode::OK) {
+            r = o_File.append(i_Block);
+          }
+        },
+        o_pErrorCode);
+    if (r != ErrorCode::OK && o_pErrorCode != nullptr) {
+      *o_pErrorCode = r;
+    }
+    return bOk && r == ErrorCode::OK;
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__COMPRESSEDSEGMENT_H_
@@ -5,7 +5,10 @@
 #ifndef BINFMT__FILEUTILS_H_
 #define BINFMT__FILEUTILS_H_
 
+#include <algorithm>
 #include <filesystem>
+#include <iostream>
+#include <vector>
 
 namespace binfmt {
 
@@ -66,12 +69,13 @@ struct FileUtils {
   /*!
    * Calls syncfs on the fp and fcloses it afterwards
    * @param fp
+   * @param SyncFileSystem false to only fsync the file itself
    * @return
    */
-  static bool CloseBinaryFile(FILE *fp) {
+  static bool CloseBinaryFile(FILE *fp, bool SyncFileSystem = true) {
     auto fn = fileno(fp);
     (void)lockf(fn, F_ULOCK, 0);
-    auto r = syncfs(fn);
+    auto r = SyncFileSystem ? syncfs(fn) : fsync(fn);
     return fclose(fp) == 0 && r == 0;
   }
 
@@ -286,7 +290,8 @@ struct FileUtils {
   /*!
    * Remove an entry at the specified position,
    * move all entries to the beginning and truncate the file by
-   * sizeof(EntryType)
+   * sizeof(EntryType). Reopens the file for every entry it moves,
+   * RemoveEntries does the same with one open.
    * @tparam HeaderType
    * @tparam EntryType
    * @param FilePath
@@ -330,6 +335,163 @@ struct FileUtils {
     return ok;
   }
 
+  /*!
+   * Move Length bytes of an open file from Source down to Destination, front
+   * to back. Pieces whose source and destination do not overlap and are at
+   * least as large as Buffer are copied by copy_file_range, which keeps the
+   * data in the kernel, the rest goes through Buffer.
+   * @param Fd
+   * @param Source
+   * @param Destination has to be lower than Source
+   * @param Length
+   * @param Buffer
+   * @return false if a read or write failed
+   */
+  static bool MoveData(int Fd, uint64_t Source, uint64_t Destination,
+                       uint64_t Length, std::vector<char> &Buffer) {
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (Length > 0) {
+      ssize_t moved = -1;
+#ifdef __linux__
+      if (Source - Destination >= Buffer.size()) {
+        auto in = static_cast<off_t>(Source);
+        auto out = static_cast<off_t>(Destination);
+        moved = copy_file_range(Fd, &in, Fd, &out,
+                                std::min(Length, Source - Destination), 0);
+      }
+#endif
+      if (moved <= 0) {
+        auto n = static_cast<ssize_t>(std::min<uint64_t>(Length, Buffer.size()));
+        if (pread(Fd, Buffer.data(), n, static_cast<off_t>(Source)) != n ||
+            pwrite(Fd, Buffer.data(), n, static_cast<off_t>(Destination)) !=
+                n) {
+          return false;
+        }
+        moved = n;
+      }
+      Source += static_cast<uint64_t>(moved);
+      Destination += static_cast<uint64_t>(moved);
+      Length -= static_cast<uint64_t>(moved);
+    }
+    return true;
+  }
+
+  /*!
+   * Remove the entries of the sorted, disjoint ranges [first, end) and move
+   * the rest down in one pass. The file is opened, locked and synced once.
+   * @tparam HeaderType
+   * @tparam EntryType
+   * @param FilePath
+   * @param Ranges
+   * @return false if a range is out of bounds or moving / truncating failed
+   */
+  template <typename HeaderType, typename EntryType>
+  static bool
+  RemoveRanges(const std::string &FilePath,
+               const std::vector<std::pair<uint32_t, uint32_t>> &Ranges) {
+    auto ec = GetEntryCount<HeaderType, EntryType>(FilePath);
+    uint32_t end = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (const auto &range : Ranges) {
+      if (range.first < end || range.first >= range.second) {
+        return false;
+      }
+      end = range.second;
+    }
+    if (Ranges.empty() || end > ec) {
+      return false;
+    }
+    auto *fp = OpenBinaryFile(FilePath);
+    if (fp == nullptr) {
+      return false;
+    }
+    auto offset = [](uint64_t Position) {
+      return sizeof(HeaderType) + Position * sizeof(EntryType);
+    };
+    std::vector<char> buffer(std::min<uint64_t>(
+        offset(ec) - offset(Ranges.front().second) + 1, 4U << 20U));
+    uint64_t destination = offset(Ranges.front().first);
+    bool ok = true;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (size_t i = 0; ok && i < Ranges.size(); i++) {
+      uint32_t keepEnd = i + 1 < Ranges.size() ? Ranges[i + 1].first : ec;
+      uint64_t length = offset(keepEnd) - offset(Ranges[i].second);
+      ok = MoveData(fileno(fp), offset(Ranges[i].second), destination, length,
+                    buffer);
+      destination += length;
+    }
+    ok = ok && ftruncate(fileno(fp), static_cast<off_t>(destination)) == 0;
+    return CloseBinaryFile(fp, false) && ok;
+  }
+
+  /*!
+   * Remove the entry at Position, see RemoveRanges
+   * @tparam HeaderType
+   * @tparam EntryType
+   * @param FilePath
+   * @param Position
+   * @return false if Position is out of bounds or moving / truncating failed
+   */
+  template <typename HeaderType, typename EntryType>
+  static bool RemoveEntries(const std::string &FilePath, uint32_t Position) {
+    return Position != UINT32_MAX &&
+           RemoveRanges<HeaderType, EntryType>(FilePath,
+                                               {{Position, Position + 1}});
+  }
+
+  /*!
+   * Remove Count entries starting at First, see RemoveRanges
+   * @tparam HeaderType
+   * @tparam EntryType
+   * @param FilePath
+   * @param First
+   * @param Count
+   * @return false if the range is out of bounds or moving / truncating failed
+   */
+  template <typename HeaderType, typename EntryType>
+  static bool RemoveEntries(const std::string &FilePath, uint32_t First,
+                            uint32_t Count) {
+    if (Count == 0) {
+      return true;
+    }
+    if (First + static_cast<uint64_t>(Count) > UINT32_MAX) {
+      return false;
+    }
+    return RemoveRanges<HeaderType, EntryType>(FilePath,
+                                               {{First, First + Count}});
+  }
+
+  /*!
+   * Remove the entries at Positions, in any order, see RemoveRanges
+   * @tparam HeaderType
+   * @tparam EntryType
+   * @param FilePath
+   * @param Positions
+   * @return false if a position is out of bounds or moving / truncating
+   * failed
+   */
+  template <typename HeaderType, typename EntryType>
+  static bool RemoveEntries(const std::string &FilePath,
+                            std::vector<uint32_t> Positions) {
+    if (Positions.empty()) {
+      return true;
+    }
+    std::sort(Positions.begin(), Positions.end());
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint32_t position : Positions) {
+      if (position == UINT32_MAX) {
+        return false;
+      }
+      if (!ranges.empty() && position <= ranges.back().second) {
+        ranges.back().second = std::max(ranges.back().second, position + 1);
+      } else {
+        ranges.emplace_back(position, position + 1);
+      }
+    }
+    return RemoveRanges<HeaderType, EntryType>(FilePath, ranges);
+  }
+
   /*!
    * Delete a file if it exists
    * @param FilePath
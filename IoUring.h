@@ -0,0 +1,352 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__IOURING_H_
+#define BINFMT__IOURING_H_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace binfmt {
+
+/*!
+ * Minimal io_uring wrapper on top of the raw system calls, so no liburing is
+ * needed. Not thread safe, callers serialize access.
+ * Usage: prepare* one or more requests, then submitAndWait for their results.
+ */
+class IoUring {
+  int m_RingFd = -1;
+  bool m_bFixedFile = false;
+
+  void *m_pSqRing = nullptr;
+  size_t m_szSqRingSize = 0;
+  void *m_pCqRing = nullptr;
+  size_t m_szCqRingSize = 0;
+  io_uring_sqe *m_pSqes = nullptr;
+  size_t m_szSqesSize = 0;
+
+  unsigned *m_pSqHead = nullptr;
+  unsigned *m_pSqTail = nullptr;
+  unsigned *m_pSqArray = nullptr;
+  unsigned m_u32SqMask = 0;
+  unsigned m_u32SqEntries = 0;
+  unsigned *m_pCqHead = nullptr;
+  unsigned *m_pCqTail = nullptr;
+  io_uring_cqe *m_pCqes = nullptr;
+  unsigned m_u32CqMask = 0;
+
+  // prepared but not yet submitted requests
+  unsigned m_u32Pending = 0;
+
+  static int setup(unsigned i_u32Entries, io_uring_params *io_pParams) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_setup, i_u32Entries, io_pParams));
+  }
+
+  int enter(unsigned i_u32Submit, unsigned i_u32MinComplete) const {
+    unsigned flags = i_u32MinComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    return static_cast<int>(syscall(__NR_io_uring_enter, m_RingFd, i_u32Submit,
+                                    i_u32MinComplete, flags, nullptr, 0));
+  }
+
+  int registerResource(unsigned i_u32Opcode, const void *i_pArgs,
+                       unsigned i_u32Count) const {
+    return static_cast<int>(syscall(__NR_io_uring_register, m_RingFd,
+                                    i_u32Opcode, i_pArgs, i_u32Count));
+  }
+
+  template <typename T> T *at(void *i_pBase, uint32_t i_u32Offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(i_pBase) + i_u32Offset);
+  }
+
+  void destroy() {
+    if (m_pSqes != nullptr) {
+      (void)munmap(m_pSqes, m_szSqesSize);
+      m_pSqes = nullptr;
+    }
+    if (m_pCqRing != nullptr && m_pCqRing != m_pSqRing) {
+      (void)munmap(m_pCqRing, m_szCqRingSize);
+    }
+    m_pCqRing = nullptr;
+    if (m_pSqRing != nullptr) {
+      (void)munmap(m_pSqRing, m_szSqRingSize);
+      m_pSqRing = nullptr;
+    }
+    if (m_RingFd >= 0) {
+      close(m_RingFd);
+      m_RingFd = -1;
+    }
+  }
+
+  io_uring_sqe *nextSqe(int i_Fd, uint8_t i_u8Opcode, uint64_t i_u64UserData,
+                        bool i_bLink) {
+    if (!isAvailable()) {
+      return nullptr;
+    }
+    unsigned head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *m_pSqTail + m_u32Pending;
+    if (tail - head >= m_u32SqEntries) {
+      return nullptr;
+    }
+    unsigned index = tail & m_u32SqMask;
+    io_uring_sqe *sqe = &m_pSqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = i_u8Opcode;
+    sqe->fd = m_bFixedFile ? 0 : i_Fd;
+    sqe->flags = (m_bFixedFile ? IOSQE_FIXED_FILE : 0) |
+                 (i_bLink ? IOSQE_IO_LINK : 0);
+    sqe->user_data = i_u64UserData;
+    m_pSqArray[index] = index;
+    m_u32Pending++;
+    return sqe;
+  }
+
+public:
+  /*!
+   * Create a ring with room for i_u32Entries requests
+   * @param i_u32Entries
+   */
+  explicit IoUring(unsigned i_u32Entries) {
+    io_uring_params params{};
+    m_RingFd = setup(i_u32Entries, &params);
+    if (m_RingFd < 0) {
+      return;
+    }
+
+    m_szSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_szCqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+      m_szSqRingSize = m_szCqRingSize = std::max(m_szSqRingSize, m_szCqRingSize);
+    }
+
+    m_pSqRing = mmap(nullptr, m_szSqRingSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQ_RING);
+    if (m_pSqRing == MAP_FAILED) {
+      m_pSqRing = nullptr;
+      destroy();
+      return;
+    }
+    m_pCqRing = singleMmap
+                    ? m_pSqRing
+                    : mmap(nullptr, m_szCqRingSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, m_RingFd,
+                           IORING_OFF_CQ_RING);
+    if (m_pCqRing == MAP_FAILED) {
+      m_pCqRing = nullptr;
+      destroy();
+      return;
+    }
+    m_szSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_szSqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, m_RingFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      destroy();
+      return;
+    }
+    m_pSqes = static_cast<io_uring_sqe *>(sqes);
+
+    m_pSqHead = at<unsigned>(m_pSqRing, params.sq_off.head);
+    m_pSqTail = at<unsigned>(m_pSqRing, params.sq_off.tail);
+    m_pSqArray = at<unsigned>(m_pSqRing, params.sq_off.array);
+    m_u32SqMask = *at<unsigned>(m_pSqRing, params.sq_off.ring_mask);
+    m_u32SqEntries = params.sq_entries;
+    m_pCqHead = at<unsigned>(m_pCqRing, params.cq_off.head);
+    m_pCqTail = at<unsigned>(m_pCqRing, params.cq_off.tail);
+    m_pCqes = at<io_uring_cqe>(m_pCqRing, params.cq_off.cqes);
+    m_u32CqMask = *at<unsigned>(m_pCqRing, params.cq_off.ring_mask);
+  }
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  ~IoUring() { destroy(); }
+
+  //! @return false if the kernel does not support io_uring or setup failed
+  [[nodiscard]] bool isAvailable() const { return m_pSqes != nullptr; }
+
+  //! @return number of requests which can be prepared before submitting
+  [[nodiscard]] unsigned getDepth() const { return m_u32SqEntries; }
+
+  /*!
+   * Register i_Fd as fixed file 0, requests prepared afterwards refer to it
+   * by index and skip the per-request file lookup
+   * @param i_Fd
+   * @return false if registration failed, requests then keep using i_Fd
+   */
+  bool registerFile(int i_Fd) {
+    m_bFixedFile = registerResource(IORING_REGISTER_FILES, &i_Fd, 1) == 0;
+    return m_bFixedFile;
+  }
+
+  /*!
+   * Register a buffer as fixed buffer 0 for prepareReadFixed /
+   * prepareWriteFixed
+   * @param i_pBuffer
+   * @param i_szSize
+   * @return false if registration failed
+   */
+  bool registerBuffer(void *i_pBuffer, size_t i_szSize) {
+    iovec iov{i_pBuffer, i_szSize};
+    return registerResource(IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+  }
+
+  bool prepareRead(int i_Fd, void *o_pBuffer, uint32_t i_u32Size,
+                   uint64_t i_u64Offset, uint64_t i_u64UserData,
+                   bool i_bLink = false) {
+    auto *sqe = nextSqe(i_Fd, IORING_OP_READ, i_u64UserData, i_bLink);
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->addr = reinterpret_cast<uint64_t>(o_pBuffer);
+    sqe->len = i_u32Size;
+    sqe->off = i_u64Offset;
+    return true;
+  }
+
+  bool prepareWrite(int i_Fd, const void *i_pBuffer, uint32_t i_u32Size,
+                    uint64_t i_u64Offset, uint64_t i_u64UserData,
+                    bool i_bLink = false) {
+    auto *sqe = nextSqe(i_Fd, IORING_OP_WRITE, i_u64UserData, i_bLink);
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->addr = reinterpret_cast<uint64_t>(i_pBuffer);
+    sqe->len = i_u32Size;
+    sqe->off = i_u64Offset;
+    return true;
+  }
+
+  //! i_pBuffer has to lie within the registered buffer
+  bool prepareWriteFixed(int i_Fd, const void *i_pBuffer, uint32_t i_u32Size,
+                         uint64_t i_u64Offset, uint64_t i_u64UserData,
+                         bool i_bLink = false) {
+    auto *sqe = nextSqe(i_Fd, IORING_OP_WRITE_FIXED, i_u64UserData, i_bLink);
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->addr = reinterpret_cast<uint64_t>(i_pBuffer);
+    sqe->len = i_u32Size;
+    sqe->off = i_u64Offset;
+    sqe->buf_index = 0;
+    return true;
+  }
+
+  //! o_pBuffer has to lie within the registered buffer
+  bool prepareReadFixed(int i_Fd, void *o_pBuffer, uint32_t i_u32Size,
+                        uint64_t i_u64Offset, uint64_t i_u64UserData,
+                        bool i_bLink = false) {
+    auto *sqe = nextSqe(i_Fd, IORING_OP_READ_FIXED, i_u64UserData, i_bLink);
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->addr = reinterpret_cast<uint64_t>(o_pBuffer);
+    sqe->len = i_u32Size;
+    sqe->off = i_u64Offset;
+    sqe->buf_index = 0;
+    return true;
+  }
+
+  bool prepareFsync(int i_Fd, bool i_bDataSync, uint64_t i_u64UserData,
+                    bool i_bLink = false) {
+    auto *sqe = nextSqe(i_Fd, IORING_OP_FSYNC, i_u64UserData, i_bLink);
+    if (sqe == nullptr) {
+      return false;
+    }
+    sqe->fsync_flags = i_bDataSync ? IORING_FSYNC_DATASYNC : 0;
+    return true;
+  }
+
+  /*!
+   * Submit every prepared request and wait until all of them completed. This
+   * blocks, it saves system calls but does not make the requests
+   * asynchronous.
+   * @param o_pResults receives the result of request n at index user_data,
+   * needs room for as many results as requests were prepared
+   * @return false if submitting failed, results are undefined then. No
+   * request touches its buffer after this returned, if that cannot be
+   * ensured the ring is torn down and isAvailable() turns false.
+   */
+  bool submitAndWait(int32_t *o_pResults) {
+    if (!isAvailable()) {
+      m_u32Pending = 0;
+      return false;
+    }
+    const unsigned count = m_u32Pending;
+    const unsigned tail = *m_pSqTail + count;
+    __atomic_store_n(m_pSqTail, tail, __ATOMIC_RELEASE);
+    m_u32Pending = 0;
+
+    unsigned completed = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (completed < count) {
+      unsigned head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+      if (enter(tail - head, 1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        drain(count, completed);
+        return false;
+      }
+      completed += reap(o_pResults);
+    }
+    return true;
+  }
+
+private:
+  //! Move the completions to o_pResults, if given
+  //! @return number of completions
+  unsigned reap(int32_t *o_pResults) {
+    unsigned head = *m_pCqHead;
+    const unsigned tail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+    const unsigned count = tail - head;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; head != tail; head++) {
+      const io_uring_cqe &cqe = m_pCqes[head & m_u32CqMask];
+      if (o_pResults != nullptr) {
+        o_pResults[cqe.user_data] = cqe.res;
+      }
+    }
+    __atomic_store_n(m_pCqHead, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  /*!
+   * After a failed enter, take back the requests the kernel did not pick up
+   * and wait for the ones it did, so none of them runs against a buffer the
+   * caller already gave up. Without SQPOLL the kernel only reads the tail
+   * within enter, so moving it back is safe. Tears the ring down if waiting
+   * fails as well. errno is kept.
+   * @param i_u32Count requests of the failed submission
+   * @param i_u32Completed of these, already reaped
+   */
+  void drain(unsigned i_u32Count, unsigned i_u32Completed) {
+    const int error = errno;
+    const unsigned head = __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE);
+    const unsigned withdrawn = *m_pSqTail - head;
+    __atomic_store_n(m_pSqTail, head, __ATOMIC_RELEASE);
+    const unsigned submitted = i_u32Count - withdrawn;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (i_u32Completed < submitted) {
+      if (enter(0, 1) < 0 && errno != EINTR) {
+        destroy();
+        break;
+      }
+      i_u32Completed += reap(nullptr);
+    }
+    errno = error;
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__IOURING_H_
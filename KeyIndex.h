@@ -0,0 +1,393 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__KEYINDEX_H_
+#define BINFMT__KEYINDEX_H_
+
+#include <sys/stat.h>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Sparse sorted index over a key of the entries, e.g. a timestamp, kept in a
+ * sidecar file next to the BinaryFile. Every stride-th record contributes a
+ * (key, record) sample, so findRange is a binary search over count / stride
+ * samples followed by reading only the candidate ranges.
+ * Keys have to be non-decreasing in append order.
+ * The sidecar is a SidecarHeader followed by a plain array of Samples, so it
+ * can be mapped as is. It is maintained on append but not synced, on open it
+ * is checked against the data file and caught up or rebuilt from it.
+ * Lookups skip the samples of records a ring has overwritten, they are
+ * dropped once they make up half of the samples, so a ring's sidecar stays
+ * bounded.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ * @tparam KeyType trivially copyable and ordered by operator<
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType,
+          typename KeyType>
+class KeyIndex : public AppendObserver<ContainerType> {
+public:
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+  using KeyFunction = std::function<KeyType(const EntryType &)>;
+
+  struct SidecarHeader {
+    uint32_t magic{0x4B494458};
+    uint32_t version{0x0001};
+    uint32_t stride{0};
+    uint32_t keySize{sizeof(KeyType)};
+  };
+
+  //! The key of the record with number record
+  struct Sample {
+    KeyType key;
+    uint64_t record;
+  };
+
+  //! Physical indices [begin, end), ready for getEntriesFromTo
+  struct IndexRange {
+    uint32_t begin;
+    uint32_t end;
+  };
+
+private:
+  static_assert(std::is_trivially_copyable_v<KeyType>,
+                "the sidecar stores keys as raw bytes");
+
+  File &m_File;
+  KeyFunction m_KeyOf;
+  const uint32_t m_u32Stride;
+  Path m_Path;
+  int32_t m_Fd = -1;
+  ErrorCode m_ErrorCode = ErrorCode::OK;
+
+  // written by the appending thread, searched by readers
+  std::mutex m_Mutex;
+  std::vector<Sample> m_Samples;
+
+  [[nodiscard]] static off_t getSampleOffset(size_t i_szIndex) {
+    return static_cast<off_t>(sizeof(SidecarHeader) +
+                              i_szIndex * sizeof(Sample));
+  }
+
+  //! Write m_Samples from i_szFirst on to the sidecar
+  void writeSamples(size_t i_szFirst) {
+    if (m_Fd < 0 || i_szFirst >= m_Samples.size()) {
+      return;
+    }
+    auto expectedWriteSize = static_cast<ssize_t>(
+        (m_Samples.size() - i_szFirst) * sizeof(Sample));
+    if (pwrite(m_Fd, m_Samples.data() + i_szFirst, expectedWriteSize,
+               getSampleOffset(i_szFirst)) != expectedWriteSize) {
+      m_ErrorCode = ErrorCode::WRITE_ERROR;
+    }
+  }
+
+  //! @return first sample of a record from i_u64Record on
+  typename std::vector<Sample>::iterator getSampleFrom(uint64_t i_u64Record) {
+    return std::lower_bound(m_Samples.begin(), m_Samples.end(), i_u64Record,
+                            [](const Sample &i_Sample, uint64_t i_u64Value) {
+                              return i_Sample.record < i_u64Value;
+                            });
+  }
+
+  //! Drop every sample of a record from i_u64Count on
+  void truncateSamples(uint64_t i_u64Count) {
+    m_Samples.erase(getSampleFrom(i_u64Count), m_Samples.end());
+    if (m_Fd >= 0 && ftruncate(m_Fd, getSampleOffset(m_Samples.size())) != 0) {
+      m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+    }
+  }
+
+  /*!
+   * Drop the samples of records a ring of i_u64MaxEntries has overwritten
+   * once they are at least half of them and rewrite the sidecar, which
+   * keeps the rewrites amortized
+   * @param i_u64Count records appended so far
+   * @param i_u64MaxEntries
+   */
+  void pruneSamples(uint64_t i_u64Count, uint64_t i_u64MaxEntries) {
+    if (i_u64MaxEntries == 0 || i_u64Count <= i_u64MaxEntries) {
+      return;
+    }
+    auto live = getSampleFrom(i_u64Count - i_u64MaxEntries);
+    const auto stale = static_cast<size_t>(live - m_Samples.begin());
+    if (stale == 0 || stale * 2 < m_Samples.size()) {
+      return;
+    }
+    m_Samples.erase(m_Samples.begin(), live);
+    writeSamples(0);
+    if (m_Fd >= 0 && ftruncate(m_Fd, getSampleOffset(m_Samples.size())) != 0) {
+      m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+    }
+  }
+
+  [[nodiscard]] uint64_t getFirstSampledRecord(uint64_t i_u64Record) const {
+    return (i_u64Record + m_u32Stride - 1) / m_u32Stride * m_u32Stride;
+  }
+
+  //! @return false if the sample does not describe what the file stores
+  bool isSampleStored(const Sample &i_Sample, const HeaderType &i_Header) {
+    const uint64_t stored =
+        i_Header.maxEntries != 0 && i_Header.count > i_Header.maxEntries
+            ? i_Header.maxEntries
+            : i_Header.count;
+    if (i_Sample.record >= i_Header.count) {
+      return false;
+    }
+    if (i_Sample.record < i_Header.count - stored) {
+      // overwritten by the ring, nothing left to compare with
+      return true;
+    }
+    ContainerType container;
+    const uint64_t index = i_Header.maxEntries == 0
+                               ? i_Sample.record
+                               : i_Sample.record % i_Header.maxEntries;
+    return m_File.getEntriesInto(Span<ContainerType>(&container, 1),
+                                 static_cast<uint32_t>(index)) &&
+           !(m_KeyOf(container.entry) < i_Sample.key) &&
+           !(i_Sample.key < m_KeyOf(container.entry));
+  }
+
+  /*!
+   * Load the sidecar, drop what the data file no longer has and sample the
+   * records appended while the index was not attached
+   */
+  void load() {
+    m_Fd = open(m_Path.c_str(), O_RDWR | O_CREAT,
+                0644); // NOLINT(hicpp-signed-bitwise)
+    if (m_Fd < 0) {
+      m_ErrorCode = ErrorCode::OPEN_ERROR;
+      return;
+    }
+
+    const auto header = m_File.getHeader();
+    SidecarHeader expected;
+    expected.stride = m_u32Stride;
+    SidecarHeader existing{};
+    struct stat st {};
+    bool bValid =
+        fstat(m_Fd, &st) == 0 &&
+        pread(m_Fd, &existing, sizeof(existing), 0) ==
+            static_cast<ssize_t>(sizeof(existing)) &&
+        existing.magic == expected.magic &&
+        existing.version == expected.version &&
+        existing.stride == expected.stride &&
+        existing.keySize == expected.keySize;
+    if (bValid) {
+      m_Samples.resize((st.st_size - sizeof(SidecarHeader)) / sizeof(Sample));
+      auto expectedReadSize =
+          static_cast<ssize_t>(m_Samples.size() * sizeof(Sample));
+      bValid = pread(m_Fd, m_Samples.data(), expectedReadSize,
+                     getSampleOffset(0)) == expectedReadSize;
+    }
+    if (bValid) {
+      truncateSamples(header.count);
+      // a data file which was cleared and refilled does not match anymore
+      bValid = m_Samples.empty() || isSampleStored(m_Samples.back(), header);
+    }
+    if (!bValid) {
+      m_Samples.clear();
+      if (ftruncate(m_Fd, 0) != 0 ||
+          pwrite(m_Fd, &expected, sizeof(expected), 0) !=
+              static_cast<ssize_t>(sizeof(expected))) {
+        m_ErrorCode = ErrorCode::WRITE_ERROR;
+        return;
+      }
+    }
+
+    const uint64_t stored =
+        header.maxEntries != 0 && header.count > header.maxEntries
+            ? header.maxEntries
+            : header.count;
+    uint64_t record = m_Samples.empty() ? header.count - stored
+                                        : m_Samples.back().record + 1;
+    const size_t first = m_Samples.size();
+    ContainerType container;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (record = getFirstSampledRecord(record); record < header.count;
+         record += m_u32Stride) {
+      const uint64_t index =
+          header.maxEntries == 0 ? record : record % header.maxEntries;
+      if (!m_File.getEntriesInto(Span<ContainerType>(&container, 1),
+                                 static_cast<uint32_t>(index), &m_ErrorCode)) {
+        break;
+      }
+      m_Samples.emplace_back(Sample{m_KeyOf(container.entry), record});
+    }
+    writeSamples(first);
+    pruneSamples(header.count, header.maxEntries);
+  }
+
+public:
+  /*!
+   * Attach to i_File, loading or building the sidecar. Open it before
+   * appending, the index registers itself as an AppendObserver.
+   * @param i_File has to outlive the index
+   * @param i_KeyOf
+   * @param i_u32Stride records per sample
+   * @param i_Path defaults to the path of i_File with ".idx" appended
+   */
+  KeyIndex(File &i_File, KeyFunction i_KeyOf, uint32_t i_u32Stride = 1024,
+           Path i_Path = {})
+      : m_File(i_File), m_KeyOf(std::move(i_KeyOf)),
+        m_u32Stride(std::max(i_u32Stride, 1U)),
+        m_Path(i_Path.empty() ? Path(i_File.getPath().string() + ".idx")
+                              : std::move(i_Path)) {
+    load();
+    m_File.addAppendObserver(this);
+  }
+
+  KeyIndex(const KeyIndex &) = delete;
+  KeyIndex &operator=(const KeyIndex &) = delete;
+
+  ~KeyIndex() override {
+    m_File.removeAppendObserver(this);
+    if (m_Fd >= 0) {
+      close(m_Fd);
+    }
+  }
+
+  void onAppended(uint64_t i_u64FirstRecord,
+                  Span<const ContainerType> i_Containers) override {
+    const uint64_t end = i_u64FirstRecord + i_Containers.size();
+    uint64_t record = getFirstSampledRecord(i_u64FirstRecord);
+    if (record >= end) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const size_t first = m_Samples.size();
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (; record < end; record += m_u32Stride) {
+      m_Samples.emplace_back(Sample{
+          m_KeyOf(i_Containers[record - i_u64FirstRecord].entry), record});
+    }
+    writeSamples(first);
+    pruneSamples(end, m_File.getHeader().maxEntries);
+  }
+
+  void onTruncated(uint64_t i_u64Count) override {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    truncateSamples(i_u64Count);
+  }
+
+  /*!
+   * Find the physical ranges which may hold keys in [i_KeyLow, i_KeyHigh].
+   * Besides the matches they hold up to a stride of entries on either side.
+   * Oldest first, two ranges if the candidates wrap around the ring.
+   * @param i_KeyLow
+   * @param i_KeyHigh
+   * @param o_Ranges
+   * @return false if no stored entry can match
+   */
+  bool findRange(const KeyType &i_KeyLow, const KeyType &i_KeyHigh,
+                 std::vector<IndexRange> &o_Ranges) {
+    o_Ranges.clear();
+    const auto header = m_File.getHeader();
+    const uint64_t stored =
+        header.maxEntries != 0 && header.count > header.maxEntries
+            ? header.maxEntries
+            : header.count;
+    uint64_t begin = header.count - stored;
+    uint64_t end = header.count;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      // samples of overwritten records say nothing about the stored ones
+      auto live = getSampleFrom(begin);
+      // everything before the last sample below i_KeyLow is below it too
+      auto low = std::lower_bound(
+          live, m_Samples.end(), i_KeyLow,
+          [](const Sample &i_Sample, const KeyType &i_Key) {
+            return i_Sample.key < i_Key;
+          });
+      if (low != live) {
+        begin = std::max(begin, std::prev(low)->record);
+      }
+      // everything from the first sample above i_KeyHigh on is above it too
+      auto high = std::upper_bound(
+          low, m_Samples.end(), i_KeyHigh,
+          [](const KeyType &i_Key, const Sample &i_Sample) {
+            return i_Key < i_Sample.key;
+          });
+      if (high != m_Samples.end()) {
+        end = std::min(end, high->record);
+      }
+    }
+    if (i_KeyHigh < i_KeyLow || begin >= end) {
+      return false;
+    }
+
+    if (header.maxEntries == 0) {
+      o_Ranges.emplace_back(IndexRange{static_cast<uint32_t>(begin),
+                                       static_cast<uint32_t>(end)});
+      return true;
+    }
+    const uint64_t physical = begin % header.maxEntries;
+    const uint64_t first =
+        std::min<uint64_t>(end - begin, header.maxEntries - physical);
+    o_Ranges.emplace_back(IndexRange{static_cast<uint32_t>(physical),
+                                     static_cast<uint32_t>(physical + first)});
+    if (first < end - begin) {
+      o_Ranges.emplace_back(
+          IndexRange{0, static_cast<uint32_t>(end - begin - first)});
+    }
+    return true;
+  }
+
+  /*!
+   * Read every stored container with a key in [i_KeyLow, i_KeyHigh]
+   * @param i_KeyLow
+   * @param i_KeyHigh
+   * @param o_Containers matches, oldest first
+   * @param o_pErrorCode
+   * @return false if a read failed
+   */
+  bool getEntries(const KeyType &i_KeyLow, const KeyType &i_KeyHigh,
+                  std::vector<ContainerType> &o_Containers,
+                  ErrorCode *o_pErrorCode = nullptr) {
+    o_Containers.clear();
+    std::vector<IndexRange> ranges;
+    if (!findRange(i_KeyLow, i_KeyHigh, ranges)) {
+      return true;
+    }
+    std::vector<ContainerType> candidates;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (const auto &range : ranges) {
+      if (!m_File.getEntriesFromTo(candidates, range.begin, range.end,
+                                   o_pErrorCode)) {
+        return false;
+      }
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (const auto &container : candidates) {
+        const KeyType key = m_KeyOf(container.entry);
+        if (!(key < i_KeyLow) && !(i_KeyHigh < key)) {
+          o_Containers.emplace_back(container);
+        }
+      }
+    }
+    return true;
+  }
+
+  //! @return number of samples, about count / stride, for a ring at most
+  //! about twice maxEntries / stride
+  [[nodiscard]] size_t getSampleCount() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Samples.size();
+  }
+
+  [[nodiscard]] uint32_t getStride() const { return m_u32Stride; }
+
+  [[nodiscard]] Path getPath() const { return m_Path; }
+
+  //! @return first error of a sidecar operation, the index keeps working
+  //! from memory after a failed write
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__KEYINDEX_H_
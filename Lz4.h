@@ -0,0 +1,261 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__LZ4_H_
+#define BINFMT__LZ4_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace binfmt {
+namespace lz4 {
+
+/*
+ * Self contained codec for the LZ4 block format, so the library stays header
+ * only without fetching anything at build time. Blocks are interchangeable
+ * with LZ4_compress_default / LZ4_decompress_safe of liblz4.
+ */
+
+constexpr size_t MinMatch = 4;
+// the last 5 bytes of a block are always literals
+constexpr size_t LastLiterals = 5;
+// the last match starts at least 12 bytes before the end of a block
+constexpr size_t MatchFindLimit = 12;
+constexpr size_t MaxOffset = 65535;
+constexpr uint32_t HashLog = 12;
+
+//! @return worst case compressed size of i_szSize bytes
+constexpr size_t compressBound(size_t i_szSize) {
+  return i_szSize + i_szSize / 255 + 16;
+}
+
+namespace detail {
+
+inline uint32_t read32(const uint8_t *i_pData) {
+  uint32_t r = 0;
+  std::memcpy(&r, i_pData, sizeof(r));
+  return r;
+}
+
+inline uint64_t read64(const uint8_t *i_pData) {
+  uint64_t r = 0;
+  std::memcpy(&r, i_pData, sizeof(r));
+  return r;
+}
+
+inline uint32_t hash(uint32_t i_u32Sequence) {
+  return (i_u32Sequence * 2654435761U) >> (32 - HashLog);
+}
+
+//! @return false if o_pOutput would pass i_pOutputEnd
+inline bool writeLength(uint8_t *&io_pOutput, const uint8_t *i_pOutputEnd,
+                        size_t i_szLength) {
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  for (; i_szLength >= 255; i_szLength -= 255) {
+    if (io_pOutput == i_pOutputEnd) {
+      return false;
+    }
+    *io_pOutput++ = 255;
+  }
+  if (io_pOutput == i_pOutputEnd) {
+    return false;
+  }
+  *io_pOutput++ = static_cast<uint8_t>(i_szLength);
+  return true;
+}
+
+/*!
+ * Emit one sequence, i_szMatchLength == 0 emits the closing literals only
+ * @return false if the output is too small
+ */
+inline bool writeSequence(uint8_t *&io_pOutput, const uint8_t *i_pOutputEnd,
+                          const uint8_t *i_pLiterals, size_t i_szLiterals,
+                          size_t i_szOffset, size_t i_szMatchLength) {
+  if (io_pOutput == i_pOutputEnd) {
+    return false;
+  }
+  uint8_t *token = io_pOutput++;
+  *token = static_cast<uint8_t>(std::min<size_t>(i_szLiterals, 15) << 4);
+  if (i_szLiterals >= 15 &&
+      !writeLength(io_pOutput, i_pOutputEnd, i_szLiterals - 15)) {
+    return false;
+  }
+  if (static_cast<size_t>(i_pOutputEnd - io_pOutput) < i_szLiterals) {
+    return false;
+  }
+  std::memcpy(io_pOutput, i_pLiterals, i_szLiterals);
+  io_pOutput += i_szLiterals;
+  if (i_szMatchLength == 0) {
+    return true;
+  }
+
+  if (i_pOutputEnd - io_pOutput < 2) {
+    return false;
+  }
+  *io_pOutput++ = static_cast<uint8_t>(i_szOffset & 0xFF);
+  *io_pOutput++ = static_cast<uint8_t>(i_szOffset >> 8);
+  const size_t length = i_szMatchLength - MinMatch;
+  *token |= static_cast<uint8_t>(std::min<size_t>(length, 15));
+  return length < 15 || writeLength(io_pOutput, i_pOutputEnd, length - 15);
+}
+
+} // namespace detail
+
+/*!
+ * Compress one block
+ * @param i_pSource
+ * @param i_szSize
+ * @param o_pDestination
+ * @param i_szCapacity compressBound(i_szSize) always suffices
+ * @return compressed size, 0 if it did not fit into i_szCapacity
+ */
+inline size_t compress(const char *i_pSource, size_t i_szSize,
+                       char *o_pDestination, size_t i_szCapacity) {
+  const auto *source = reinterpret_cast<const uint8_t *>(i_pSource);
+  const uint8_t *const end = source + i_szSize;
+  auto *output = reinterpret_cast<uint8_t *>(o_pDestination);
+  const uint8_t *const outputEnd = output + i_szCapacity;
+  const uint8_t *anchor = source;
+
+  if (i_szSize > MatchFindLimit) {
+    const uint8_t *const matchLimit = end - LastLiterals;
+    const uint8_t *const lastMatchStart = end - MatchFindLimit;
+    auto table = std::make_unique<std::array<uint32_t, 1U << HashLog>>();
+    const uint8_t *ip = source;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (ip <= lastMatchStart) {
+      uint32_t &slot = (*table)[detail::hash(detail::read32(ip))];
+      const uint8_t *match = source + slot;
+      slot = static_cast<uint32_t>(ip - source);
+      if (match >= ip || static_cast<size_t>(ip - match) > MaxOffset ||
+          detail::read32(match) != detail::read32(ip)) {
+        // skip faster through data which does not compress
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+      while (ip > anchor && match > source && ip[-1] == match[-1]) {
+        ip--;
+        match--;
+      }
+      const uint8_t *matchEnd = ip + MinMatch;
+      const uint8_t *reference = match + MinMatch;
+      // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+      while (matchEnd + sizeof(uint64_t) <= matchLimit &&
+             detail::read64(matchEnd) == detail::read64(reference)) {
+        matchEnd += sizeof(uint64_t);
+        reference += sizeof(uint64_t);
+      }
+      // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+      while (matchEnd < matchLimit && *matchEnd == *reference) {
+        matchEnd++;
+        reference++;
+      }
+
+      if (!detail::writeSequence(output, outputEnd, anchor,
+                                 static_cast<size_t>(ip - anchor),
+                                 static_cast<size_t>(ip - match),
+                                 static_cast<size_t>(matchEnd - ip))) {
+        return 0;
+      }
+      ip = matchEnd;
+      anchor = ip;
+    }
+  }
+
+  if (!detail::writeSequence(output, outputEnd, anchor,
+                             static_cast<size_t>(end - anchor), 0, 0)) {
+    return 0;
+  }
+  return static_cast<size_t>(output -
+                             reinterpret_cast<uint8_t *>(o_pDestination));
+}
+
+/*!
+ * Decompress one block, never reads or writes out of bounds
+ * @param i_pSource
+ * @param i_szSize compressed size
+ * @param o_pDestination
+ * @param i_szDecompressedSize exact size of the original block
+ * @return false if the block is malformed or does not have that size
+ */
+inline bool decompress(const char *i_pSource, size_t i_szSize,
+                       char *o_pDestination, size_t i_szDecompressedSize) {
+  const auto *ip = reinterpret_cast<const uint8_t *>(i_pSource);
+  const uint8_t *const inputEnd = ip + i_szSize;
+  auto *const output = reinterpret_cast<uint8_t *>(o_pDestination);
+  uint8_t *op = output;
+  uint8_t *const outputEnd = output + i_szDecompressedSize;
+
+  auto readLength = [&ip, inputEnd](size_t &io_szLength) {
+    uint8_t next = 255;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (next == 255) {
+      if (ip == inputEnd) {
+        return false;
+      }
+      next = *ip++;
+      io_szLength += next;
+    }
+    return true;
+  };
+
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (ip < inputEnd) {
+    const uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(literals)) {
+      return false;
+    }
+    if (static_cast<size_t>(inputEnd - ip) < literals ||
+        static_cast<size_t>(outputEnd - op) < literals) {
+      return false;
+    }
+    std::memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    if (ip == inputEnd) {
+      break;
+    }
+
+    if (inputEnd - ip < 2) {
+      return false;
+    }
+    const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    size_t length = token & 15;
+    if (length == 15 && !readLength(length)) {
+      return false;
+    }
+    length += MinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(op - output) ||
+        static_cast<size_t>(outputEnd - op) < length) {
+      return false;
+    }
+
+    const uint8_t *reference = op - offset;
+    if (offset == 1) {
+      std::memset(op, *reference, length);
+    } else if (offset >= length) {
+      std::memcpy(op, reference, length);
+    } else {
+      // overlapping match repeats the last offset bytes
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = 0; i < length; i++) {
+        op[i] = reference[i];
+      }
+    }
+    op += length;
+  }
+  return op == outputEnd;
+}
+
+} // namespace lz4
+} // namespace binfmt
+
+#endif // BINFMT__LZ4_H_
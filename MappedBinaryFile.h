@@ -0,0 +1,139 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__MAPPEDBINARYFILE_H_
+#define BINFMT__MAPPEDBINARYFILE_H_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * BinaryFile which additionally maps the file read-only and hands out
+ * zero-copy views of the stored containers.
+ * Appends still go through pwrite, the mapping grows lazily when a view
+ * reaches past it. Views are invalidated by the next call which remaps.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class MappedBinaryFile
+    : public BinaryFile<HeaderType, EntryType, ContainerType> {
+  using Base = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  char *m_pMapping = nullptr;
+  size_t m_szMappedSize = 0;
+
+  void unmap() {
+    if (m_pMapping != nullptr) {
+      (void)munmap(m_pMapping, m_szMappedSize);
+      m_pMapping = nullptr;
+      m_szMappedSize = 0;
+    }
+  }
+
+  /*!
+   * Make sure the first i_szSize bytes of the file are mapped.
+   * Maps at least twice the previous size, so appending and viewing in turns
+   * only remaps a logarithmic number of times.
+   * @param i_szSize
+   * @param o_pErrorCode
+   * @return false if mmap failed
+   */
+  bool ensureMapped(size_t i_szSize, ErrorCode *o_pErrorCode) {
+    if (i_szSize <= m_szMappedSize) {
+      return true;
+    }
+
+    struct stat st {};
+    if (fstat(this->getFileDescriptor(), &st) != 0) {
+      this->onSysCallError(ErrorCode::READ_ERROR, o_pErrorCode);
+      return false;
+    }
+
+    size_t size = std::max(static_cast<size_t>(st.st_size), i_szSize);
+    size = std::max(size, m_szMappedSize * 2);
+
+    unmap();
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED,
+                         this->getFileDescriptor(), 0);
+    if (mapping == MAP_FAILED) {
+      this->onSysCallError(ErrorCode::MAP_ERROR, o_pErrorCode);
+      return false;
+    }
+    m_pMapping = static_cast<char *>(mapping);
+    m_szMappedSize = size;
+    return true;
+  }
+
+public:
+  MappedBinaryFile(Path i_Path, HeaderType i_Header,
+                   BinaryFileOptions i_Options = BinaryFileOptions{})
+      : Base(std::move(i_Path), i_Header, i_Options) {}
+
+  ~MappedBinaryFile() { unmap(); }
+
+  /*!
+   * View i_u32Count containers starting at physical index i_u32Index. A view
+   * cannot leave out containers, ranges the read filter hides any of are
+   * refused. The view does not keep the filter from moving containers.
+   * @param i_u32Index
+   * @param i_u32Count
+   * @param o_pErrorCode ErrorCode::ENTRY_REMOVED if the range holds a hidden
+   * container
+   * @return empty span if the range is not stored, holds a hidden container
+   * or mapping failed
+   */
+  Span<const ContainerType> getEntriesView(uint32_t i_u32Index,
+                                           uint32_t i_u32Count,
+                                           ErrorCode *o_pErrorCode = nullptr) {
+    if (i_u32Count == 0 ||
+        static_cast<uint64_t>(i_u32Index) + i_u32Count >
+            this->getStoredEntryCount()) {
+      return {};
+    }
+    if (this->isAnyRemoved(i_u32Index, i_u32Count)) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::ENTRY_REMOVED;
+      }
+      return {};
+    }
+
+    size_t begin = this->getHeaderSize() +
+                   static_cast<size_t>(i_u32Index) * sizeof(ContainerType);
+    size_t end = begin + static_cast<size_t>(i_u32Count) * sizeof(ContainerType);
+    if (!ensureMapped(end, o_pErrorCode)) {
+      return {};
+    }
+
+    return Span<const ContainerType>(
+        reinterpret_cast<const ContainerType *>(m_pMapping + begin),
+        i_u32Count);
+  }
+
+  //! @return view of every stored container, in physical order
+  Span<const ContainerType> getAllEntriesView(ErrorCode *o_pErrorCode = nullptr) {
+    return getEntriesView(0, this->getStoredEntryCount(), o_pErrorCode);
+  }
+
+  //! @return pointer into the mapping or nullptr if i_u32Index is not stored
+  const ContainerType *getEntryView(uint32_t i_u32Index,
+                                    ErrorCode *o_pErrorCode = nullptr) {
+    auto view = getEntriesView(i_u32Index, 1, o_pErrorCode);
+    return view.empty() ? nullptr : view.data();
+  }
+
+  bool deleteFile() {
+    unmap();
+    return Base::deleteFile();
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__MAPPEDBINARYFILE_H_
@@ -0,0 +1,547 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__SEGMENTEDBINARYFILE_H_
+#define BINFMT__SEGMENTEDBINARYFILE_H_
+
+#include <cinttypes>
+#include <cstdio>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+//! When a SegmentedBinaryFile starts a new segment
+struct SegmentOptions {
+  //! containers per segment, 0 means no limit
+  uint32_t maxEntries = 0;
+  //! bytes per segment file including its header, 0 means no limit
+  uint64_t maxBytes = 1ULL << 30;
+  //! options of every segment, sealed ones are opened with OSManaged
+  BinaryFileOptions fileOptions{};
+};
+
+/*!
+ * Append-only stream over a directory of BinaryFiles. Appends go to the
+ * active segment until it holds SegmentOptions::maxEntries containers or
+ * maxBytes bytes, then it is sealed and a new one is started. Containers are
+ * addressed by a global 64-bit sequence number, 0 is the first one ever
+ * appended, segments are named after their first one.
+ * A small manifest lists the segments, it is rewritten atomically whenever a
+ * segment is sealed or dropped. Sealed segments never change, so they can be
+ * read in parallel while the active one is appended to.
+ * @tparam HeaderType maxEntries is ignored, segments never wrap
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class SegmentedBinaryFile {
+public:
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  struct ManifestHeader {
+    uint32_t magic{0x53474D54};
+    uint32_t version{0x0001};
+    uint32_t containerSize{sizeof(ContainerType)};
+    uint32_t segmentCount{0};
+  };
+
+  //! count is 0 for the active segment, its file knows
+  struct SegmentInfo {
+    uint64_t firstSequence;
+    uint64_t count;
+  };
+
+private:
+  Path m_Directory;
+  HeaderType m_Header;
+  SegmentOptions m_Options;
+  uint32_t m_u32SegmentCapacity;
+  ErrorCode m_ErrorCode = ErrorCode::OK;
+
+  // serializes append, seal and drop
+  std::mutex m_AppendMutex;
+  // guards m_Segments and m_Files, never held during I/O on a segment
+  std::mutex m_Mutex;
+  std::vector<SegmentInfo> m_Segments;
+  // opened on first use, the last one is the active segment
+  std::vector<std::shared_ptr<File>> m_Files;
+
+  [[nodiscard]] Path getManifestPath() const {
+    return m_Directory / "manifest";
+  }
+
+  uint32_t getSegmentCapacity() const {
+    uint64_t r = m_Options.maxEntries == 0 ? UINT32_MAX : m_Options.maxEntries;
+    if (m_Options.maxBytes != 0) {
+      const uint64_t header =
+          File::getHeaderSize(m_Options.fileOptions.headerSlots);
+      const uint64_t bytes =
+          m_Options.maxBytes > header ? m_Options.maxBytes - header : 0;
+      r = std::min<uint64_t>(r, bytes / sizeof(ContainerType));
+    }
+    return static_cast<uint32_t>(std::max<uint64_t>(r, 1));
+  }
+
+  //! Replace the manifest with i_Segments via a synced temporary file, the
+  //! directory is synced after the rename
+  bool writeManifest(const std::vector<SegmentInfo> &i_Segments,
+                     ErrorCode *o_pErrorCode) {
+    const Path path = getManifestPath();
+    const Path temporary = path.string() + ".tmp";
+    int32_t fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                        0644); // NOLINT(hicpp-signed-bitwise)
+    if (fd < 0) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::OPEN_ERROR;
+      }
+      return false;
+    }
+    ManifestHeader header;
+    header.segmentCount = static_cast<uint32_t>(i_Segments.size());
+    const auto segmentsSize =
+        static_cast<ssize_t>(i_Segments.size() * sizeof(SegmentInfo));
+    bool bOk = pwrite(fd, &header, sizeof(header), 0) ==
+                   static_cast<ssize_t>(sizeof(header)) &&
+               pwrite(fd, i_Segments.data(), segmentsSize, sizeof(header)) ==
+                   segmentsSize &&
+               fsync(fd) == 0;
+    close(fd);
+    std::error_code error;
+    if (bOk) {
+      std::filesystem::rename(temporary, path, error);
+      bOk = !error;
+    }
+    if (!bOk) {
+      std::filesystem::remove(temporary, error);
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::WRITE_ERROR;
+      }
+      return false;
+    }
+    if (!syncParentDirectory(path)) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::SYNC_ERROR;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  bool readManifest() {
+    int32_t fd = ::open(getManifestPath().c_str(),
+                        O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+    if (fd < 0) {
+      m_ErrorCode = ErrorCode::OPEN_ERROR;
+      return false;
+    }
+    const ManifestHeader expected;
+    ManifestHeader header;
+    bool bOk = pread(fd, &header, sizeof(header), 0) ==
+               static_cast<ssize_t>(sizeof(header));
+    if (bOk && (header.magic != expected.magic ||
+                header.version != expected.version ||
+                header.containerSize != expected.containerSize ||
+                header.segmentCount == 0)) {
+      m_ErrorCode = ErrorCode::MAGIC_MISMATCH;
+      close(fd);
+      return false;
+    }
+    if (bOk) {
+      m_Segments.resize(header.segmentCount);
+      const auto segmentsSize =
+          static_cast<ssize_t>(m_Segments.size() * sizeof(SegmentInfo));
+      bOk = pread(fd, m_Segments.data(), segmentsSize, sizeof(header)) ==
+            segmentsSize;
+    }
+    close(fd);
+    if (!bOk) {
+      m_ErrorCode = ErrorCode::READ_ERROR;
+    }
+    return bOk;
+  }
+
+  std::shared_ptr<File> openSegment(uint64_t i_u64FirstSequence,
+                                    bool i_bActive) const {
+    BinaryFileOptions options = m_Options.fileOptions;
+    if (!i_bActive) {
+      options.durability = DurabilityPolicy::OSManaged;
+    }
+    return std::make_shared<File>(getSegmentPath(i_u64FirstSequence),
+                                  m_Header, options);
+  }
+
+  void initialize() {
+    std::error_code error;
+    std::filesystem::create_directories(m_Directory, error);
+    if (!std::filesystem::exists(getManifestPath())) {
+      if (!writeManifest({SegmentInfo{0, 0}}, &m_ErrorCode)) {
+        return;
+      }
+    }
+    if (!readManifest()) {
+      return;
+    }
+    m_Files.resize(m_Segments.size());
+    m_Files.back() = openSegment(m_Segments.back().firstSequence, true);
+    m_ErrorCode = m_Files.back()->getErrorCode();
+  }
+
+  //! @return the segment holding i_u64Sequence, nullptr if none does
+  std::shared_ptr<File> findSegment(uint64_t i_u64Sequence,
+                                    uint64_t &o_u64First,
+                                    uint64_t &o_u64Count) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = std::upper_bound(m_Segments.begin(), m_Segments.end(),
+                               i_u64Sequence,
+                               [](uint64_t i_u64Value, const SegmentInfo &i) {
+                                 return i_u64Value < i.firstSequence;
+                               });
+    if (it == m_Segments.begin()) {
+      return nullptr;
+    }
+    const auto index = static_cast<size_t>(it - m_Segments.begin()) - 1;
+    if (m_Files[index] == nullptr) {
+      m_Files[index] = openSegment(m_Segments[index].firstSequence, false);
+    }
+    o_u64First = m_Segments[index].firstSequence;
+    o_u64Count = index + 1 == m_Segments.size()
+                     ? m_Files[index]->getEntryCount()
+                     : m_Segments[index].count;
+    if (i_u64Sequence >= o_u64First + o_u64Count) {
+      return nullptr;
+    }
+    return m_Files[index];
+  }
+
+  //! Seal the active segment and start the next one
+  bool sealActive(ErrorCode *o_pErrorCode) {
+    std::shared_ptr<File> active = m_Files.back();
+    if (!active->flush(o_pErrorCode)) {
+      return false;
+    }
+    std::vector<SegmentInfo> segments = m_Segments;
+    segments.back().count = active->getEntryCount();
+    const uint64_t next = segments.back().firstSequence + segments.back().count;
+    segments.emplace_back(SegmentInfo{next, 0});
+    // a leftover of a seal which did not reach the manifest
+    std::error_code error;
+    std::filesystem::remove(getSegmentPath(next), error);
+    if (!writeManifest(segments, o_pErrorCode)) {
+      return false;
+    }
+    auto file = openSegment(next, true);
+    const ErrorCode r = file->getErrorCode();
+    std::shared_ptr<File> sealed;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Segments = std::move(segments);
+      // reopened read-only on first use, without a group commit thread
+      sealed = std::move(m_Files.back());
+      m_Files.emplace_back(std::move(file));
+    }
+    // closing writes the header, so the last reference goes outside m_Mutex
+    sealed.reset();
+    active.reset();
+    if (r != ErrorCode::OK) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = r;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  template <typename ValueType> ErrorCode appendSpan(Span<ValueType> i_Values) {
+    std::lock_guard<std::mutex> lock(m_AppendMutex);
+    if (m_ErrorCode != ErrorCode::OK) {
+      return m_ErrorCode;
+    }
+    ErrorCode r = ErrorCode::OK;
+    size_t done = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (done < i_Values.size()) {
+      const uint64_t count = m_Files.back()->getEntryCount();
+      if (count >= m_u32SegmentCapacity) {
+        if (!sealActive(&r)) {
+          return r == ErrorCode::OK ? ErrorCode::WRITE_ERROR : r;
+        }
+        continue;
+      }
+      const size_t n =
+          std::min<size_t>(m_u32SegmentCapacity - count, i_Values.size() - done);
+      r = m_Files.back()->append(i_Values.subspan(done, n));
+      if (r != ErrorCode::OK) {
+        return r;
+      }
+      done += n;
+    }
+    return r;
+  }
+
+public:
+  /*!
+   * Open the stream in i_Directory, creating it if needed
+   * @param i_Directory
+   * @param i_Header copied into every segment
+   * @param i_Options
+   */
+  SegmentedBinaryFile(Path i_Directory, HeaderType i_Header,
+                      SegmentOptions i_Options = SegmentOptions{})
+      : m_Directory(std::move(i_Directory)), m_Header(i_Header),
+        m_Options(i_Options), m_u32SegmentCapacity(getSegmentCapacity()) {
+    m_Header.maxEntries = 0;
+    m_Header.count = 0;
+    m_Header.offset = 0;
+    initialize();
+  }
+
+  SegmentedBinaryFile(const SegmentedBinaryFile &) = delete;
+  SegmentedBinaryFile &operator=(const SegmentedBinaryFile &) = delete;
+
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+
+  [[nodiscard]] const Path &getDirectory() const { return m_Directory; }
+
+  //! @return path of the segment starting at i_u64FirstSequence
+  [[nodiscard]] Path getSegmentPath(uint64_t i_u64FirstSequence) const {
+    std::array<char, 32> name{};
+    std::snprintf(name.data(), name.size(), "%020" PRIu64 ".bin",
+                  i_u64FirstSequence);
+    return m_Directory / name.data();
+  }
+
+  //! @return sealed segments plus the active one
+  std::vector<SegmentInfo> getSegments() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Segments;
+  }
+
+  //! @return sequence number of the oldest stored container
+  uint64_t getFirstSequence() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Files.empty() ? 0 : m_Segments.front().firstSequence;
+  }
+
+  //! @return sequence number the next appended container gets
+  uint64_t getNextSequence() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Files.empty() ? 0
+                           : m_Segments.back().firstSequence +
+                                 m_Files.back()->getEntryCount();
+  }
+
+  ErrorCode append(const ContainerType &i_Container) {
+    return appendSpan(Span<const ContainerType>(&i_Container, 1));
+  }
+
+  ErrorCode append(const EntryType &i_Entry) {
+    return append(ContainerType(i_Entry));
+  }
+
+  /*!
+   * Append a batch, split at segment boundaries
+   * @param i_Containers
+   * @return ErrorCode::OK or the error of the failed append / seal
+   */
+  ErrorCode append(Span<const ContainerType> i_Containers) {
+    return appendSpan(i_Containers);
+  }
+
+  ErrorCode append(Span<const EntryType> i_Entries) {
+    return appendSpan(i_Entries);
+  }
+
+  ErrorCode append(const std::vector<EntryType> &i_Entries) {
+    return append(Span<const EntryType>(i_Entries.data(), i_Entries.size()));
+  }
+
+  //! Seal the active segment now, e.g. before archiving it
+  bool seal(ErrorCode *o_pErrorCode = nullptr) {
+    std::lock_guard<std::mutex> lock(m_AppendMutex);
+    if (m_ErrorCode != ErrorCode::OK) {
+      return false;
+    }
+    return m_Files.back()->getEntryCount() == 0 || sealActive(o_pErrorCode);
+  }
+
+  bool getEntry(uint64_t i_u64Sequence, ContainerType &o_Container,
+                ErrorCode *o_pErrorCode = nullptr) {
+    uint64_t first = 0;
+    uint64_t count = 0;
+    auto file = findSegment(i_u64Sequence, first, count);
+    return file != nullptr &&
+           file->getEntriesInto(Span<ContainerType>(&o_Container, 1),
+                                static_cast<uint32_t>(i_u64Sequence - first),
+                                o_pErrorCode);
+  }
+
+  /*!
+   * Read the containers [i_u64First, i_u64First + i_u64Count), which may
+   * span several segments
+   * @param o_Containers resized to i_u64Count
+   * @param i_u64First
+   * @param i_u64Count
+   * @param o_pErrorCode
+   * @return false if a container is not stored or a read failed
+   */
+  bool getEntries(std::vector<ContainerType> &o_Containers, uint64_t i_u64First,
+                  uint64_t i_u64Count, ErrorCode *o_pErrorCode = nullptr) {
+    o_Containers.resize(i_u64Count);
+    uint64_t done = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (done < i_u64Count) {
+      const uint64_t sequence = i_u64First + done;
+      uint64_t first = 0;
+      uint64_t count = 0;
+      auto file = findSegment(sequence, first, count);
+      if (file == nullptr) {
+        return false;
+      }
+      const uint64_t n =
+          std::min(first + count - sequence, i_u64Count - done);
+      if (!file->getEntriesInto(
+              Span<ContainerType>(o_Containers.data() + done, n),
+              static_cast<uint32_t>(sequence - first), o_pErrorCode)) {
+        return false;
+      }
+      done += n;
+    }
+    return true;
+  }
+
+  /*!
+   * Read every sealed segment on i_Executor, one task per segment. Appends
+   * to the active segment carry on meanwhile.
+   * @param i_Callback called concurrently with the sequence number of the
+   * first container of a chunk and the chunk
+   * @param i_Executor
+   * @param i_u32ChunkSize
+   * @param o_pErrorCode
+   * @return false if a read failed
+   */
+  bool scanSealed(
+      const std::function<void(uint64_t, Span<const ContainerType>)>
+          &i_Callback,
+      Executor &i_Executor, uint32_t i_u32ChunkSize = 65536,
+      ErrorCode *o_pErrorCode = nullptr) {
+    i_u32ChunkSize = std::max(i_u32ChunkSize, 1U);
+    std::vector<SegmentInfo> sealed;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      sealed.assign(m_Segments.begin(), m_Segments.end() - 1);
+    }
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t remaining = sealed.size();
+    ErrorCode error = ErrorCode::OK;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (const auto &segment : sealed) {
+      i_Executor.post([&, segment] {
+        uint64_t first = 0;
+        uint64_t count = 0;
+        auto file = findSegment(segment.firstSequence, first, count);
+        ErrorCode r = ErrorCode::OK;
+        bool bOk = file != nullptr;
+        // the manifest has the count, the header of a sealed segment is only
+        // written once its file is closed
+        std::vector<ContainerType> chunk;
+        // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+        for (uint64_t done = 0; bOk && done < segment.count;) {
+          const auto n = static_cast<uint32_t>(
+              std::min<uint64_t>(i_u32ChunkSize, segment.count - done));
+          chunk.resize(n);
+          bOk = file->getEntriesInto(chunk, static_cast<uint32_t>(done), &r);
+          if (bOk) {
+            i_Callback(segment.firstSequence + done,
+                       Span<const ContainerType>(chunk.data(), n));
+            done += n;
+          }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!bOk && error == ErrorCode::OK) {
+          error = r == ErrorCode::OK ? ErrorCode::READ_ERROR : r;
+        }
+        if (--remaining == 0) {
+          finished.notify_one();
+        }
+      });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&remaining] { return remaining == 0; });
+    if (error != ErrorCode::OK && o_pErrorCode != nullptr) {
+      *o_pErrorCode = error;
+    }
+    return error == ErrorCode::OK;
+  }
+
+  //! Same as above on a temporary ThreadPool
+  bool scanSealed(
+      const std::function<void(uint64_t, Span<const ContainerType>)>
+          &i_Callback,
+      uint32_t i_u32ThreadCount = 0, uint32_t i_u32ChunkSize = 65536,
+      ErrorCode *o_pErrorCode = nullptr) {
+    ThreadPool pool(i_u32ThreadCount);
+    return scanSealed(i_Callback, pool, i_u32ChunkSize, o_pErrorCode);
+  }
+
+  /*!
+   * Delete the sealed segments whose containers all come before
+   * i_u64Sequence, e.g. to enforce retention. The manifest is updated first.
+   * Readers still holding such a segment keep reading it.
+   * @param i_u64Sequence
+   * @param o_pErrorCode
+   * @return false if the manifest could not be written
+   */
+  bool dropSegmentsBefore(uint64_t i_u64Sequence,
+                          ErrorCode *o_pErrorCode = nullptr) {
+    std::lock_guard<std::mutex> appendLock(m_AppendMutex);
+    if (m_ErrorCode != ErrorCode::OK) {
+      return false;
+    }
+    size_t dropped = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (dropped + 1 < m_Segments.size() &&
+           m_Segments[dropped + 1].firstSequence <= i_u64Sequence) {
+      dropped++;
+    }
+    if (dropped == 0) {
+      return true;
+    }
+    std::vector<SegmentInfo> segments(m_Segments.begin() + dropped,
+                                      m_Segments.end());
+    if (!writeManifest(segments, o_pErrorCode)) {
+      return false;
+    }
+    std::vector<SegmentInfo> removed;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      removed.assign(m_Segments.begin(), m_Segments.begin() + dropped);
+      m_Segments = std::move(segments);
+      m_Files.erase(m_Files.begin(), m_Files.begin() + dropped);
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (const auto &segment : removed) {
+      std::error_code error;
+      std::filesystem::remove(getSegmentPath(segment.firstSequence), error);
+    }
+    return true;
+  }
+
+  //! Delete every segment and the manifest, the stream is unusable after
+  bool deleteFiles() {
+    std::lock_guard<std::mutex> appendLock(m_AppendMutex);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Files.clear();
+    std::error_code error;
+    std::filesystem::remove_all(m_Directory, error);
+    return !error;
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__SEGMENTEDBINARYFILE_H_
@@ -0,0 +1,175 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__SEQUENTIALREADER_H_
+#define BINFMT__SEQUENTIALREADER_H_
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Streams a physical range of a BinaryFile in chunks. A background thread
+ * reads chunk N + 1 into the second of two preallocated buffers while the
+ * caller processes chunk N, so I/O and processing overlap. The buffers are
+ * reused for the whole scan. Containers hidden by the read filter of the
+ * file are left out and chunks with nothing left are skipped, none of them
+ * move until the scan is done.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class SequentialReader {
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  File &m_File;
+  const uint32_t m_u32Begin;
+  const uint32_t m_u32End;
+  const uint32_t m_u32ChunkSize;
+
+  std::array<std::vector<ContainerType>, 2> m_Buffers;
+  std::array<uint32_t, 2> m_Counts{};
+  // a buffer stays ready while the caller holds it
+  std::array<bool, 2> m_Ready{};
+  int32_t m_i32InUse = -1;
+  uint64_t m_u64NextChunk = 0;
+  bool m_bDone = false;
+  bool m_bStop = false;
+  ErrorCode m_Error = ErrorCode::OK;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+  std::thread m_Reader;
+
+  void runReader() {
+    m_File.beginLiveRead();
+    m_File.adviseScanBegin();
+    uint64_t chunk = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint32_t begin = m_u32Begin; begin < m_u32End;
+         begin += m_u32ChunkSize) {
+      const size_t slot = chunk & 1;
+      {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Condition.wait(lock, [this, slot] { return m_bStop || !m_Ready[slot]; });
+        if (m_bStop) {
+          break;
+        }
+      }
+
+      uint32_t count = std::min(m_u32ChunkSize, m_u32End - begin);
+      uint32_t next = begin + count;
+      m_File.adviseScanAhead(next, std::min(m_u32ChunkSize, m_u32End - next));
+      ErrorCode r = ErrorCode::OK;
+      Span<ContainerType> buffer(m_Buffers[slot].data(), count);
+      bool bOk = m_File.getEntriesInto(buffer, begin, &r);
+      m_File.adviseScanBehind(begin, count);
+      const size_t live = bOk ? m_File.keepLive(begin, buffer) : 0;
+
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      if (!bOk) {
+        m_Error = r == ErrorCode::OK ? ErrorCode::READ_ERROR : r;
+        break;
+      }
+      if (live == 0) {
+        continue;
+      }
+      m_Counts[slot] = static_cast<uint32_t>(live);
+      m_Ready[slot] = true;
+      chunk++;
+      m_Condition.notify_all();
+    }
+    m_File.adviseScanEnd();
+    m_File.endLiveRead();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_bDone = true;
+    m_Condition.notify_all();
+  }
+
+public:
+  /*!
+   * Starts reading the first chunk right away
+   * @param i_File
+   * @param i_u32Begin first physical index
+   * @param i_u32End 0 means up to the stored entry count
+   * @param i_u32ChunkSize containers per buffer
+   */
+  explicit SequentialReader(File &i_File, uint32_t i_u32Begin = 0,
+                            uint32_t i_u32End = 0,
+                            uint32_t i_u32ChunkSize = 65536)
+      : m_File(i_File), m_u32Begin(i_u32Begin),
+        m_u32End(i_u32End == 0 ? i_File.getStoredEntryCount() : i_u32End),
+        m_u32ChunkSize(std::max(i_u32ChunkSize, 1U)) {
+    const size_t bufferSize =
+        std::min<size_t>(m_u32ChunkSize, m_u32End > m_u32Begin
+                                             ? m_u32End - m_u32Begin
+                                             : 0);
+    m_Buffers[0].resize(bufferSize);
+    m_Buffers[1].resize(bufferSize);
+    m_Reader = std::thread(&SequentialReader::runReader, this);
+  }
+
+  SequentialReader(const SequentialReader &) = delete;
+  SequentialReader &operator=(const SequentialReader &) = delete;
+
+  ~SequentialReader() {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_bStop = true;
+    }
+    m_Condition.notify_all();
+    m_Reader.join();
+  }
+
+  /*!
+   * Hand out the next chunk and let the reader refill the previous one
+   * @param o_pErrorCode set if the scan stopped because a read failed
+   * @return view valid until the next call, empty once the range is done
+   */
+  Span<const ContainerType> next(ErrorCode *o_pErrorCode = nullptr) {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    if (m_i32InUse >= 0) {
+      m_Ready[m_i32InUse] = false;
+      m_i32InUse = -1;
+      m_Condition.notify_all();
+    }
+
+    const size_t slot = m_u64NextChunk & 1;
+    m_Condition.wait(lock, [this, slot] { return m_Ready[slot] || m_bDone; });
+    if (!m_Ready[slot]) {
+      if (m_Error != ErrorCode::OK && o_pErrorCode != nullptr) {
+        *o_pErrorCode = m_Error;
+      }
+      return {};
+    }
+
+    m_i32InUse = static_cast<int32_t>(slot);
+    m_u64NextChunk++;
+    return Span<const ContainerType>(m_Buffers[slot].data(), m_Counts[slot]);
+  }
+
+  /*!
+   * Run i_Callback for every remaining chunk
+   * @param i_Callback
+   * @param o_pErrorCode
+   * @return false if a read failed
+   */
+  bool forEach(const std::function<void(Span<const ContainerType>)> &i_Callback,
+               ErrorCode *o_pErrorCode = nullptr) {
+    ErrorCode r = ErrorCode::OK;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto chunk = next(&r); !chunk.empty(); chunk = next(&r)) {
+      i_Callback(chunk);
+    }
+    if (o_pErrorCode != nullptr && r != ErrorCode::OK) {
+      *o_pErrorCode = r;
+    }
+    return r == ErrorCode::OK;
+  }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__SEQUENTIALREADER_H_
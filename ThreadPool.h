@@ -0,0 +1,92 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__THREADPOOL_H_
+#define BINFMT__THREADPOOL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace binfmt {
+
+//! Something that runs posted work, e.g. a ThreadPool or an event loop
+struct Executor {
+  virtual ~Executor() = default;
+  virtual void post(std::function<void()> i_Work) = 0;
+};
+
+//! Fixed size thread pool, work is run in the order it was posted
+class ThreadPool : public Executor {
+  std::mutex m_Mutex;
+  std::condition_variable m_Condition;
+  std::deque<std::function<void()>> m_Queue;
+  std::vector<std::thread> m_Threads;
+  bool m_bStop = false;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (true) {
+      m_Condition.wait(lock, [this] { return m_bStop || !m_Queue.empty(); });
+      if (m_Queue.empty()) {
+        return;
+      }
+      auto work = std::move(m_Queue.front());
+      m_Queue.pop_front();
+      lock.unlock();
+      work();
+      lock.lock();
+    }
+  }
+
+public:
+  /*!
+   * Start the worker threads
+   * @param i_u32ThreadCount defaults to std::thread::hardware_concurrency
+   */
+  explicit ThreadPool(uint32_t i_u32ThreadCount = 0) {
+    if (i_u32ThreadCount == 0) {
+      i_u32ThreadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < i_u32ThreadCount; i++) {
+      m_Threads.emplace_back(&ThreadPool::run, this);
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  //! Runs everything posted so far, then joins the workers
+  ~ThreadPool() override {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_bStop = true;
+    }
+    m_Condition.notify_all();
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto &thread : m_Threads) {
+      thread.join();
+    }
+  }
+
+  void post(std::function<void()> i_Work) override {
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Queue.emplace_back(std::move(i_Work));
+    }
+    m_Condition.notify_one();
+  }
+
+  [[nodiscard]] uint32_t getThreadCount() const { return m_Threads.size(); }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__THREADPOOL_H_
@@ -0,0 +1,416 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__TOMBSTONEMAP_H_
+#define BINFMT__TOMBSTONEMAP_H_
+
+#include <shared_mutex>
+#include <sys/stat.h>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Deletes from anywhere in a BinaryFile in O(1) by setting a bit per
+ * container in a sidecar bitmap. While the map is attached it is the read
+ * filter of the file, its reads skip removed containers, see
+ * BinaryFile::setReadFilter.
+ * compact reclaims the space of a file without maxEntries in bounded steps:
+ * each moves one run of live containers down into the removed ones before it,
+ * never further than there are removed ones, and syncs the copies before
+ * their bits flip. Once nothing but removed containers
+ * is left at the end of the file it is truncated, which is the only moment
+ * appends wait for. Positions change
+ * while compacting, so it refuses while other AppendObservers like KeyIndex
+ * or ZoneMap are attached; rebuild them afterwards.
+ * A ring is not compacted, its removed slots are reused when it wraps.
+ * The bitmap is written on every change but not synced, see flush().
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType>
+class TombstoneMap : public AppendObserver<ContainerType>,
+                     public ReadFilter<ContainerType> {
+public:
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  struct SidecarHeader {
+    uint32_t magic{0x544F4D42};
+    uint32_t version{0x0001};
+    uint64_t reserved{0};
+  };
+
+private:
+  File &m_File;
+  Path m_Path;
+  int32_t m_Fd = -1;
+  ErrorCode m_ErrorCode = ErrorCode::OK;
+
+  // held shared by the reads of the file, exclusively by removals and
+  // compaction steps, so no read sees a container halfway through a move
+  std::shared_mutex m_Mutex;
+  // guards the bitmap, also taken by the observer callbacks which arrive
+  // with the file locked
+  std::mutex m_BitmapMutex;
+  // bit i is set if the container at physical index i was removed
+  std::vector<uint64_t> m_Words;
+  uint64_t m_u64Removed = 0;
+  // no removed container before this physical index
+  uint64_t m_u64CompactFrom = 0;
+
+  [[nodiscard]] static off_t getWordOffset(size_t i_szWord) {
+    return static_cast<off_t>(sizeof(SidecarHeader) +
+                              i_szWord * sizeof(uint64_t));
+  }
+
+  [[nodiscard]] bool isSet(uint64_t i_u64Index) const {
+    return i_u64Index / 64 < m_Words.size() &&
+           ((m_Words[i_u64Index / 64] >> (i_u64Index % 64)) & 1U) != 0;
+  }
+
+  //! Set or clear the bits [i_u64Begin, i_u64End), keeping m_u64Removed
+  void assign(uint64_t i_u64Begin, uint64_t i_u64End, bool i_bRemoved) {
+    if (i_u64Begin >= i_u64End) {
+      return;
+    }
+    if (i_bRemoved && m_Words.size() < (i_u64End + 63) / 64) {
+      m_Words.resize((i_u64End + 63) / 64);
+    }
+    i_u64End = std::min<uint64_t>(i_u64End, m_Words.size() * 64);
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint64_t i = i_u64Begin; i < i_u64End;) {
+      const uint64_t bits = std::min<uint64_t>(64 - i % 64, i_u64End - i);
+      const uint64_t mask =
+          (bits == 64 ? ~0ULL : ((1ULL << bits) - 1)) << (i % 64);
+      uint64_t &word = m_Words[i / 64];
+      const auto before = __builtin_popcountll(word & mask);
+      word = i_bRemoved ? word | mask : word & ~mask;
+      m_u64Removed += __builtin_popcountll(word & mask);
+      m_u64Removed -= before;
+      i += bits;
+    }
+  }
+
+  //! @return first index in [i_u64Begin, i_u64End) whose bit is
+  //! i_bRemoved, i_u64End if there is none
+  [[nodiscard]] uint64_t find(uint64_t i_u64Begin, uint64_t i_u64End,
+                              bool i_bRemoved) const {
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint64_t i = i_u64Begin; i < i_u64End;) {
+      if (i / 64 >= m_Words.size()) {
+        return i_bRemoved ? i_u64End : i;
+      }
+      uint64_t word = m_Words[i / 64];
+      word = (i_bRemoved ? word : ~word) >> (i % 64);
+      if (word != 0) {
+        return std::min<uint64_t>(i + __builtin_ctzll(word), i_u64End);
+      }
+      i += 64 - i % 64;
+    }
+    return i_u64End;
+  }
+
+  //! Write the words holding the bits [i_u64Begin, i_u64End)
+  void writeWords(uint64_t i_u64Begin, uint64_t i_u64End) {
+    const size_t first = i_u64Begin / 64;
+    const size_t end = std::min<size_t>((i_u64End + 63) / 64, m_Words.size());
+    if (m_Fd < 0 || first >= end) {
+      return;
+    }
+    auto expectedWriteSize =
+        static_cast<ssize_t>((end - first) * sizeof(uint64_t));
+    if (pwrite(m_Fd, m_Words.data() + first, expectedWriteSize,
+               getWordOffset(first)) != expectedWriteSize) {
+      m_ErrorCode = ErrorCode::WRITE_ERROR;
+    }
+  }
+
+  //! Physical index of the container i_u64Record was stored at
+  [[nodiscard]] uint64_t getSlot(const HeaderType &i_Header,
+                                 uint64_t i_u64Record) const {
+    return i_Header.maxEntries == 0 ? i_u64Record
+                                    : i_u64Record % i_Header.maxEntries;
+  }
+
+  //! Load the sidecar and drop the bits of containers the file does not hold
+  void load() {
+    m_Fd = open(m_Path.c_str(), O_RDWR | O_CREAT,
+                0644); // NOLINT(hicpp-signed-bitwise)
+    if (m_Fd < 0) {
+      m_ErrorCode = ErrorCode::OPEN_ERROR;
+      return;
+    }
+    const SidecarHeader expected;
+    SidecarHeader existing{};
+    struct stat st {};
+    bool bValid = fstat(m_Fd, &st) == 0 &&
+                  pread(m_Fd, &existing, sizeof(existing), 0) ==
+                      static_cast<ssize_t>(sizeof(existing)) &&
+                  existing.magic == expected.magic &&
+                  existing.version == expected.version;
+    if (bValid) {
+      m_Words.resize((st.st_size - sizeof(SidecarHeader)) / sizeof(uint64_t));
+      auto expectedReadSize =
+          static_cast<ssize_t>(m_Words.size() * sizeof(uint64_t));
+      bValid = pread(m_Fd, m_Words.data(), expectedReadSize,
+                     getWordOffset(0)) == expectedReadSize;
+    }
+    if (!bValid) {
+      m_Words.clear();
+      if (ftruncate(m_Fd, 0) != 0 ||
+          pwrite(m_Fd, &expected, sizeof(expected), 0) !=
+              static_cast<ssize_t>(sizeof(expected))) {
+        m_ErrorCode = ErrorCode::WRITE_ERROR;
+        return;
+      }
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint64_t word : m_Words) {
+      m_u64Removed += __builtin_popcountll(word);
+    }
+    truncateBits(m_File.getStoredEntryCount());
+  }
+
+  //! Clear every bit from i_u64Stored on and shrink the sidecar to match
+  void truncateBits(uint64_t i_u64Stored) {
+    assign(i_u64Stored, m_Words.size() * 64, false);
+    m_Words.resize(std::min<size_t>(m_Words.size(), (i_u64Stored + 63) / 64));
+    m_u64CompactFrom = std::min(m_u64CompactFrom, i_u64Stored);
+    if (m_Fd >= 0 && ftruncate(m_Fd, getWordOffset(m_Words.size())) != 0) {
+      m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+    }
+    writeWords(m_Words.empty() ? 0 : m_Words.size() * 64 - 64,
+               m_Words.size() * 64);
+  }
+
+public:
+  /*!
+   * Attach to i_File, loading or creating the sidecar. Open it before
+   * appending, the map registers itself as an AppendObserver.
+   * @param i_File has to outlive the map
+   * @param i_Path defaults to the path of i_File with ".tomb" appended
+   */
+  explicit TombstoneMap(File &i_File, Path i_Path = {})
+      : m_File(i_File),
+        m_Path(i_Path.empty() ? Path(i_File.getPath().string() + ".tomb")
+                              : std::move(i_Path)) {
+    load();
+    m_File.addAppendObserver(this);
+    m_File.setReadFilter(this);
+  }
+
+  TombstoneMap(const TombstoneMap &) = delete;
+  TombstoneMap &operator=(const TombstoneMap &) = delete;
+
+  ~TombstoneMap() override {
+    m_File.setReadFilter(nullptr);
+    m_File.removeAppendObserver(this);
+    if (m_Fd >= 0) {
+      close(m_Fd);
+    }
+  }
+
+  //! A ring overwrote the slots of removed containers, they are live again
+  void onAppended(uint64_t i_u64FirstRecord,
+                  Span<const ContainerType> i_Containers) override {
+    const auto header = m_File.getHeader();
+    std::lock_guard<std::mutex> lock(m_BitmapMutex);
+    if (header.maxEntries == 0 || m_u64Removed == 0) {
+      return;
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (size_t i = 0; i < i_Containers.size(); i++) {
+      const uint64_t slot = getSlot(header, i_u64FirstRecord + i);
+      if (isSet(slot)) {
+        assign(slot, slot + 1, false);
+        writeWords(slot, slot + 1);
+      }
+    }
+  }
+
+  void onTruncated(uint64_t i_u64Count) override {
+    std::lock_guard<std::mutex> lock(m_BitmapMutex);
+    truncateBits(i_u64Count);
+  }
+
+  void beginRead() override { m_Mutex.lock_shared(); }
+
+  void endRead() override { m_Mutex.unlock_shared(); }
+
+  size_t keepLive(uint32_t i_u32Index,
+                  Span<ContainerType> io_Containers) override {
+    std::lock_guard<std::mutex> lock(m_BitmapMutex);
+    if (m_u64Removed == 0) {
+      return io_Containers.size();
+    }
+    size_t live = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (size_t i = 0; i < io_Containers.size(); i++) {
+      if (!isSet(i_u32Index + static_cast<uint64_t>(i))) {
+        io_Containers[live++] = io_Containers[i];
+      }
+    }
+    return live;
+  }
+
+  bool isAnyRemoved(uint32_t i_u32Index, uint32_t i_u32Count) override {
+    std::lock_guard<std::mutex> lock(m_BitmapMutex);
+    const uint64_t end = i_u32Index + static_cast<uint64_t>(i_u32Count);
+    return m_u64Removed != 0 && find(i_u32Index, end, true) < end;
+  }
+
+  /*!
+   * Mark the container at physical index i_u32Index as removed
+   * @param i_u32Index
+   * @return false if it is not stored
+   */
+  bool remove(uint32_t i_u32Index) {
+    return remove(std::vector<uint32_t>{i_u32Index});
+  }
+
+  /*!
+   * Mark the containers at the physical indices i_Indices as removed, with
+   * one write for all of them
+   * @param i_Indices
+   * @return false if any of them is not stored, nothing is removed then
+   */
+  bool remove(const std::vector<uint32_t> &i_Indices) {
+    if (i_Indices.empty()) {
+      return true;
+    }
+    std::lock_guard<std::shared_mutex> lock(m_Mutex);
+    const auto [low, high] =
+        std::minmax_element(i_Indices.begin(), i_Indices.end());
+    if (*high >= m_File.getStoredEntryCount()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> bitmapLock(m_BitmapMutex);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t index : i_Indices) {
+      assign(index, index + 1, true);
+    }
+    m_u64CompactFrom = std::min<uint64_t>(m_u64CompactFrom, *low);
+    writeWords(*low, *high + 1ULL);
+    return true;
+  }
+
+  bool isRemoved(uint32_t i_u32Index) {
+    std::lock_guard<std::mutex> lock(m_BitmapMutex);
+    return isSet(i_u32Index);
+  }
+
+  //! @return number of removed containers the file still stores
+  uint64_t getRemovedCount() {
+    std::lock_guard<std::mutex> lock(m_BitmapMutex);
+    return m_u64Removed;
+  }
+
+  //! @return number of stored containers which were not removed
+  uint64_t getLiveCount() {
+    return m_File.getStoredEntryCount() - getRemovedCount();
+  }
+
+  /*!
+   * One bounded compaction step. Moves the first run of up to i_u32MaxMoves
+   * live containers behind a removed one down over the removed ones, or
+   * truncates the file if only removed containers are left at its end.
+   * Call it until getRemovedCount() is 0, appends go on in between. Reads
+   * of the file wait for the step, do not call it from a read callback.
+   * setEntriesAt does not tell AppendObservers about the moves, so nothing
+   * is moved while any other observer is attached.
+   * @param i_u32MaxMoves
+   * @param o_pErrorCode
+   * @return false for a ring, while other AppendObservers are attached or if
+   * a read, write, sync or truncate failed
+   */
+  bool compact(uint32_t i_u32MaxMoves = 65536,
+               ErrorCode *o_pErrorCode = nullptr) {
+    std::lock_guard<std::shared_mutex> lock(m_Mutex);
+    const auto header = m_File.getHeader();
+    if (header.maxEntries != 0 || m_File.getAppendObserverCount() > 1) {
+      return false;
+    }
+    const uint64_t count = header.count;
+    uint64_t removed = 0;
+    uint64_t live = 0;
+    uint64_t liveEnd = 0;
+    {
+      std::lock_guard<std::mutex> bitmapLock(m_BitmapMutex);
+      removed = find(m_u64CompactFrom, count, true);
+      m_u64CompactFrom = removed;
+      live = find(removed, count, false);
+      liveEnd = find(live, std::min<uint64_t>(live + std::max(i_u32MaxMoves, 1U),
+                                              count),
+                     true);
+    }
+    if (removed == count) {
+      return true;
+    }
+    if (live == count) {
+      // an append in between only delays this to the next step
+      return m_File.removeEntriesAtEnd(static_cast<uint32_t>(count - removed),
+                                       count) ||
+             m_File.getEntryCount() != count;
+    }
+
+    // only the removed containers before the run are overwritten, so a
+    // crash during the move never hits a live one
+    const auto moves =
+        static_cast<uint32_t>(std::min(liveEnd - live, live - removed));
+    liveEnd = live + moves;
+    std::vector<ContainerType> containers(moves);
+    if (!m_File.getEntriesInto(containers, static_cast<uint32_t>(live),
+                               o_pErrorCode) ||
+        !m_File.setEntriesAt(containers, static_cast<uint32_t>(removed),
+                             o_pErrorCode) ||
+        !m_File.flush(o_pErrorCode)) {
+      return false;
+    }
+    // the copies are live on disk before the originals are removed, a crash
+    // in between leaves duplicates but loses nothing
+    {
+      std::lock_guard<std::mutex> bitmapLock(m_BitmapMutex);
+      assign(removed, removed + moves, false);
+      writeWords(removed, removed + moves);
+    }
+    if (!flush(o_pErrorCode)) {
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> bitmapLock(m_BitmapMutex);
+      assign(live, liveEnd, true);
+      m_u64CompactFrom = removed + moves;
+      writeWords(live, liveEnd);
+    }
+    return flush(o_pErrorCode);
+  }
+
+  /*!
+   * Sync the sidecar
+   * @param o_pErrorCode
+   * @return false if an earlier write or the sync failed
+   */
+  bool flush(ErrorCode *o_pErrorCode = nullptr) {
+    ErrorCode error = m_ErrorCode;
+    if (error == ErrorCode::OK && (m_Fd < 0 || fsync(m_Fd) != 0)) {
+      error = m_ErrorCode = ErrorCode::SYNC_ERROR;
+    }
+    if (error != ErrorCode::OK && o_pErrorCode != nullptr) {
+      *o_pErrorCode = error;
+    }
+    return error == ErrorCode::OK;
+  }
+
+  [[nodiscard]] Path getPath() const { return m_Path; }
+
+  //! @return first error of a sidecar operation, the map keeps working from
+  //! memory after a failed write
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__TOMBSTONEMAP_H_
@@ -0,0 +1,536 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#ifndef BINFMT__ZONEMAP_H_
+#define BINFMT__ZONEMAP_H_
+
+#include <sys/stat.h>
+
+#include "binfmt.h"
+
+namespace binfmt {
+
+/*!
+ * Min / max summary of the declared fields for every block of blockSize
+ * records, kept in a sidecar file next to the BinaryFile. scan skips every
+ * block whose summary rules out a match, so selective predicates like
+ * "temperature above x" only read the blocks which can contain hits.
+ * Summaries are updated on append but not synced. On open, missing ones are
+ * recomputed from the data file and the last block is compared with it to
+ * detect a sidecar which is out of date, other changes to the data file are
+ * only seen while the zone map is attached.
+ * A ring only keeps the summaries of the blocks it still stores.
+ * @tparam HeaderType
+ * @tparam EntryType
+ * @tparam ContainerType
+ * @tparam Fields pointers to the summarized members of EntryType, e.g.
+ * &MyPODEntry::temperature, ordered by operator<
+ */
+template <typename HeaderType, typename EntryType, typename ContainerType,
+          auto... Fields>
+class ZoneMap : public AppendObserver<ContainerType> {
+public:
+  using File = BinaryFile<HeaderType, EntryType, ContainerType>;
+
+  /*!
+   * Only the declared fields of i_Min and i_Max are meaningful
+   * @return false if no entry of the block can match
+   */
+  using ZoneFilter =
+      std::function<bool(const EntryType &i_Min, const EntryType &i_Max)>;
+
+  struct SidecarHeader {
+    uint32_t magic{0x5A4F4E45};
+    uint32_t version{0x0001};
+    uint32_t blockSize{0};
+    uint32_t entrySize{sizeof(EntryType)};
+    uint32_t fields{getFieldsFingerprint()};
+    uint32_t slots{0};
+  };
+
+  //! Summary of the records [block * blockSize, block * blockSize + count)
+  struct Zone {
+    uint64_t block;
+    uint64_t count;
+    EntryType min;
+    EntryType max;
+  };
+
+private:
+  static_assert(sizeof...(Fields) > 0, "declare at least one field");
+  static_assert((std::is_member_object_pointer_v<decltype(Fields)> && ...),
+                "fields have to be pointers to members of EntryType");
+
+  template <auto A, auto B> static constexpr bool isSameField() {
+    if constexpr (std::is_same_v<decltype(A), decltype(B)>) {
+      return A == B;
+    } else {
+      return false;
+    }
+  }
+
+  //! Tells sidecars written for other fields apart
+  static uint32_t getFieldsFingerprint() {
+    EntryType entry{};
+    const auto *base = reinterpret_cast<const char *>(&entry);
+    uint32_t r = 2166136261U;
+    auto mix = [&r](size_t i_szValue) {
+      r = (r ^ static_cast<uint32_t>(i_szValue)) * 16777619U;
+    };
+    (mix(reinterpret_cast<const char *>(&(entry.*Fields)) - base), ...);
+    (mix(sizeof(entry.*Fields)), ...);
+    return r;
+  }
+
+  File &m_File;
+  const uint32_t m_u32BlockSize;
+  // 0 for a file without maxEntries, zones are then stored by block number
+  uint64_t m_u64Slots = 0;
+  Path m_Path;
+  int32_t m_Fd = -1;
+  ErrorCode m_ErrorCode = ErrorCode::OK;
+
+  // written by the appending thread, read by scans
+  std::mutex m_Mutex;
+  std::vector<Zone> m_Zones;
+  std::vector<ContainerType> m_Buffer;
+
+  static void reset(Zone &o_Zone, uint64_t i_u64Block,
+                    const EntryType &i_Entry) {
+    o_Zone = Zone{i_u64Block, 1, i_Entry, i_Entry};
+  }
+
+  static void widen(Zone &io_Zone, const EntryType &i_Entry) {
+    ((io_Zone.min.*Fields = std::min(io_Zone.min.*Fields, i_Entry.*Fields)),
+     ...);
+    ((io_Zone.max.*Fields = std::max(io_Zone.max.*Fields, i_Entry.*Fields)),
+     ...);
+  }
+
+  [[nodiscard]] static uint64_t getStoredCount(const HeaderType &i_Header) {
+    return i_Header.maxEntries != 0 && i_Header.count > i_Header.maxEntries
+               ? i_Header.maxEntries
+               : i_Header.count;
+  }
+
+  //! @return number of records block i_u64Block has with i_u64Count records
+  [[nodiscard]] uint64_t getExpectedCount(uint64_t i_u64Block,
+                                          uint64_t i_u64Count) const {
+    const uint64_t begin = i_u64Block * m_u32BlockSize;
+    return begin >= i_u64Count
+               ? 0
+               : std::min<uint64_t>(m_u32BlockSize, i_u64Count - begin);
+  }
+
+  [[nodiscard]] uint64_t getSlot(uint64_t i_u64Block) const {
+    return m_u64Slots == 0 ? i_u64Block : i_u64Block % m_u64Slots;
+  }
+
+  [[nodiscard]] static off_t getZoneOffset(uint64_t i_u64Slot) {
+    return static_cast<off_t>(sizeof(SidecarHeader) +
+                              i_u64Slot * sizeof(Zone));
+  }
+
+  Zone &getZone(uint64_t i_u64Block) {
+    const uint64_t slot = getSlot(i_u64Block);
+    if (slot >= m_Zones.size()) {
+      m_Zones.resize(slot + 1, Zone{0, 0, EntryType{}, EntryType{}});
+    }
+    return m_Zones[slot];
+  }
+
+  void writeZone(uint64_t i_u64Block) {
+    const uint64_t slot = getSlot(i_u64Block);
+    if (m_Fd >= 0 && pwrite(m_Fd, &m_Zones[slot], sizeof(Zone),
+                            getZoneOffset(slot)) !=
+                         static_cast<ssize_t>(sizeof(Zone))) {
+      m_ErrorCode = ErrorCode::WRITE_ERROR;
+    }
+  }
+
+  /*!
+   * Read the records [i_u64First, i_u64First + o_Containers.size()), which
+   * have to be stored, wrapping at maxEntries
+   */
+  bool readRecords(uint64_t i_u64First, Span<ContainerType> o_Containers,
+                   const HeaderType &i_Header, ErrorCode *o_pErrorCode) {
+    if (i_Header.maxEntries == 0) {
+      return m_File.getEntriesInto(
+          o_Containers, static_cast<uint32_t>(i_u64First), o_pErrorCode);
+    }
+    const uint64_t begin = i_u64First % i_Header.maxEntries;
+    const size_t first = std::min<uint64_t>(o_Containers.size(),
+                                            i_Header.maxEntries - begin);
+    return m_File.getEntriesInto(o_Containers.subspan(0, first),
+                                 static_cast<uint32_t>(begin), o_pErrorCode) &&
+           (first == o_Containers.size() ||
+            m_File.getEntriesInto(
+                o_Containers.subspan(first, o_Containers.size() - first), 0,
+                o_pErrorCode));
+  }
+
+  /*!
+   * Drop the containers the read filter of the file hides from records read
+   * by readRecords
+   * @return number of containers left at the front of io_Containers
+   */
+  size_t keepLive(uint64_t i_u64First, Span<ContainerType> io_Containers,
+                  const HeaderType &i_Header) {
+    if (i_Header.maxEntries == 0) {
+      return m_File.keepLive(static_cast<uint32_t>(i_u64First), io_Containers);
+    }
+    const uint64_t begin = i_u64First % i_Header.maxEntries;
+    const size_t first = std::min<uint64_t>(io_Containers.size(),
+                                            i_Header.maxEntries - begin);
+    size_t live = m_File.keepLive(static_cast<uint32_t>(begin),
+                                  io_Containers.subspan(0, first));
+    if (first < io_Containers.size()) {
+      auto second =
+          io_Containers.subspan(first, io_Containers.size() - first);
+      const size_t secondLive = m_File.keepLive(0, second);
+      std::copy(second.begin(), second.begin() + secondLive,
+                io_Containers.begin() + live);
+      live += secondLive;
+    }
+    return live;
+  }
+
+  /*!
+   * Stored part of block i_u64Block
+   * @return false if nothing of it is stored
+   */
+  bool getStoredRange(uint64_t i_u64Block, const HeaderType &i_Header,
+                      uint64_t &o_u64First, size_t &o_szCount) const {
+    const uint64_t oldest = i_Header.count - getStoredCount(i_Header);
+    const uint64_t begin =
+        std::max<uint64_t>(i_u64Block * m_u32BlockSize, oldest);
+    const uint64_t end = std::min<uint64_t>(
+        (i_u64Block + 1) * m_u32BlockSize, i_Header.count);
+    o_u64First = begin;
+    o_szCount = end > begin ? end - begin : 0;
+    return o_szCount > 0;
+  }
+
+  //! Summarize the stored part of block i_u64Block from the data file
+  bool recompute(uint64_t i_u64Block, const HeaderType &i_Header, Zone &o_Zone) {
+    uint64_t first = 0;
+    size_t count = 0;
+    if (!getStoredRange(i_u64Block, i_Header, first, count)) {
+      return false;
+    }
+    m_Buffer.resize(count);
+    if (!readRecords(first, m_Buffer, i_Header, &m_ErrorCode)) {
+      return false;
+    }
+    reset(o_Zone, i_u64Block, m_Buffer[0].entry);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (size_t i = 1; i < count; i++) {
+      widen(o_Zone, m_Buffer[i].entry);
+    }
+    o_Zone.count = getExpectedCount(i_u64Block, i_Header.count);
+    return true;
+  }
+
+  void truncateZones(uint64_t i_u64Count) {
+    const uint64_t blocks =
+        (i_u64Count + m_u32BlockSize - 1) / m_u32BlockSize;
+    if (m_u64Slots == 0) {
+      m_Zones.resize(std::min<uint64_t>(m_Zones.size(), blocks));
+      if (m_Fd >= 0 &&
+          ftruncate(m_Fd, getZoneOffset(m_Zones.size())) != 0) {
+        m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+      }
+    } else {
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (auto &zone : m_Zones) {
+        if (zone.count != 0 && zone.block >= blocks) {
+          zone.count = 0;
+          writeZone(zone.block);
+        }
+      }
+    }
+  }
+
+  //! Load the sidecar and recompute every zone the data file disagrees with
+  void load() {
+    m_Fd = open(m_Path.c_str(), O_RDWR | O_CREAT,
+                0644); // NOLINT(hicpp-signed-bitwise)
+    if (m_Fd < 0) {
+      m_ErrorCode = ErrorCode::OPEN_ERROR;
+      return;
+    }
+
+    const auto header = m_File.getHeader();
+    SidecarHeader expected;
+    expected.blockSize = m_u32BlockSize;
+    expected.slots = static_cast<uint32_t>(m_u64Slots);
+    SidecarHeader existing{};
+    struct stat st {};
+    bool bValid = fstat(m_Fd, &st) == 0 &&
+                  pread(m_Fd, &existing, sizeof(existing), 0) ==
+                      static_cast<ssize_t>(sizeof(existing)) &&
+                  std::memcmp(&existing, &expected, sizeof(expected)) == 0;
+    if (bValid) {
+      m_Zones.resize((st.st_size - sizeof(SidecarHeader)) / sizeof(Zone));
+      auto expectedReadSize =
+          static_cast<ssize_t>(m_Zones.size() * sizeof(Zone));
+      bValid = pread(m_Fd, m_Zones.data(), expectedReadSize,
+                     getZoneOffset(0)) == expectedReadSize;
+    }
+    if (!bValid) {
+      m_Zones.clear();
+      if (ftruncate(m_Fd, 0) != 0 ||
+          pwrite(m_Fd, &expected, sizeof(expected), 0) !=
+              static_cast<ssize_t>(sizeof(expected))) {
+        m_ErrorCode = ErrorCode::WRITE_ERROR;
+        return;
+      }
+    }
+    truncateZones(header.count);
+    if (header.count == 0) {
+      return;
+    }
+
+    // a data file which was cleared and refilled does not match anymore
+    const uint64_t last = (header.count - 1) / m_u32BlockSize;
+    Zone zone{};
+    if (isValid(getZone(last), last, header.count) &&
+        recompute(last, header, zone) && !isSameSummary(zone, getZone(last))) {
+      m_Zones.clear();
+      if (ftruncate(m_Fd, getZoneOffset(0)) != 0) {
+        m_ErrorCode = ErrorCode::TRUNCATE_ERROR;
+      }
+    }
+
+    const uint64_t oldest = header.count - getStoredCount(header);
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint64_t block = oldest / m_u32BlockSize; block <= last; block++) {
+      if (!isValid(getZone(block), block, header.count) &&
+          recompute(block, header, getZone(block))) {
+        writeZone(block);
+      }
+    }
+  }
+
+  [[nodiscard]] static bool isSameSummary(const Zone &i_Zone,
+                                          const Zone &i_Other) {
+    auto same = [](const auto &i_Value, const auto &i_OtherValue) {
+      return std::memcmp(&i_Value, &i_OtherValue, sizeof(i_Value)) == 0;
+    };
+    return ((same(i_Zone.min.*Fields, i_Other.min.*Fields) &&
+             same(i_Zone.max.*Fields, i_Other.max.*Fields)) &&
+            ...);
+  }
+
+  [[nodiscard]] bool isValid(const Zone &i_Zone, uint64_t i_u64Block,
+                             uint64_t i_u64Count) const {
+    return i_Zone.block == i_u64Block && i_Zone.count != 0 &&
+           i_Zone.count == getExpectedCount(i_u64Block, i_u64Count);
+  }
+
+public:
+  /*!
+   * Attach to i_File, loading or building the sidecar. Open it before
+   * appending, the zone map registers itself as an AppendObserver.
+   * @param i_File has to outlive the zone map
+   * @param i_u32BlockSize records per zone
+   * @param i_Path defaults to the path of i_File with ".zones" appended
+   */
+  explicit ZoneMap(File &i_File, uint32_t i_u32BlockSize = 4096,
+                   Path i_Path = {})
+      : m_File(i_File), m_u32BlockSize(std::max(i_u32BlockSize, 1U)),
+        m_Path(i_Path.empty() ? Path(i_File.getPath().string() + ".zones")
+                              : std::move(i_Path)) {
+    const uint32_t maxEntries = m_File.getHeader().maxEntries;
+    if (maxEntries != 0) {
+      // a window of maxEntries records touches at most this many blocks
+      m_u64Slots = maxEntries / m_u32BlockSize + 2;
+    }
+    load();
+    m_File.addAppendObserver(this);
+  }
+
+  ZoneMap(const ZoneMap &) = delete;
+  ZoneMap &operator=(const ZoneMap &) = delete;
+
+  ~ZoneMap() override {
+    m_File.removeAppendObserver(this);
+    if (m_Fd >= 0) {
+      close(m_Fd);
+    }
+  }
+
+  void onAppended(uint64_t i_u64FirstRecord,
+                  Span<const ContainerType> i_Containers) override {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    size_t done = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (done < i_Containers.size()) {
+      const uint64_t record = i_u64FirstRecord + done;
+      const uint64_t block = record / m_u32BlockSize;
+      const uint64_t position = record % m_u32BlockSize;
+      const size_t count = std::min<uint64_t>(i_Containers.size() - done,
+                                              m_u32BlockSize - position);
+      Zone &zone = getZone(block);
+      size_t i = 0;
+      if (position == 0) {
+        reset(zone, block, i_Containers[done].entry);
+        i = 1;
+      } else if (zone.block != block || zone.count != position) {
+        // records are missing, the zone stays invalid and is always read
+        zone.block = block;
+        zone.count = 0;
+        i = count;
+      }
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (; i < count; i++) {
+        widen(zone, i_Containers[done + i].entry);
+      }
+      if (zone.count != 0) {
+        zone.count = position + count;
+      }
+      writeZone(block);
+      done += count;
+    }
+  }
+
+  void onTruncated(uint64_t i_u64Count) override {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    truncateZones(i_u64Count);
+    if (i_u64Count % m_u32BlockSize != 0) {
+      const uint64_t block = i_u64Count / m_u32BlockSize;
+      auto header = m_File.getHeader();
+      header.count = static_cast<decltype(header.count)>(i_u64Count);
+      if (recompute(block, header, getZone(block))) {
+        writeZone(block);
+      }
+    }
+  }
+
+  /*!
+   * Call i_Callback with the containers of every stored block, oldest first,
+   * whose summary passes i_MayMatch. Blocks without a valid summary are
+   * always read. i_Callback still has to check every container. Containers
+   * hidden by the read filter of the file are left out.
+   * @param i_MayMatch e.g. above<&EntryType::field>(x)
+   * @param i_Callback
+   * @param o_pBlocksRead number of blocks which were read
+   * @param o_pErrorCode
+   * @return false if a read failed
+   */
+  bool scan(const ZoneFilter &i_MayMatch,
+            const std::function<void(Span<const ContainerType>)> &i_Callback,
+            uint64_t *o_pBlocksRead = nullptr,
+            ErrorCode *o_pErrorCode = nullptr) {
+    const auto header = m_File.getHeader();
+    uint64_t blocksRead = 0;
+    std::vector<ContainerType> buffer;
+    bool bOk = true;
+    m_File.beginLiveRead();
+    if (header.count != 0) {
+      const uint64_t oldest = header.count - getStoredCount(header);
+      const uint64_t last = (header.count - 1) / m_u32BlockSize;
+      // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+      for (uint64_t block = oldest / m_u32BlockSize; bOk && block <= last;
+           block++) {
+        Zone zone{};
+        {
+          std::lock_guard<std::mutex> lock(m_Mutex);
+          zone = getZone(block);
+        }
+        if (isValid(zone, block, header.count) &&
+            !i_MayMatch(zone.min, zone.max)) {
+          continue;
+        }
+        uint64_t first = 0;
+        size_t count = 0;
+        if (getStoredRange(block, header, first, count)) {
+          buffer.resize(count);
+          bOk = readRecords(first, buffer, header, o_pErrorCode);
+          if (bOk) {
+            blocksRead++;
+            const size_t live = keepLive(first, buffer, header);
+            if (live > 0) {
+              i_Callback(Span<const ContainerType>(buffer.data(), live));
+            }
+          }
+        }
+      }
+    }
+    m_File.endLiveRead();
+    if (o_pBlocksRead != nullptr) {
+      *o_pBlocksRead = blocksRead;
+    }
+    return bOk;
+  }
+
+  /*!
+   * Read every stored container passing i_Match, skipping blocks ruled out
+   * by i_MayMatch
+   * @param i_MayMatch
+   * @param i_Match
+   * @param o_Containers matches, oldest first
+   * @param o_pErrorCode
+   * @return false if a read failed
+   */
+  bool getEntries(const ZoneFilter &i_MayMatch,
+                  const std::function<bool(const EntryType &)> &i_Match,
+                  std::vector<ContainerType> &o_Containers,
+                  ErrorCode *o_pErrorCode = nullptr) {
+    o_Containers.clear();
+    return scan(
+        i_MayMatch,
+        [&i_Match, &o_Containers](Span<const ContainerType> i_Block) {
+          // NOLINTNEXTLINE(altera-unroll-loops)
+          for (const auto &container : i_Block) {
+            if (i_Match(container.entry)) {
+              o_Containers.emplace_back(container);
+            }
+          }
+        },
+        nullptr, o_pErrorCode);
+  }
+
+  //! Blocks which may hold a Field in [i_Low, i_High]
+  template <auto Field, typename ValueType>
+  static ZoneFilter between(ValueType i_Low, ValueType i_High) {
+    static_assert((isSameField<Field, Fields>() || ...),
+                  "Field is not summarized");
+    return [i_Low, i_High](const EntryType &i_Min, const EntryType &i_Max) {
+      return !(i_Max.*Field < i_Low) && !(i_High < i_Min.*Field);
+    };
+  }
+
+  //! Blocks which may hold a Field greater than i_Threshold
+  template <auto Field, typename ValueType>
+  static ZoneFilter above(ValueType i_Threshold) {
+    static_assert((isSameField<Field, Fields>() || ...),
+                  "Field is not summarized");
+    return [i_Threshold](const EntryType & /*i_Min*/, const EntryType &i_Max) {
+      return i_Threshold < i_Max.*Field;
+    };
+  }
+
+  //! Blocks which may hold a Field less than i_Threshold
+  template <auto Field, typename ValueType>
+  static ZoneFilter below(ValueType i_Threshold) {
+    static_assert((isSameField<Field, Fields>() || ...),
+                  "Field is not summarized");
+    return [i_Threshold](const EntryType &i_Min, const EntryType & /*i_Max*/) {
+      return i_Min.*Field < i_Threshold;
+    };
+  }
+
+  [[nodiscard]] uint32_t getBlockSize() const { return m_u32BlockSize; }
+
+  [[nodiscard]] Path getPath() const { return m_Path; }
+
+  //! @return first error of a sidecar operation, the zone map keeps working
+  //! from memory after a failed write
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+};
+
+} // namespace binfmt
+
+#endif // BINFMT__ZONEMAP_H_
@@ -2,13 +2,49 @@
 // Created by nbdy on 02.09.21.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <new>
+#include <numeric>
+#include <sys/mman.h>
+#include <thread>
+
 #include "FunctionTimer/FunctionTimer.h"
+#include "AsyncAppender.h"
+#include "ColumnarFile.h"
+#include "CompressedSegment.h"
+#include "FileUtils.h"
+#include "KeyIndex.h"
+#include "MappedBinaryFile.h"
+#include "SegmentedBinaryFile.h"
+#include "SequentialReader.h"
+#include "TombstoneMap.h"
+#include "ZoneMap.h"
 #include "test_common.h"
 
+#if __cplusplus >= 202002L
+#include "AsyncBinaryFile.h"
+#endif
+
+// counts every heap allocation of the benchmark binary
+std::atomic<uint64_t> g_u64Allocations{0};
+
+void *operator new(size_t i_szSize) {
+  g_u64Allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(i_szSize)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *i_pData) noexcept { std::free(i_pData); }
+void operator delete(void *i_pData, size_t /*i_szSize*/) noexcept { std::free(i_pData); }
+
 
 template<typename FileType>
 void benchmark_read(FileType* i_pFile, uint32_t i_u32Count, std::vector<TestBinaryEntryContainer> entries) {
-  auto t = *i_pFile;
+  auto &t = *i_pFile;
   int ec = 0;
   std::vector<TestBinaryEntryContainer> allContainers;
   FunctionTimer ft1(
@@ -22,8 +58,9 @@ void benchmark_read(FileType* i_pFile, uint32_t i_u32Count, std::vector<TestBina
   }
 }
 
-void testSingleInsert(uint32_t i_u32Count) {
-  auto t = getRandomTestFile();
+void testSingleInsert(uint32_t i_u32Count,
+                      binfmt::BinaryFileOptions i_Options = {}) {
+  auto t = getRandomTestFile(i_Options);
   std::vector<TestBinaryEntryContainer> entries;
 
   FunctionTimer ft([&t, &entries, i_u32Count]() {
@@ -36,6 +73,7 @@ void testSingleInsert(uint32_t i_u32Count) {
   });
 
   std::cout << "Single insert of " << i_u32Count << " items took " << ft.getExecutionTimeMs() << "ms" << std::endl;
+  EXPECT_TRUE(t.waitUntilDurable(t.getAppendSequence()));
   EXPECT_EQ(t.getFileSize(), i_u32Count * sizeof(TestBinaryEntryContainer) + sizeof(TestBinaryHeader));
   std::cout << "Size: " << t.getFileSize() << std::endl;
 
@@ -97,4 +135,878 @@ TEST(BinaryFile, test100kVectorInsert) {
 // NOLINTNEXTLINE(cert-err58-cpp)
 TEST(BinaryFile, test1MVectorInsert) {
   testVectorInsert(1000000);
-}
\ No newline at end of file
+}
+template <typename BatchType>
+void testBatchAppendAllocations(const char *i_pName, const BatchType &i_Batch) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  // the first call sizes the scratch buffer
+  EXPECT_EQ(t.append(i_Batch), binfmt::ErrorCode::OK);
+  uint64_t allocations = 0;
+  FunctionTimer ft([&t, &i_Batch, &allocations]() {
+    auto before = g_u64Allocations.load();
+    EXPECT_EQ(t.append(i_Batch), binfmt::ErrorCode::OK);
+    allocations = g_u64Allocations.load() - before;
+  });
+  std::cout << i_pName << " append of " << i_Batch.size() << " items took " << ft.getExecutionTimeMs()
+            << "ms, " << allocations << " allocations" << std::endl;
+  EXPECT_EQ(allocations, 0);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test1MBatchAppendAllocations) {
+  std::vector<TestBinaryEntry> entries(1000000);
+  std::vector<TestBinaryEntryContainer> containers;
+  for (auto &entry : entries) {
+    entry = generateRandomTestEntry();
+    containers.emplace_back(entry);
+  }
+  testBatchAppendAllocations("Entry span", binfmt::Span<const TestBinaryEntry>(entries));
+  testBatchAppendAllocations("Container span", binfmt::Span<const TestBinaryEntryContainer>(containers));
+  testBatchAppendAllocations("Entry vector", entries);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test10kSingleInsertGroupCommit) {
+  testSingleInsert(10000, {binfmt::DurabilityPolicy::GroupCommit});
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test10kSingleInsertDataSync) {
+  testSingleInsert(10000, {binfmt::DurabilityPolicy::DataSync});
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test100kSingleInsertGroupCommit) {
+  testSingleInsert(100000, {binfmt::DurabilityPolicy::GroupCommit});
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test100kSingleInsertOSManaged) {
+  testSingleInsert(100000, {binfmt::DurabilityPolicy::OSManaged});
+}
+
+void testMappedRead(uint32_t i_u32Count, uint32_t i_u32Passes) {
+  using MappedFile = binfmt::MappedBinaryFile<TestBinaryHeader, TestBinaryEntry,
+                                              TestBinaryEntryContainer>;
+  MappedFile t("/tmp/test.bin", TestBinaryHeader{});
+  std::vector<TestBinaryEntryContainer> entries(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    entries[i] = TestBinaryEntryContainer(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  uint64_t readSum = 0;
+  FunctionTimer ftRead([&t, &readSum, i_u32Passes]() {
+    for (uint32_t pass = 0; pass < i_u32Passes; pass++) {
+      std::vector<TestBinaryEntryContainer> containers;
+      EXPECT_TRUE(t.getAllEntries(containers));
+      for (const auto &container : containers) {
+        readSum += container.entry.m_u32Number;
+      }
+    }
+  });
+
+  uint64_t viewSum = 0;
+  FunctionTimer ftView([&t, &viewSum, i_u32Passes]() {
+    for (uint32_t pass = 0; pass < i_u32Passes; pass++) {
+      for (const auto &container : t.getAllEntriesView()) {
+        viewSum += container.entry.m_u32Number;
+      }
+    }
+  });
+
+  EXPECT_EQ(readSum, viewSum);
+  std::cout << i_u32Passes << "x " << i_u32Count << " getAllEntries: " << ftRead.getExecutionTimeMs() << "ms, "
+            << "getAllEntriesView: " << ftView.getExecutionTimeMs() << "ms" << std::endl;
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(MappedBinaryFile, test1MRead) {
+  testMappedRead(1000000, 10);
+}
+
+#ifdef BINFMT_X86_SIMD
+double measureBytesPerCycle(binfmt::Checksum::GenerateFunction i_Generate,
+                            const std::vector<char> &i_Data, uint32_t i_u32Size) {
+  const uint64_t iterations = (64ULL * 1024 * 1024) / i_u32Size;
+  volatile uint32_t sink = 0;
+  uint64_t start = __rdtsc();
+  for (uint64_t i = 0; i < iterations; i++) {
+    sink = sink + i_Generate(&i_Data[i % 64], i_u32Size);
+  }
+  uint64_t cycles = __rdtsc() - start;
+  return static_cast<double>(iterations * i_u32Size) / static_cast<double>(cycles);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(Checksum, testThroughput) {
+  std::vector<char> data(4096 + 64);
+  for (auto &c : data) {
+    c = static_cast<char>(generateRandomInteger());
+  }
+  const std::vector<std::pair<const char *, binfmt::Checksum::GenerateFunction>> implementations = {
+      {"scalar", &binfmt::Checksum::GenerateScalar},
+      {"sse2", &binfmt::Checksum::GenerateSSE2},
+      {"avx2", __builtin_cpu_supports("avx2") ? &binfmt::Checksum::GenerateAVX2 : nullptr},
+      {"dispatch", &binfmt::Checksum::Generate},
+      {"crc32c-sw", &binfmt::Checksum::GenerateCRC32CSoftware},
+      {"crc32c", &binfmt::Checksum::GenerateCRC32C},
+  };
+  std::cout << "bytes/cycle";
+  for (uint32_t size = 4; size <= 4096; size *= 4) {
+    std::cout << "\t" << size << "B";
+  }
+  std::cout << std::endl;
+  for (const auto &implementation : implementations) {
+    if (implementation.second == nullptr) {
+      continue;
+    }
+    std::cout << implementation.first;
+    for (uint32_t size = 4; size <= 4096; size *= 4) {
+      std::cout << "\t" << measureBytesPerCycle(implementation.second, data, size);
+    }
+    std::cout << std::endl;
+  }
+}
+#endif
+
+void testConcurrentAppend(uint32_t i_u32Writers, uint32_t i_u32PerWriter,
+                          binfmt::BinaryFileOptions i_Options = {}) {
+  auto t = getRandomTestFile(i_Options);
+  FunctionTimer ft([&t, i_u32Writers, i_u32PerWriter]() {
+    std::vector<std::thread> writers;
+    for (uint32_t w = 0; w < i_u32Writers; w++) {
+      writers.emplace_back([&t, i_u32PerWriter]() {
+        for (uint32_t i = 0; i < i_u32PerWriter; i++) {
+          EXPECT_EQ(t.appendConcurrent(generateRandomTestEntry()), binfmt::ErrorCode::OK);
+        }
+      });
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+  });
+  auto total = i_u32Writers * i_u32PerWriter;
+  EXPECT_EQ(t.getEntryCount(), total);
+  auto ms = std::max<int64_t>(ft.getExecutionTimeMs(), 1);
+  std::cout << i_u32Writers << " writers appended " << total << " items in " << ms << "ms ("
+            << total * 1000 / ms << " items/s)" << std::endl;
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testConcurrentAppendWriterSweep) {
+  for (uint32_t writers = 1; writers <= 32; writers *= 2) {
+    testConcurrentAppend(writers, 2000 / writers);
+  }
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testConcurrentAppendWriterSweepOSManaged) {
+  for (uint32_t writers = 1; writers <= 32; writers *= 2) {
+    testConcurrentAppend(writers, 320000 / writers, {binfmt::DurabilityPolicy::OSManaged});
+  }
+}
+
+void testAsyncAppender(uint32_t i_u32Producers, uint32_t i_u32PerProducer) {
+  auto t = getRandomTestFile();
+  int64_t appendMs = 0;
+  {
+    binfmt::AsyncAppender<TestBinaryHeader, TestBinaryEntry, TestBinaryEntryContainer> appender(t);
+    FunctionTimer ftAppend([&appender, i_u32Producers, i_u32PerProducer]() {
+      std::vector<std::thread> producers;
+      for (uint32_t p = 0; p < i_u32Producers; p++) {
+        producers.emplace_back([&appender, i_u32PerProducer]() {
+          for (uint32_t i = 0; i < i_u32PerProducer; i++) {
+            EXPECT_EQ(appender.append(generateRandomTestEntry()), binfmt::ErrorCode::OK);
+          }
+        });
+      }
+      for (auto &producer : producers) {
+        producer.join();
+      }
+    });
+    appendMs = ftAppend.getExecutionTimeMs();
+    FunctionTimer ftFlush([&appender]() { EXPECT_TRUE(appender.flush()); });
+    auto total = i_u32Producers * i_u32PerProducer;
+    std::cout << i_u32Producers << " producers queued " << total << " items in " << appendMs
+              << "ms, flush took " << ftFlush.getExecutionTimeMs() << "ms" << std::endl;
+  }
+  EXPECT_EQ(t.getEntryCount(), i_u32Producers * i_u32PerProducer);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncAppender, testProducerSweep) {
+  for (uint32_t producers = 1; producers <= 16; producers *= 2) {
+    testAsyncAppender(producers, 320000 / producers);
+  }
+}
+
+binfmt::BinaryFileOptions ioUringOptions() {
+  binfmt::BinaryFileOptions options;
+  options.ioBackend = binfmt::IoBackend::IoUring;
+  return options;
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test10kSingleInsertIoUring) {
+  testSingleInsert(10000, ioUringOptions());
+}
+
+void testVerify(uint32_t i_u32Count) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  std::vector<TestBinaryEntry> entries(i_u32Count);
+  for (auto &entry : entries) {
+    entry = generateRandomTestEntry();
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  FunctionTimer ftSingle([&t]() {
+    std::vector<TestBinaryEntryContainer> all;
+    EXPECT_TRUE(t.getAllEntries(all));
+    uint32_t invalid = 0;
+    for (const auto &container : all) {
+      invalid += !container.isEntryValid();
+    }
+    EXPECT_EQ(invalid, 0);
+  });
+  std::cout << i_u32Count << " getAllEntries + isEntryValid: " << ftSingle.getExecutionTimeMs() << "ms"
+            << std::endl;
+
+  for (uint32_t threads = 1; threads <= std::thread::hardware_concurrency(); threads *= 2) {
+    binfmt::ThreadPool pool(threads);
+    binfmt::VerifyResult result;
+    FunctionTimer ft([&t, &pool, &result]() { EXPECT_TRUE(t.verify(result, pool)); });
+    EXPECT_EQ(result.checked, i_u32Count);
+    std::cout << i_u32Count << " verify on " << threads << " threads: " << ft.getExecutionTimeMs() << "ms"
+              << std::endl;
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test10MVerify) {
+  testVerify(10000000);
+}
+
+void testMapReduce(uint32_t i_u32Count) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  std::vector<TestBinaryEntry> entries(i_u32Count);
+  for (auto &entry : entries) {
+    entry = generateRandomTestEntry();
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  uint64_t expected = 0;
+  FunctionTimer ftChunked([&t, &expected]() {
+    EXPECT_TRUE(t.getEntriesChunked([&expected](const std::vector<TestBinaryEntryContainer> &i_Chunk) {
+      for (const auto &container : i_Chunk) {
+        expected += container.entry.m_u32Number;
+      }
+    }));
+  });
+  std::cout << i_u32Count << " getEntriesChunked sum: " << ftChunked.getExecutionTimeMs() << "ms" << std::endl;
+
+  for (uint32_t threads = 1; threads <= std::thread::hardware_concurrency(); threads *= 2) {
+    binfmt::ThreadPool pool(threads);
+    uint64_t total = 0;
+    FunctionTimer ft([&t, &pool, &total]() {
+      EXPECT_TRUE(t.mapReduce(
+          total,
+          [](binfmt::Span<const TestBinaryEntryContainer> i_Containers) {
+            uint64_t r = 0;
+            for (const auto &container : i_Containers) {
+              r += container.entry.m_u32Number;
+            }
+            return r;
+          },
+          [](uint64_t a, uint64_t b) { return a + b; }, pool));
+    });
+    EXPECT_EQ(total, expected);
+    std::cout << i_u32Count << " mapReduce sum on " << threads << " threads: " << ft.getExecutionTimeMs() << "ms"
+              << std::endl;
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test10MMapReduce) {
+  testMapReduce(10000000);
+}
+
+void testSequentialReader(uint32_t i_u32Count, uint32_t i_u32ChunkSize) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  std::vector<TestBinaryEntry> entries(i_u32Count);
+  for (auto &entry : entries) {
+    entry = generateRandomTestEntry();
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  // stands in for the per chunk work of a consumer
+  auto process = [](const TestBinaryEntryContainer *i_pContainers, size_t i_szCount) {
+    uint32_t invalid = 0;
+    for (size_t i = 0; i < i_szCount; i++) {
+      invalid += !i_pContainers[i].isEntryValid();
+    }
+    EXPECT_EQ(invalid, 0);
+  };
+
+  FunctionTimer ftChunked([&t, &process, i_u32ChunkSize]() {
+    EXPECT_TRUE(t.getEntriesChunked(
+        [&process](const std::vector<TestBinaryEntryContainer> &i_Chunk) {
+          process(i_Chunk.data(), i_Chunk.size());
+        },
+        0, 0, i_u32ChunkSize));
+  });
+  FunctionTimer ftReader([&t, &process, i_u32ChunkSize]() {
+    binfmt::SequentialReader<TestBinaryHeader, TestBinaryEntry, TestBinaryEntryContainer> reader(
+        t, 0, 0, i_u32ChunkSize);
+    EXPECT_TRUE(reader.forEach([&process](binfmt::Span<const TestBinaryEntryContainer> i_Chunk) {
+      process(i_Chunk.data(), i_Chunk.size());
+    }));
+  });
+  std::cout << i_u32Count << " items in chunks of " << i_u32ChunkSize << ": getEntriesChunked "
+            << ftChunked.getExecutionTimeMs() << "ms, SequentialReader " << ftReader.getExecutionTimeMs() << "ms"
+            << std::endl;
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SequentialReader, test10MScan) {
+  testSequentialReader(10000000, 65536);
+}
+
+void testKeyIndexRange(uint32_t i_u32Count, uint32_t i_u32RangeSize) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  auto keyOf = [](const TestBinaryEntry &i_Entry) { return i_Entry.m_u32Number; };
+  binfmt::KeyIndex<TestBinaryHeader, TestBinaryEntry, TestBinaryEntryContainer, uint32_t> index(t, keyOf);
+  // ascending like a timestamp
+  std::vector<TestBinaryEntry> entries(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    entries[i] = TestBinaryEntry{i};
+  }
+  FunctionTimer ftAppend([&t, &entries]() { EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK); });
+
+  const uint32_t low = i_u32Count / 2;
+  const uint32_t high = low + i_u32RangeSize - 1;
+  size_t scanned = 0;
+  FunctionTimer ftScan([&t, &scanned, keyOf, low, high]() {
+    EXPECT_TRUE(t.getEntriesChunked([&scanned, keyOf, low, high](const std::vector<TestBinaryEntryContainer> &i_Chunk) {
+      for (const auto &container : i_Chunk) {
+        const uint32_t key = keyOf(container.entry);
+        scanned += key >= low && key <= high;
+      }
+    }));
+  });
+  std::vector<TestBinaryEntryContainer> found;
+  FunctionTimer ftIndex([&index, &found, low, high]() { EXPECT_TRUE(index.getEntries(low, high, found)); });
+  EXPECT_EQ(scanned, i_u32RangeSize);
+  EXPECT_EQ(found.size(), i_u32RangeSize);
+
+  std::cout << i_u32Count << " items, " << index.getSampleCount() << " samples: indexed append "
+            << ftAppend.getExecutionTimeMs() << "ms, " << i_u32RangeSize << " keys by full scan "
+            << ftScan.getExecutionTimeMs() << "ms, by findRange " << ftIndex.getExecutionTimeMs() << "ms"
+            << std::endl;
+  auto indexPath = index.getPath();
+  cleanupTestFile(t);
+  cleanup(indexPath);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(KeyIndex, test10MRangeQuery) {
+  testKeyIndexRange(10000000, 10000);
+}
+
+struct SensorReading {
+  float temperature;
+  uint32_t timestamp;
+};
+
+void testZoneMapThreshold(uint32_t i_u32Count, uint32_t i_u32BlockSize) {
+  using Container = binfmt::BinaryEntryContainer<SensorReading>;
+  using File = binfmt::BinaryFile<TestBinaryHeader, SensorReading, Container>;
+  using Zones = binfmt::ZoneMap<TestBinaryHeader, SensorReading, Container, &SensorReading::temperature>;
+  File f("/tmp/test.bin", TestBinaryHeader{}, {binfmt::DurabilityPolicy::OSManaged});
+  Zones zones(f, i_u32BlockSize);
+  // a hot spell of 1000 readings every million
+  std::vector<SensorReading> readings(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    readings[i] = SensorReading{i % 1000000 < 1000 ? 45.0F : 20.0F + static_cast<float>(i % 10), i};
+  }
+  FunctionTimer ftAppend([&f, &readings]() { EXPECT_EQ(f.append(readings), binfmt::ErrorCode::OK); });
+
+  size_t scanned = 0;
+  FunctionTimer ftScan([&f, &scanned]() {
+    EXPECT_TRUE(f.getEntriesChunked([&scanned](const std::vector<Container> &i_Chunk) {
+      for (const auto &container : i_Chunk) {
+        scanned += container.entry.temperature > 40.0F;
+      }
+    }));
+  });
+  size_t filtered = 0;
+  uint64_t blocksRead = 0;
+  FunctionTimer ftZones([&zones, &filtered, &blocksRead]() {
+    EXPECT_TRUE(zones.scan(
+        Zones::above<&SensorReading::temperature>(40.0F),
+        [&filtered](binfmt::Span<const Container> i_Block) {
+          for (const auto &container : i_Block) {
+            filtered += container.entry.temperature > 40.0F;
+          }
+        },
+        &blocksRead));
+  });
+  EXPECT_EQ(scanned, filtered);
+
+  const uint64_t blocks = (i_u32Count + i_u32BlockSize - 1) / i_u32BlockSize;
+  std::cout << i_u32Count << " readings, " << filtered << " above threshold: zoned append " << ftAppend.getExecutionTimeMs()
+            << "ms, full scan " << ftScan.getExecutionTimeMs() << "ms, zone map scan " << ftZones.getExecutionTimeMs()
+            << "ms reading " << blocksRead << " of " << blocks << " blocks" << std::endl;
+  auto zonesPath = zones.getPath();
+  cleanupTestFile(f);
+  cleanup(zonesPath);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ZoneMap, test10MThresholdScan) {
+  testZoneMapThreshold(10000000, 4096);
+}
+
+struct LogLine {
+  char message[128];
+};
+
+void testCompressedSegment(uint32_t i_u32Count, uint32_t i_u32BlockSize, uint32_t i_u32Reads) {
+  using Container = binfmt::BinaryEntryContainer<LogLine>;
+  using File = binfmt::BinaryFile<TestBinaryHeader, LogLine, Container>;
+  using Segment = binfmt::CompressedSegment<TestBinaryHeader, LogLine, Container>;
+  const char *segmentPath = "/tmp/test.segment";
+  File f("/tmp/test.bin", TestBinaryHeader{}, {binfmt::DurabilityPolicy::OSManaged});
+  std::vector<LogLine> lines(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    std::snprintf(lines[i].message, sizeof(lines[i].message), "%u worker %u finished job %u in %ums", i, i % 16,
+                  i / 16, generateRandomInteger() % 1000);
+  }
+  EXPECT_EQ(f.append(lines), binfmt::ErrorCode::OK);
+  FunctionTimer ftWrite([&f, segmentPath, i_u32BlockSize]() { EXPECT_TRUE(Segment::write(f, segmentPath, i_u32BlockSize)); });
+  Segment segment(segmentPath);
+
+  std::vector<uint32_t> indices(i_u32Reads);
+  for (auto &index : indices) {
+    index = generateRandomInteger() % i_u32Count;
+  }
+  FunctionTimer ftRawRead([&f, &indices]() {
+    Container container;
+    for (auto index : indices) {
+      EXPECT_TRUE(f.getEntry(index, container));
+    }
+  });
+  FunctionTimer ftSegmentRead([&segment, &indices]() {
+    Container container;
+    for (auto index : indices) {
+      EXPECT_TRUE(segment.getEntry(index, container));
+    }
+  });
+  uint64_t scanned = 0;
+  FunctionTimer ftRawScan([&f, &scanned]() {
+    EXPECT_TRUE(f.getEntriesChunked([&scanned](const std::vector<Container> &i_Chunk) { scanned += i_Chunk.size(); }));
+  });
+  FunctionTimer ftSegmentScan([&segment, &scanned]() {
+    EXPECT_TRUE(segment.getEntriesChunked([&scanned](binfmt::Span<const Container> i_Block) { scanned += i_Block.size(); }));
+  });
+  EXPECT_EQ(scanned, 2ULL * i_u32Count);
+
+  const uint64_t rawSize = static_cast<uint64_t>(i_u32Count) * sizeof(Container);
+  std::cout << i_u32Count << " log lines, blocks of " << i_u32BlockSize << ": " << rawSize / 1024 / 1024 << "MiB raw, "
+            << segment.getCompressedSize() / 1024 / 1024 << "MiB compressed in " << ftWrite.getExecutionTimeMs()
+            << "ms; " << i_u32Reads << " random reads raw " << ftRawRead.getExecutionTimeMs() << "ms, compressed "
+            << ftSegmentRead.getExecutionTimeMs() << "ms; scan raw " << ftRawScan.getExecutionTimeMs()
+            << "ms, compressed " << ftSegmentScan.getExecutionTimeMs() << "ms" << std::endl;
+  cleanupTestFile(f);
+  cleanup(segmentPath);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(CompressedSegment, test1MLogLines) {
+  testCompressedSegment(1000000, 64, 10000);
+  testCompressedSegment(1000000, 1024, 10000);
+}
+
+struct StationReading {
+  uint32_t timestamp;
+  float temperature;
+  char station[56];
+};
+
+void testColumnarAggregate(uint32_t i_u32Count) {
+  using Container = binfmt::BinaryEntryContainer<StationReading>;
+  using File = binfmt::BinaryFile<TestBinaryHeader, StationReading, Container>;
+  using Columns =
+      binfmt::ColumnarFile<TestBinaryHeader, StationReading, &StationReading::timestamp, &StationReading::temperature>;
+  std::vector<StationReading> readings(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    readings[i] = StationReading{i, static_cast<float>(i % 40), {}};
+  }
+  File f("/tmp/test.bin", TestBinaryHeader{}, {binfmt::DurabilityPolicy::OSManaged});
+  Columns columns("/tmp/test.columns", TestBinaryHeader{}, {binfmt::DurabilityPolicy::OSManaged});
+  FunctionTimer ftRowAppend([&f, &readings]() { EXPECT_EQ(f.append(readings), binfmt::ErrorCode::OK); });
+  FunctionTimer ftColumnAppend([&columns, &readings]() { EXPECT_EQ(columns.append(readings), binfmt::ErrorCode::OK); });
+
+  double rowSum = 0;
+  FunctionTimer ftRowScan([&f, &rowSum]() {
+    EXPECT_TRUE(f.getLogicalEntriesChunked([&rowSum](binfmt::Span<const Container> i_Chunk) {
+      for (const auto &container : i_Chunk) {
+        rowSum += container.entry.temperature;
+      }
+    }));
+  });
+  double columnSum = 0;
+  FunctionTimer ftColumnScan([&columns, &columnSum]() {
+    EXPECT_TRUE(columns.scanColumns<&StationReading::temperature>([&columnSum](binfmt::Span<const float> i_Values) {
+      columnSum += std::accumulate(i_Values.begin(), i_Values.end(), 0.0);
+    }));
+  });
+  EXPECT_EQ(rowSum, columnSum);
+
+  std::cout << i_u32Count << " readings of " << sizeof(Container) << " bytes: append rows "
+            << ftRowAppend.getExecutionTimeMs() << "ms, columns " << ftColumnAppend.getExecutionTimeMs()
+            << "ms; average temperature over rows " << ftRowScan.getExecutionTimeMs() << "ms, over the column "
+            << ftColumnScan.getExecutionTimeMs() << "ms" << std::endl;
+  cleanupTestFile(f);
+  EXPECT_TRUE(columns.deleteFiles());
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ColumnarFile, test10MAggregate) {
+  testColumnarAggregate(10000000);
+}
+
+void testSegmentedScan(uint32_t i_u32Count, uint32_t i_u32SegmentEntries) {
+  using Segmented = binfmt::SegmentedBinaryFile<TestBinaryHeader, TestBinaryEntry, TestBinaryEntryContainer>;
+  binfmt::SegmentOptions options;
+  options.maxEntries = i_u32SegmentEntries;
+  options.fileOptions.durability = binfmt::DurabilityPolicy::OSManaged;
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  Segmented segmented("/tmp/test.segments", TestBinaryHeader{}, options);
+  std::vector<TestBinaryEntry> entries(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    entries[i] = TestBinaryEntry{i};
+  }
+  FunctionTimer ftAppend([&t, &entries]() { EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK); });
+  FunctionTimer ftSegmentedAppend([&segmented, &entries]() {
+    EXPECT_EQ(segmented.append(entries), binfmt::ErrorCode::OK);
+    EXPECT_TRUE(segmented.seal());
+  });
+
+  uint64_t sum = 0;
+  FunctionTimer ftScan([&t, &sum]() {
+    EXPECT_TRUE(t.getEntriesChunked([&sum](const std::vector<TestBinaryEntryContainer> &i_Chunk) {
+      for (const auto &container : i_Chunk) {
+        sum += container.isEntryValid() ? container.entry.m_u32Number : 0;
+      }
+    }));
+  });
+  std::atomic<uint64_t> segmentedSum{0};
+  FunctionTimer ftSegmentedScan([&segmented, &segmentedSum]() {
+    EXPECT_TRUE(segmented.scanSealed(
+        [&segmentedSum](uint64_t, binfmt::Span<const TestBinaryEntryContainer> i_Chunk) {
+          uint64_t partial = 0;
+          for (const auto &container : i_Chunk) {
+            partial += container.isEntryValid() ? container.entry.m_u32Number : 0;
+          }
+          segmentedSum += partial;
+        }));
+  });
+  EXPECT_EQ(sum, segmentedSum.load());
+
+  std::cout << i_u32Count << " items in segments of " << i_u32SegmentEntries << ": append one file "
+            << ftAppend.getExecutionTimeMs() << "ms, segmented " << ftSegmentedAppend.getExecutionTimeMs()
+            << "ms; checked scan of one file " << ftScan.getExecutionTimeMs() << "ms, of the sealed segments in parallel "
+            << ftSegmentedScan.getExecutionTimeMs() << "ms" << std::endl;
+  cleanupTestFile(t);
+  EXPECT_TRUE(segmented.deleteFiles());
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SegmentedBinaryFile, test10MScan) {
+  testSegmentedScan(10000000, 1000000);
+}
+
+// open a sparse file of i_u64Size bytes whose header is a checkpoint
+// i_u32Lag records behind, as if the process had died
+void testOpenAfterCrash(uint64_t i_u64Size, uint32_t i_u32Lag) {
+  const uint64_t count = (i_u64Size - sizeof(TestBinaryHeader)) / sizeof(TestBinaryEntryContainer);
+  {
+    std::ofstream out("/tmp/test.bin", std::ios::binary);
+    TestBinaryHeader header(0xBEEF, 1, static_cast<uint32_t>(count - i_u32Lag),
+                            static_cast<uint32_t>(count - i_u32Lag), 0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    std::vector<TestBinaryEntryContainer> tail;
+    for (uint32_t i = 0; i < i_u32Lag; i++) {
+      tail.emplace_back(generateRandomTestEntry());
+    }
+    out.seekp(static_cast<std::streamoff>(sizeof(TestBinaryHeader) +
+                                          (count - i_u32Lag) * sizeof(TestBinaryEntryContainer)));
+    out.write(reinterpret_cast<const char *>(tail.data()),
+              static_cast<std::streamsize>(tail.size() * sizeof(TestBinaryEntryContainer)));
+  }
+  int fd = open("/tmp/test.bin", O_RDONLY);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+
+  // too short for FunctionTimer's milliseconds
+  auto begin = std::chrono::steady_clock::now();
+  uint64_t recovered = 0;
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{});
+    recovered = t.getEntryCount();
+  }
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+  EXPECT_EQ(recovered, count);
+  std::cout << "open after crash, " << (i_u64Size >> 30U) << "GiB file, " << i_u32Lag
+            << " records behind the checkpoint: " << us << "us" << std::endl;
+  std::filesystem::remove("/tmp/test.bin");
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testOpenAfterCrash) {
+  for (uint64_t size : {1ULL << 30U, 10ULL << 30U}) {
+    testOpenAfterCrash(size, 4096);
+  }
+}
+
+// remove the entry at position 1 of a file of i_u32Count containers
+void testRemoveEarlyEntry(uint32_t i_u32Count, bool i_bBulk) {
+  using Utils = binfmt::FileUtils;
+  Utils::WriteHeader("/tmp/test.bin", TestBinaryHeader{});
+  std::vector<TestBinaryEntryContainer> containers(i_u32Count);
+  for (auto &container : containers) {
+    container = generateRandomTestEntryContainer();
+  }
+  Utils::WriteDataVector<TestBinaryHeader>("/tmp/test.bin", containers);
+  FunctionTimer ft([i_bBulk]() {
+    EXPECT_TRUE((i_bBulk ? Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>("/tmp/test.bin", 1)
+                         : Utils::RemoveAt<TestBinaryHeader, TestBinaryEntryContainer>("/tmp/test.bin", 1)));
+  });
+  EXPECT_EQ((Utils::GetEntryCount<TestBinaryHeader, TestBinaryEntryContainer>("/tmp/test.bin")), i_u32Count - 1);
+  std::cout << (i_bBulk ? "RemoveEntries" : "RemoveAt") << " of an early entry of " << i_u32Count
+            << " items: " << ft.getExecutionTimeMs() << "ms" << std::endl;
+  Utils::DeleteFile("/tmp/test.bin");
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(FileUtils, testRemoveEarlyEntry) {
+  for (uint32_t count : {1000U, 10000U}) {
+    testRemoveEarlyEntry(count, false);
+    testRemoveEarlyEntry(count, true);
+  }
+  testRemoveEarlyEntry(1000000, true);
+  testRemoveEarlyEntry(10000000, true);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testCompact1PercentOf1M) {
+  const uint32_t count = 1000000;
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  binfmt::TombstoneMap<TestBinaryHeader, TestBinaryEntry, TestBinaryEntryContainer> map(t);
+  std::vector<TestBinaryEntry> entries(count);
+  for (auto &entry : entries) {
+    entry = generateRandomTestEntry();
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+  std::vector<uint32_t> indices(count / 100);
+  for (auto &index : indices) {
+    index = generateRandomInteger() % count;
+  }
+  FunctionTimer removeTimer([&map, &indices]() { EXPECT_TRUE(map.remove(indices)); });
+
+  // appends go on while compacting, the slowest one is the pause
+  std::atomic<bool> done{false};
+  std::vector<int64_t> latencies;
+  std::thread appender([&t, &done, &latencies]() {
+    while (!done) {
+      auto begin = std::chrono::steady_clock::now();
+      EXPECT_EQ(t.append(generateRandomTestEntry()), binfmt::ErrorCode::OK);
+      latencies.push_back(
+          std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  });
+  uint32_t steps = 0;
+  FunctionTimer compactTimer([&map, &steps]() {
+    while (map.getRemovedCount() > 0) {
+      EXPECT_TRUE(map.compact(65536));
+      steps++;
+    }
+  });
+  done = true;
+  appender.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << "Removing " << indices.size() << " of " << count << " items: " << removeTimer.getExecutionTimeMs()
+            << "ms, compacting in " << steps << " steps: " << compactTimer.getExecutionTimeMs() << "ms, "
+            << latencies.size() << " appends meanwhile, p50 " << latencies[latencies.size() / 2] << "us max "
+            << latencies.back() << "us" << std::endl;
+  auto path = map.getPath();
+  cleanupTestFile(t);
+  cleanup(path);
+}
+
+// fraction of the pages of [i_szBegin, i_szEnd) which are in the page cache
+double residentFraction(const std::string &i_Path, size_t i_szBegin, size_t i_szEnd) {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  int fd = open(i_Path.c_str(), O_RDONLY);
+  size_t size = std::filesystem::file_size(i_Path);
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  std::vector<unsigned char> pages((size + page - 1) / page);
+  mincore(mapping, size, pages.data());
+  munmap(mapping, size);
+  close(fd);
+  size_t resident = 0;
+  for (size_t i = i_szBegin / page; i < i_szEnd / page; i++) {
+    resident += pages[i] & 1;
+  }
+  return static_cast<double>(resident) / std::max<size_t>(i_szEnd / page - i_szBegin / page, 1);
+}
+
+void testColdScanWithTailReader(binfmt::ScanMode i_ScanMode) {
+  const uint32_t count = 10000000;
+  const uint32_t hot = 65536;
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::OSManaged;
+  options.scanMode = i_ScanMode;
+  options.hotTailEntries = hot;
+  auto t = getRandomTestFile(options);
+  std::vector<TestBinaryEntry> entries(count);
+  for (auto &entry : entries) {
+    entry = generateRandomTestEntry();
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_TRUE(t.flush());
+
+  // cold file with a warm tail
+  {
+    int fd = open(t.getPath().c_str(), O_RDONLY);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    std::vector<TestBinaryEntryContainer> tail;
+    EXPECT_TRUE(t.getEntriesFrom(tail, count - hot, hot));
+  }
+
+  std::atomic<bool> done{false};
+  std::vector<int64_t> latencies;
+  std::thread tailReader([&t, &done, &latencies, count, hot]() {
+    TestBinaryEntryContainer c;
+    while (!done) {
+      auto begin = std::chrono::steady_clock::now();
+      EXPECT_TRUE(t.getEntry(count - 1 - generateRandomInteger() % hot, c));
+      latencies.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+  });
+  FunctionTimer ft([&t]() {
+    EXPECT_TRUE(t.getEntriesChunked([](const std::vector<TestBinaryEntryContainer> &) {}));
+  });
+  done = true;
+  tailReader.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  size_t headEnd = sizeof(TestBinaryHeader) + static_cast<size_t>(count - hot) * sizeof(TestBinaryEntryContainer);
+  std::cout << (i_ScanMode == binfmt::ScanMode::Streaming ? "Streaming" : "Default") << " cold scan of " << count
+            << " items: " << ft.getExecutionTimeMs() << "ms, tail reads p50 "
+            << latencies[latencies.size() / 2] << "ns p99 " << latencies[latencies.size() * 99 / 100]
+            << "ns, cached afterwards: head " << residentFraction(t.getPath(), 0, headEnd) * 100 << "% tail "
+            << residentFraction(t.getPath(), headEnd, t.getFileSize()) * 100 << "%" << std::endl;
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testColdScanWithTailReader) {
+  testColdScanWithTailReader(binfmt::ScanMode::Default);
+  testColdScanWithTailReader(binfmt::ScanMode::Streaming);
+}
+
+void testRandomRead(uint32_t i_u32Count, uint32_t i_u32Reads,
+                    binfmt::BinaryFileOptions i_Options) {
+  auto t = getRandomTestFile(i_Options);
+  std::vector<TestBinaryEntryContainer> entries(i_u32Count);
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    entries[i] = TestBinaryEntryContainer(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+  std::vector<uint32_t> indices(i_u32Reads);
+  for (auto &index : indices) {
+    index = generateRandomInteger() % i_u32Count;
+  }
+
+  FunctionTimer ftSingle([&t, &indices]() {
+    TestBinaryEntryContainer container;
+    for (auto index : indices) {
+      EXPECT_TRUE(t.getEntry(index, container));
+    }
+  });
+  std::vector<TestBinaryEntryContainer> read;
+  FunctionTimer ftBatch([&t, &indices, &read]() {
+    EXPECT_TRUE(t.getEntries(indices, read));
+  });
+  EXPECT_EQ(read.back().entry.m_u32Number, indices.back());
+
+  std::cout << i_u32Reads << " random reads (io_uring " << (t.isIoUringActive() ? "on" : "off")
+            << "): getEntry " << ftSingle.getExecutionTimeMs() << "ms, getEntries "
+            << ftBatch.getExecutionTimeMs() << "ms" << std::endl;
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, test100kRandomRead) {
+  testRandomRead(1000000, 100000, {});
+  testRandomRead(1000000, 100000, ioUringOptions());
+}
+
+#if __cplusplus >= 202002L
+void testAsyncAppend(uint32_t i_u32Count, uint32_t i_u32Threads,
+                     binfmt::BinaryFileOptions i_Options) {
+  auto t = getRandomTestFile(i_Options);
+  std::atomic<uint32_t> inFlight{0};
+  std::atomic<uint32_t> peakInFlight{0};
+  {
+    binfmt::AsyncBinaryFile<TestBinaryHeader, TestBinaryEntry, TestBinaryEntryContainer> f(t, i_u32Threads);
+    FunctionTimer ft([&]() {
+      std::promise<void> allDone;
+      std::atomic<uint32_t> done{0};
+      for (uint32_t i = 0; i < i_u32Count; i++) {
+        auto current = ++inFlight;
+        auto peak = peakInFlight.load();
+        while (current > peak && !peakInFlight.compare_exchange_weak(peak, current)) {
+        }
+        binfmt::spawn(f.append(generateRandomTestEntry()), [&](binfmt::ErrorCode r) {
+          EXPECT_EQ(r, binfmt::ErrorCode::OK);
+          inFlight--;
+          if (++done == i_u32Count) {
+            allDone.set_value();
+          }
+        });
+      }
+      allDone.get_future().wait();
+    });
+    auto ms = std::max<int64_t>(ft.getExecutionTimeMs(), 1);
+    std::cout << i_u32Threads << " threads, " << i_u32Count << " async appends in " << ms << "ms ("
+              << static_cast<uint64_t>(i_u32Count) * 1000 / ms << " items/s), peak in flight "
+              << peakInFlight.load() << std::endl;
+  }
+  EXPECT_EQ(t.getEntryCount(), i_u32Count);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncBinaryFile, test100kAsyncAppendGroupCommit) {
+  testAsyncAppend(100000, 4, {binfmt::DurabilityPolicy::GroupCommit, 1024});
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncBinaryFile, test2kAsyncAppendSyncEveryAppend) {
+  testAsyncAppend(2000, 4, {binfmt::DurabilityPolicy::SyncEveryAppend});
+}
+#endif
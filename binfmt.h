@@ -11,18 +11,46 @@
 #define LOCK_FREE
 #define CAPTURE_ERRORS
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <vector>
 #include <functional>
+#include <limits>
+#include <map>
+#include <memory>
 #include <fcntl.h>
 #include <filesystem>
 #include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
 #include <unistd.h>
 #include <utility>
 
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BINFMT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define BINFMT_IO_URING
+#include "IoUring.h"
+#endif
+
 #ifdef CAPTURE_ERRORS
 #include <cstring>
 #endif
 
+#include "ThreadPool.h"
+
 /*!
  *  \addtogroup binfmt
  *  @{
@@ -43,21 +71,108 @@ enum SizeType {
 #define LG(mtx) LockGuard ___lg(mtx)
 #endif
 
+#if __cplusplus >= 202002L
+template <typename T> using Span = std::span<T>;
+#else
+//! Minimal stand-in for std::span when compiling as C++17
+template <typename T> class Span {
+  T *m_pData = nullptr;
+  size_t m_szSize = 0;
+
+public:
+  Span() = default;
+
+  Span(T *i_pData, size_t i_szSize) : m_pData(i_pData), m_szSize(i_szSize) {}
+
+  template <typename ContainerType,
+            typename = decltype(std::declval<ContainerType &>().data())>
+  Span(ContainerType &i_Container) // NOLINT(google-explicit-constructor)
+      : m_pData(i_Container.data()), m_szSize(i_Container.size()) {}
+
+  [[nodiscard]] T *data() const { return m_pData; }
+  [[nodiscard]] size_t size() const { return m_szSize; }
+  [[nodiscard]] size_t size_bytes() const { return m_szSize * sizeof(T); }
+  [[nodiscard]] bool empty() const { return m_szSize == 0; }
+  T *begin() const { return m_pData; }
+  T *end() const { return m_pData + m_szSize; }
+  T &front() const { return m_pData[0]; }
+  T &back() const { return m_pData[m_szSize - 1]; }
+  T &operator[](size_t i_szIndex) const { return m_pData[i_szIndex]; }
+
+  [[nodiscard]] Span subspan(size_t i_szOffset, size_t i_szCount) const {
+    return Span(m_pData + i_szOffset, i_szCount);
+  }
+};
+#endif
+
+/*!
+ * Sequence lock for small trivially copyable values. A single writer stores
+ * without blocking, readers retry until they copied a consistent value.
+ * @tparam T
+ */
+template <typename T> class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SeqLock requires a trivially copyable type");
+  static constexpr size_t WordCount =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint32_t> m_u32Sequence{0};
+  std::array<std::atomic<uint64_t>, WordCount> m_Words{};
+
+public:
+  //! Must not be called by two threads at the same time
+  void store(const T &i_Value) {
+    std::array<uint64_t, WordCount> words{};
+    std::memcpy(words.data(), &i_Value, sizeof(T));
+    uint32_t sequence = m_u32Sequence.load(std::memory_order_relaxed);
+    m_u32Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (size_t i = 0; i < WordCount; i++) {
+      m_Words[i].store(words[i], std::memory_order_relaxed);
+    }
+    m_u32Sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    std::array<uint64_t, WordCount> words{};
+    uint32_t before = 0;
+    uint32_t after = 0;
+    do {
+      before = m_u32Sequence.load(std::memory_order_acquire);
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = 0; i < WordCount; i++) {
+        words[i] = m_Words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = m_u32Sequence.load(std::memory_order_relaxed);
+    } while ((before & 1U) != 0 || before != after);
+    T r;
+    // T only has to be trivially copyable, not trivial
+    std::memcpy(static_cast<void *>(&r), words.data(), sizeof(T));
+    return r;
+  }
+};
+
 //! Class to generate a checksum from a buffer
 struct Checksum {
+  //! Signature shared by every Generate implementation
+  using GenerateFunction = uint32_t (*)(const char *, uint32_t);
+
   /*!
-   * Generate a basic Checksum
+   * Generate a basic Checksum, the negated sum of all bytes.
+   * Dispatches to the fastest implementation supported by the CPU.
    * @param data const char*
    * @param length length of data in bytes
    * @return uint32 checksum
    */
   static uint32_t Generate(const char *data, uint32_t length) {
-    uint32_t r = 0;
-    do // NOLINT(altera-unroll-loops)
-    {
-      r += *data++;
-    } while (--length != 0U);
-    return -r;
+    // the vector loops only pay off once there is a full register to fill
+    if (length < 16) {
+      return GenerateScalar(data, length);
+    }
+    static const GenerateFunction generate = SelectGenerate();
+    return generate(data, length);
   }
 
   /*!
@@ -69,6 +184,221 @@ struct Checksum {
   static uint32_t Generate(const std::string &data) {
     return Checksum::Generate(data.c_str(), data.size());
   }
+
+  /*!
+   * Portable byte-at-a-time implementation of Generate
+   * @param data const char*
+   * @param length length of data in bytes
+   * @return uint32 checksum
+   */
+  static uint32_t GenerateScalar(const char *data, uint32_t length) {
+    uint32_t r = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < length; i++) {
+      r += data[i];
+    }
+    return -r;
+  }
+
+  /*!
+   * CRC32C (Castagnoli), uses the SSE4.2 crc32 instruction when available
+   * @param data const char*
+   * @param length length of data in bytes
+   * @return uint32 checksum
+   */
+  static uint32_t GenerateCRC32C(const char *data, uint32_t length) {
+    static const GenerateFunction generate = SelectCRC32C();
+    return generate(data, length);
+  }
+
+  /*!
+   * Table driven implementation of GenerateCRC32C
+   * @param data const char*
+   * @param length length of data in bytes
+   * @return uint32 checksum
+   */
+  static uint32_t GenerateCRC32CSoftware(const char *data, uint32_t length) {
+    static const auto table = [] {
+      std::array<uint32_t, 256> t{};
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (uint32_t i = 0; i < t.size(); i++) {
+        uint32_t c = i;
+        // NOLINTNEXTLINE(altera-unroll-loops)
+        for (int bit = 0; bit < 8; bit++) {
+          c = (c & 1U) != 0 ? (c >> 1U) ^ 0x82F63B78U : c >> 1U;
+        }
+        t[i] = c;
+      }
+      return t;
+    }();
+
+    uint32_t crc = ~0U;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < length; i++) {
+      crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFFU] ^ (crc >> 8U);
+    }
+    return ~crc;
+  }
+
+  /*!
+   * 64 bit hash of the buffer (MurmurHash64A, seed 0)
+   * @param data const char*
+   * @param length length of data in bytes
+   * @return uint64 hash
+   */
+  static uint64_t GenerateHash64(const char *data, uint32_t length) {
+    const uint64_t m = 0xC6A4A7935BD1E995ULL;
+    const uint32_t r = 47;
+    uint64_t h = length * m;
+
+    uint32_t i = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; i + 8 <= length; i += 8) {
+      uint64_t k = 0;
+      std::memcpy(&k, data + i, sizeof(k));
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+
+    uint32_t tail = length - i;
+    if (tail != 0) {
+      uint64_t k = 0;
+      std::memcpy(&k, data + i, tail);
+      h ^= k;
+      h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+  }
+
+#ifdef BINFMT_X86_SIMD
+  //! SSE2 implementation of Generate
+  __attribute__((target("sse2"))) static uint32_t
+  GenerateSSE2(const char *data, uint32_t length) {
+    const __m128i bias = _mm_set1_epi8(CharBias);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    uint32_t i = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; i + 16 <= length; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_xor_si128(v, bias), zero));
+    }
+    uint64_t sum = static_cast<uint64_t>(_mm_cvtsi128_si64(acc)) +
+                   static_cast<uint64_t>(
+                       _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc, acc)));
+    return finishVectorSum(sum, data + i, length - i, i);
+  }
+
+  //! AVX2 implementation of Generate
+  __attribute__((target("avx2"))) static uint32_t
+  GenerateAVX2(const char *data, uint32_t length) {
+    const __m256i bias = _mm256_set1_epi8(CharBias);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    uint32_t i = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; i + 64 <= length; i += 64) {
+      __m256i v0 =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+      __m256i v1 =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32));
+      acc0 = _mm256_add_epi64(acc0,
+                              _mm256_sad_epu8(_mm256_xor_si256(v0, bias), zero));
+      acc1 = _mm256_add_epi64(acc1,
+                              _mm256_sad_epu8(_mm256_xor_si256(v1, bias), zero));
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; i + 32 <= length; i += 32) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+      acc0 = _mm256_add_epi64(acc0,
+                              _mm256_sad_epu8(_mm256_xor_si256(v, bias), zero));
+    }
+    __m256i acc = _mm256_add_epi64(acc0, acc1);
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                                 _mm256_extracti128_si256(acc, 1));
+    if (i + 16 <= length) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      half = _mm_add_epi64(
+          half, _mm_sad_epu8(_mm_xor_si128(v, _mm256_castsi256_si128(bias)),
+                             _mm256_castsi256_si128(zero)));
+      i += 16;
+    }
+    uint64_t sum = static_cast<uint64_t>(_mm_cvtsi128_si64(half)) +
+                   static_cast<uint64_t>(
+                       _mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half)));
+    return finishVectorSum(sum, data + i, length - i, i);
+  }
+
+  //! SSE4.2 implementation of GenerateCRC32C
+  __attribute__((target("sse4.2"))) static uint32_t
+  GenerateCRC32CSSE42(const char *data, uint32_t length) {
+    uint32_t i = 0;
+    uint64_t crc = ~0U;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; i + 8 <= length; i += 8) {
+      uint64_t v = 0;
+      std::memcpy(&v, data + i, sizeof(v));
+      crc = _mm_crc32_u64(crc, v);
+    }
+    auto crc32 = static_cast<uint32_t>(crc);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (; i < length; i++) {
+      crc32 = _mm_crc32_u8(crc32, static_cast<uint8_t>(data[i]));
+    }
+    return ~crc32;
+  }
+#endif
+
+private:
+#ifdef BINFMT_X86_SIMD
+  // Vector loops sum unsigned bytes. Flipping the top bit turns a signed
+  // char c into c + 128, which finishVectorSum subtracts again.
+  static constexpr char CharBias =
+      std::is_signed<char>::value ? static_cast<char>(0x80) : 0;
+
+  static uint32_t finishVectorSum(uint64_t i_u64Sum, const char *i_pTail,
+                                  uint32_t i_u32TailLength,
+                                  uint32_t i_u32VectorLength) {
+    if (CharBias != 0) {
+      i_u64Sum -= static_cast<uint64_t>(i_u32VectorLength) * 128U;
+    }
+    uint32_t r = static_cast<uint32_t>(i_u64Sum) -
+                 GenerateScalar(i_pTail, i_u32TailLength);
+    return -r;
+  }
+#endif
+
+  static GenerateFunction SelectGenerate() {
+#ifdef BINFMT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return &GenerateAVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return &GenerateSSE2;
+    }
+#endif
+    return &GenerateScalar;
+  }
+
+  static GenerateFunction SelectCRC32C() {
+#ifdef BINFMT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+      return &GenerateCRC32CSSE42;
+    }
+#endif
+    return &GenerateCRC32CSoftware;
+  }
 };
 
 //! BinaryFile header structure which should be directly used or inherited from
@@ -112,26 +442,239 @@ struct BinaryFileHeaderBase {
   }
 };
 
-template <typename EntryType> struct BinaryEntryContainer {
-  uint32_t checksum = 0;
+/*!
+ * Header with 64-bit count, offset and maxEntries for files which outgrow
+ * 4G containers' worth of records. Entries are still addressed by uint32_t
+ * physical indices, so a file stores at most 2^32 containers, but byte offsets
+ * are 64-bit whichever header is used.
+ * layout tells it apart from BinaryFileHeaderBase, opening a file written with
+ * the other one fails with ErrorCode::LAYOUT_MISMATCH and leaves it untouched,
+ * see migrateFile.
+ */
+struct BinaryFileHeaderBase64 {
+  static constexpr uint32_t LAYOUT = 0x34364842; // "BH64"
+
+  uint32_t magic{0xBEEF};
+  uint32_t version{0x0001};
+  uint32_t layout{LAYOUT};
+  uint32_t reserved{0};
+  uint64_t maxEntries{0};
+  uint64_t count = 0;
+  uint64_t offset = 0;
+
+  BinaryFileHeaderBase64() = default;
+
+  explicit BinaryFileHeaderBase64(uint32_t magic, uint32_t version,
+                                  uint64_t maxEntries)
+      : magic(magic), version(version), maxEntries(maxEntries) {}
+
+  BinaryFileHeaderBase64(uint32_t magic, uint32_t version, uint64_t count,
+                         uint64_t offset, uint64_t maxEntries)
+      : magic(magic), version(version), maxEntries(maxEntries), count(count),
+        offset(offset) {}
+};
+
+//! Checksum policy for BinaryEntryContainer without a checksum field
+struct NoChecksum {};
+
+//! Checksum policy using Checksum::Generate, the default
+struct AdditiveChecksum {
+  using ValueType = uint32_t;
+  static ValueType Generate(const char *data, uint32_t length) {
+    return Checksum::Generate(data, length);
+  }
+};
+
+//! Checksum policy using Checksum::GenerateCRC32C
+struct CRC32CChecksum {
+  using ValueType = uint32_t;
+  static ValueType Generate(const char *data, uint32_t length) {
+    return Checksum::GenerateCRC32C(data, length);
+  }
+};
+
+//! Checksum policy using Checksum::GenerateHash64
+struct Hash64Checksum {
+  using ValueType = uint64_t;
+  static ValueType Generate(const char *data, uint32_t length) {
+    return Checksum::GenerateHash64(data, length);
+  }
+};
+
+/*!
+ * Stores an entry together with its checksum
+ * @tparam EntryType
+ * @tparam ChecksumPolicy one of NoChecksum, AdditiveChecksum, CRC32CChecksum,
+ * Hash64Checksum or any type providing ValueType and Generate
+ */
+template <typename EntryType, typename ChecksumPolicy = AdditiveChecksum>
+struct BinaryEntryContainer {
+  typename ChecksumPolicy::ValueType checksum = 0;
   EntryType entry;
 
   BinaryEntryContainer() = default;
 
   explicit BinaryEntryContainer(const EntryType &entry)
-      : checksum(Checksum::Generate(
+      : checksum(ChecksumPolicy::Generate(
             (const char *)&entry,
             sizeof(EntryType))), // NOLINT(google-readability-casting)
         entry(entry) {}
 
-  bool isEntryValid() {
-    return Checksum::Generate(
+  [[nodiscard]] bool isEntryValid() const {
+    return ChecksumPolicy::Generate(
                (const char *)&entry,
                sizeof(EntryType)) == // NOLINT(google-readability-casting)
            checksum;
   }
 };
 
+//! Container without checksum, same size as EntryType and never invalid
+template <typename EntryType>
+struct BinaryEntryContainer<EntryType, NoChecksum> {
+  EntryType entry;
+
+  BinaryEntryContainer() = default;
+
+  explicit BinaryEntryContainer(const EntryType &entry) : entry(entry) {}
+
+  [[nodiscard]] bool isEntryValid() const { return true; }
+};
+
+//! Controls when appended records are flushed to stable storage
+enum class DurabilityPolicy {
+  //! fsync after every append call (default)
+  SyncEveryAppend,
+  //! fsync once per groupCommitRecords records or groupCommitInterval,
+  //! done by a background thread; see BinaryFile::waitUntilDurable
+  GroupCommit,
+  //! fdatasync after every append call
+  DataSync,
+  //! never sync on append, leave write back to the OS
+  OSManaged,
+};
+
+//! How a BinaryFile issues appends and batched reads
+enum class IoBackend {
+  //! blocking pread / pwrite / fsync, one system call each (default)
+  Syscalls,
+  //! io_uring with registered file and buffer, writes and their sync are
+  //! linked into one submission. Every call still waits for its submission,
+  //! it saves system calls, it does not make I/O asynchronous. Falls back
+  //! to Syscalls if unavailable.
+  IoUring,
+};
+
+//! How scans and lookups treat the page cache
+enum class ScanMode {
+  //! no access pattern hints (default)
+  Default,
+  //! scans advise SEQUENTIAL / WILLNEED ahead of the cursor and DONTNEED
+  //! behind it, keeping the hot tail cached; lookups advise RANDOM
+  Streaming,
+};
+
+//! Where the header lives in the file
+enum class HeaderSlots {
+  //! one header in front of the containers (default), rewritten in place
+  Single,
+  //! two sector aligned slots, each with a sequence number and a checksum,
+  //! written alternately. A torn write only loses the update in flight.
+  AB,
+};
+
+/*!
+ * Layout of a HeaderSlots::AB slot: the header followed by its sequence,
+ * MAGIC and the CRC32C of everything before it, padded to whole sectors.
+ * The file starts with two of them.
+ * @tparam HeaderType
+ */
+template <typename HeaderType> struct HeaderSlot {
+  static constexpr uint32_t MAGIC = 0x544F4C53; // "SLOT"
+  static constexpr uint32_t BYTES = sizeof(HeaderType) + 16;
+  static constexpr uint32_t SIZE = (BYTES + 511) / 512 * 512;
+
+  static uint32_t getChecksum(const char *i_pSlot) {
+    return Checksum::GenerateCRC32C(i_pSlot, BYTES - 4);
+  }
+
+  static bool isValid(const char *i_pSlot) {
+    uint32_t magic = 0;
+    uint32_t checksum = 0;
+    std::memcpy(&magic, i_pSlot + sizeof(HeaderType) + 8, 4);
+    std::memcpy(&checksum, i_pSlot + sizeof(HeaderType) + 12, 4);
+    return magic == MAGIC && checksum == getChecksum(i_pSlot);
+  }
+
+  /*!
+   * @param o_pSlot BYTES to fill
+   * @param i_Header
+   * @param i_u64Sequence
+   */
+  static void encode(char *o_pSlot, const HeaderType &i_Header,
+                     uint64_t i_u64Sequence) {
+    std::memcpy(o_pSlot, &i_Header, sizeof(HeaderType));
+    std::memcpy(o_pSlot + sizeof(HeaderType), &i_u64Sequence, 8);
+    std::memcpy(o_pSlot + sizeof(HeaderType) + 8, &MAGIC, 4);
+    const uint32_t checksum = getChecksum(o_pSlot);
+    std::memcpy(o_pSlot + sizeof(HeaderType) + 12, &checksum, 4);
+  }
+
+  /*!
+   * @param i_pSlots both slots, 2 * SIZE bytes
+   * @param o_Header header of the valid slot with the higher sequence
+   * @param o_u64Sequence its sequence
+   * @return false if neither slot is valid
+   */
+  static bool decodeNewest(const char *i_pSlots, HeaderType &o_Header,
+                           uint64_t &o_u64Sequence) {
+    bool bFound = false;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < 2; i++) {
+      const char *slot = i_pSlots + i * SIZE;
+      uint64_t sequence = 0;
+      std::memcpy(&sequence, slot + sizeof(HeaderType), 8);
+      if (!isValid(slot) || (bFound && sequence <= o_u64Sequence)) {
+        continue;
+      }
+      std::memcpy(&o_Header, slot, sizeof(HeaderType));
+      o_u64Sequence = sequence;
+      bFound = true;
+    }
+    return bFound;
+  }
+};
+
+//! Optional runtime configuration of a BinaryFile
+struct BinaryFileOptions {
+  DurabilityPolicy durability = DurabilityPolicy::SyncEveryAppend;
+  uint32_t groupCommitRecords = 128;
+  std::chrono::microseconds groupCommitInterval{1000};
+  IoBackend ioBackend = IoBackend::Syscalls;
+  uint32_t ioUringDepth = 64;
+  //! containers built per write when appending a span of entries
+  uint32_t appendScratchEntries = 65536;
+  ScanMode scanMode = ScanMode::Default;
+  //! newest containers a Streaming scan never drops from the page cache
+  uint32_t hotTailEntries = 65536;
+  //! write the header every this many synced records, 0 only writes it on
+  //! close. Opening checks the containers behind the last header written.
+  //! DurabilityPolicy::OSManaged only syncs on flush(), without it nothing
+  //! is checkpointed and opening checks everything since the last close.
+  uint32_t headerCheckpointRecords = 4096;
+  //! has to match the file, it is not converted
+  HeaderSlots headerSlots = HeaderSlots::Single;
+};
+
+//! Outcome of BinaryFile::verify
+struct VerifyResult {
+  //! containers read and checked
+  uint64_t checked = 0;
+  //! physical indices of the containers whose checksum did not match
+  std::vector<uint32_t> invalidIndices;
+
+  [[nodiscard]] bool isValid() const { return invalidIndices.empty(); }
+};
+
 enum class ErrorCode {
   OK = 0,
   OPEN_ERROR,
@@ -141,17 +684,74 @@ enum class ErrorCode {
   WRITE_ERROR,
   SYNC_ERROR,
   TRUNCATE_ERROR,
+  MAP_ERROR,
+  QUEUE_FULL,
+  CLOSED,
+  LAYOUT_MISMATCH,
+  COUNT_OVERFLOW,
+  ENTRY_REMOVED,
+};
+
+/*!
+ * Gets told about every successful append, e.g. to maintain a sidecar index.
+ * Calls are serialized and arrive in record order.
+ * @tparam ContainerType
+ */
+template <typename ContainerType> struct AppendObserver {
+  virtual ~AppendObserver() = default;
+
+  /*!
+   * @param i_u64FirstRecord record number of the first container, the total
+   * number of containers appended before it, its physical index is this
+   * modulo maxEntries
+   * @param i_Containers only valid during the call
+   */
+  virtual void onAppended(uint64_t i_u64FirstRecord,
+                          Span<const ContainerType> i_Containers) = 0;
+
+  //! Every record from i_u64Count on was removed
+  virtual void onTruncated(uint64_t /*i_u64Count*/) {}
+};
+
+/*!
+ * Hides removed containers from the reads of a BinaryFile, see
+ * BinaryFile::setReadFilter. TombstoneMap is one.
+ * @tparam ContainerType
+ */
+template <typename ContainerType> struct ReadFilter {
+  virtual ~ReadFilter() = default;
+
+  //! Containers are not moved until endRead, a read made of several parts
+  //! sees them in one place
+  virtual void beginRead() = 0;
+  virtual void endRead() = 0;
+
+  /*!
+   * Move the containers which were not removed to the front, in order
+   * @param i_u32Index physical index of io_Containers[0]
+   * @param io_Containers
+   * @return number of containers kept
+   */
+  virtual size_t keepLive(uint32_t i_u32Index,
+                          Span<ContainerType> io_Containers) = 0;
+
+  //! @return true if any physical index in
+  //! [i_u32Index, i_u32Index + i_u32Count) was removed
+  virtual bool isAnyRemoved(uint32_t i_u32Index, uint32_t i_u32Count) = 0;
 };
 
 template <typename HeaderType, typename EntryType, typename ContainerType>
 class BinaryFile {
-  const uint32_t m_u32HeaderSize = sizeof(HeaderType);
+  const uint32_t m_u32HeaderSize;
   const uint32_t m_u32EntrySize = sizeof(EntryType);
   const uint32_t m_u32ContainerSize = sizeof(ContainerType);
 
   Path m_Path;
   HeaderType m_ExpectedHeader;
+  // owned by the writer, readers use the snapshot in m_PublishedHeader
   HeaderType m_CurrentHeader;
+  SeqLock<HeaderType> m_PublishedHeader;
+  BinaryFileOptions m_Options;
 #ifndef LOCK_FREE
   std::mutex m_Mutex;
 #endif
@@ -161,7 +761,63 @@ class BinaryFile {
   std::vector<std::string> m_Errors{};
 #endif
 
+  // Records are numbered in append order for this session, starting at 1.
+  // Everything up to m_u64DurableRecords has been synced.
+  std::mutex m_DurabilityMutex;
+  std::condition_variable m_FlushCondition;
+  std::condition_variable m_DurableCondition;
+  uint64_t m_u64WrittenRecords = 0;
+  uint64_t m_u64DurableRecords = 0;
+  bool m_bSyncFailed = false;
+  bool m_bStopFlusher = false;
+  std::chrono::steady_clock::time_point m_FirstPendingTime;
+  std::thread m_Flusher;
+  std::multimap<uint64_t, std::function<void(bool)>> m_DurabilityCallbacks;
+  // Header count known to be on stable storage, checkpoints never claim more.
+  // Record s > m_u64RebaseSequence ends at header count
+  // m_u64RebaseCount + s - m_u64RebaseSequence, both are reset whenever the
+  // count changes without an append. Written with m_DurabilityMutex held.
+  std::atomic<uint64_t> m_u64DurableCount{0};
+  uint64_t m_u64RebaseSequence = 0;
+  uint64_t m_u64RebaseCount = 0;
+
+  // appendConcurrent reserves the records [first, first + n) on
+  // m_u64Reserved and publishes them to m_CurrentHeader in reservation order
+  std::atomic<uint64_t> m_u64Reserved{0};
+  std::atomic<uint64_t> m_u64Published{0};
+  // set once a reservation was not counted, until resetReservations
+  std::atomic<bool> m_bReservationFailed{false};
+
+  // reused by append(Span<const EntryType>) to checksum entries into
+  std::vector<ContainerType> m_ScratchContainers;
+
+  // whole file posix_fadvise advice, shared by every scan and lookup. Scans
+  // keep SEQUENTIAL until the last running one ends, lookups only switch to
+  // RANDOM while no scan runs.
+  std::mutex m_AdviceMutex;
+  uint32_t m_u32ActiveScans = 0;
+  int32_t m_i32FileAdvice = POSIX_FADV_NORMAL;
+
+  std::vector<AppendObserver<ContainerType> *> m_Observers;
+  ReadFilter<ContainerType> *m_pReadFilter = nullptr;
+
+  // count of the header last written to the file
+  uint64_t m_u64CheckpointCount = 0;
+  // sequence of the newest header slot, HeaderSlots::AB only
+  uint64_t m_u64HeaderSequence = 0;
+
+#ifdef BINFMT_IO_URING
+  std::unique_ptr<IoUring> m_pRing;
+  std::mutex m_RingMutex;
+  // registered with the ring, staging area for single container writes
+  std::vector<ContainerType> m_RingBuffer;
+  bool m_bRingBufferRegistered = false;
+  std::vector<int32_t> m_RingResults;
+#endif
+
 protected:
+  [[nodiscard]] int32_t getFileDescriptor() const { return m_Fd; }
+
   void onSysCallError(ErrorCode i_ErrorCode,
                       ErrorCode *o_pErrorCode = nullptr) {
     if (o_pErrorCode != nullptr) {
@@ -176,86 +832,438 @@ protected:
   }
 
   bool sync(ErrorCode *o_pErrorCode) {
-    bool bOk = fsync(m_Fd) == 0;
+    bool bOk = (m_Options.durability == DurabilityPolicy::DataSync
+                    ? fdatasync(m_Fd)
+                    : fsync(m_Fd)) == 0;
     if (!bOk) {
       onSysCallError(ErrorCode::SYNC_ERROR, o_pErrorCode);
     }
     return bOk;
   }
 
-  template <typename DataType>
-  bool writeData(DataType i_Data, uint32_t i_u32ByteOffset,
-                 ErrorCode *o_pErrorCode = nullptr) {
-    bool bOk = pwrite(m_Fd, &i_Data, sizeof(DataType), i_u32ByteOffset) ==
-               sizeof(DataType);
-    bOk ? (void)sync(o_pErrorCode)
-        : onSysCallError(ErrorCode::WRITE_ERROR, o_pErrorCode);
-    return bOk;
-  }
+  /*!
+   * Account for freshly written records and make them durable according to
+   * the configured DurabilityPolicy
+   * @param i_u64Records number of records written by the caller
+   * @param o_pErrorCode
+   * @param i_bSynced the caller already synced the records
+   * @return false if a required sync failed
+   */
+  bool commit(uint64_t i_u64Records, ErrorCode *o_pErrorCode,
+              bool i_bSynced = false, uint64_t *o_pSequence = nullptr) {
+    if (m_Options.durability == DurabilityPolicy::GroupCommit ||
+        m_Options.durability == DurabilityPolicy::OSManaged) {
+      std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+      // the flusher sleeps without a timeout while nothing is pending, wake
+      // it for the first record so the interval starts
+      bool bFirstPending = m_u64WrittenRecords == m_u64DurableRecords;
+      if (bFirstPending) {
+        m_FirstPendingTime = std::chrono::steady_clock::now();
+      }
+      m_u64WrittenRecords += i_u64Records;
+      if (o_pSequence != nullptr) {
+        *o_pSequence = m_u64WrittenRecords;
+      }
+      if (bFirstPending || m_u64WrittenRecords - m_u64DurableRecords >=
+                               m_Options.groupCommitRecords) {
+        m_FlushCondition.notify_one();
+      }
+      return true;
+    }
 
-  template <typename DataType>
-  bool writeVector(std::vector<DataType> i_Data, uint32_t i_u32ByteOffset,
-                   ErrorCode *o_pErrorCode = nullptr) {
-    auto expectedWriteSize = i_Data.size() * sizeof(DataType);
-    bool bOk = pwrite(m_Fd, &i_Data[0], expectedWriteSize, i_u32ByteOffset) ==
-               expectedWriteSize;
-    bOk ? (void)sync(o_pErrorCode) : onSysCallError(ErrorCode::WRITE_ERROR);
+    bool bOk = i_bSynced || sync(o_pErrorCode);
+    std::vector<std::function<void(bool)>> ready;
+    {
+      std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+      m_u64WrittenRecords += i_u64Records;
+      if (o_pSequence != nullptr) {
+        *o_pSequence = m_u64WrittenRecords;
+      }
+      markDurable(m_u64WrittenRecords, bOk, ready);
+    }
+    runDurabilityCallbacks(ready, bOk);
     return bOk;
   }
 
-  bool truncate(uint32_t i_u32Size, ErrorCode *o_pErrorCode = nullptr) {
-    bool bOk = ftruncate(m_Fd, i_u32Size) == 0;
-    bOk ? (void)sync(o_pErrorCode) : onSysCallError(ErrorCode::TRUNCATE_ERROR);
-    return bOk;
+  //! Group commit loop, syncs once enough records are pending or the oldest
+  //! pending record waited for groupCommitInterval
+  void runFlusher() {
+    std::unique_lock<std::mutex> lock(m_DurabilityMutex);
+    std::vector<std::function<void(bool)>> ready;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (!m_bStopFlusher) {
+      if (m_u64WrittenRecords == m_u64DurableRecords) {
+        m_FlushCondition.wait(lock);
+        continue;
+      }
+      m_FlushCondition.wait_until(
+          lock, m_FirstPendingTime + m_Options.groupCommitInterval, [this] {
+            return m_bStopFlusher || m_u64WrittenRecords - m_u64DurableRecords >=
+                                         m_Options.groupCommitRecords;
+          });
+      uint64_t target = m_u64WrittenRecords;
+      lock.unlock();
+      bool bOk = sync(nullptr);
+      lock.lock();
+      markDurable(target, bOk, ready);
+      lock.unlock();
+      runDurabilityCallbacks(ready, bOk);
+      lock.lock();
+    }
   }
 
-  template <typename DataType>
-  bool read(DataType &o_Data, uint32_t i_u32ByteOffset,
-            ErrorCode *o_pErrorCode = nullptr) {
-    bool bOk = pread(m_Fd, &o_Data, sizeof(DataType),
-                     static_cast<off_t>(i_u32ByteOffset)) ==
-               static_cast<ssize_t>(sizeof(DataType));
-    bOk ? (void)sync(o_pErrorCode) : onSysCallError(ErrorCode::READ_ERROR);
-    return bOk;
+  /*!
+   * Must be called with m_DurabilityMutex held. Callbacks which are due are
+   * moved to o_Ready, run them with runDurabilityCallbacks after unlocking.
+   * @param i_u64Records everything up to this sequence was synced
+   * @param i_bSynced false if the sync failed
+   * @param o_Ready
+   */
+  void markDurable(uint64_t i_u64Records, bool i_bSynced,
+                   std::vector<std::function<void(bool)>> &o_Ready) {
+    if (!i_bSynced) {
+      m_bSyncFailed = true;
+    } else if (i_u64Records > m_u64DurableRecords) {
+      m_u64DurableRecords = i_u64Records;
+      // appendConcurrent may commit out of reservation order, but each
+      // committed record was published first and publishing is in order
+      if (i_u64Records > m_u64RebaseSequence) {
+        m_u64DurableCount.store(
+            std::max(m_u64DurableCount.load(std::memory_order_relaxed),
+                     m_u64RebaseCount + i_u64Records - m_u64RebaseSequence),
+            std::memory_order_release);
+      }
+      if (m_u64WrittenRecords > m_u64DurableRecords) {
+        m_FirstPendingTime = std::chrono::steady_clock::now();
+      }
+    }
+    m_DurableCondition.notify_all();
+
+    auto end = i_bSynced
+                   ? m_DurabilityCallbacks.upper_bound(m_u64DurableRecords)
+                   : m_DurabilityCallbacks.end();
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto it = m_DurabilityCallbacks.begin(); it != end; ++it) {
+      o_Ready.emplace_back(std::move(it->second));
+    }
+    m_DurabilityCallbacks.erase(m_DurabilityCallbacks.begin(), end);
   }
 
-  template <typename DataType>
-  bool readVector(std::vector<DataType> &o_Data, uint32_t i_u32ByteOffset,
-                  ErrorCode *o_pErrorCode = nullptr) {
-    auto expectedReadSize = o_Data.size() * sizeof(DataType);
-    bool bOk = pread(m_Fd, &o_Data[0], expectedReadSize, i_u32ByteOffset) ==
-               static_cast<ssize_t>(expectedReadSize);
-    bOk ? (void)sync(o_pErrorCode) : onSysCallError(ErrorCode::READ_ERROR);
-    return bOk;
+  /*!
+   * Records appended from now on are counted from m_CurrentHeader.count.
+   * Call after the count changed without an append.
+   * @param i_u64DurableCount header count which is on stable storage
+   */
+  void rebaseDurableCount(uint64_t i_u64DurableCount) {
+    std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+    m_u64RebaseSequence = m_u64WrittenRecords;
+    m_u64RebaseCount = m_CurrentHeader.count;
+    m_u64DurableCount.store(i_u64DurableCount, std::memory_order_release);
   }
 
-  uint32_t getByteOffsetFromIndex(uint32_t index) {
-    return m_u32HeaderSize + (index * m_u32ContainerSize);
+  //! @return m_CurrentHeader cut back to the records known to be synced
+  HeaderType getDurableHeader() {
+    HeaderType header = m_CurrentHeader;
+    const uint64_t count = std::min<uint64_t>(
+        header.count, m_u64DurableCount.load(std::memory_order_acquire));
+    header.count = static_cast<decltype(header.count)>(count);
+    header.offset = static_cast<decltype(header.offset)>(
+        header.maxEntries == 0 ? count : count % header.maxEntries);
+    return header;
   }
 
-  uint32_t getCurrentByteOffset() {
-    return m_u32HeaderSize + (m_u32ContainerSize * m_CurrentHeader.offset);
+  static void
+  runDurabilityCallbacks(std::vector<std::function<void(bool)>> &io_Ready,
+                         bool i_bSynced) {
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto &callback : io_Ready) {
+      callback(i_bSynced);
+    }
+    io_Ready.clear();
   }
 
-  bool readHeader(ErrorCode *o_pErrorCode = nullptr) {
-#ifndef LOCK_FREE
-    LG(m_Mutex);
-#endif
-    return read<HeaderType>(m_CurrentHeader, 0, o_pErrorCode);
+  //! Stop the group commit thread and sync what it left behind
+  void stopFlusher() {
+    if (!m_Flusher.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+      m_bStopFlusher = true;
+    }
+    m_FlushCondition.notify_one();
+    m_Flusher.join();
+    (void)flush();
   }
 
-  virtual void onVersionOlder(){};
-  virtual void onVersionNewer(){};
+  template <typename DataType>
+  bool writeData(DataType i_Data, uint64_t i_u64ByteOffset,
+                 ErrorCode *o_pErrorCode = nullptr) {
+    bool bOk = pwrite(m_Fd, &i_Data, sizeof(DataType),
+                      static_cast<off_t>(i_u64ByteOffset)) ==
+               static_cast<ssize_t>(sizeof(DataType));
+    if (!bOk) {
+      onSysCallError(ErrorCode::WRITE_ERROR, o_pErrorCode);
+    }
+    return bOk;
+  }
 
-  virtual void onMaxEntriesChanged(){};
+  //! @return true if the DurabilityPolicy syncs inside every append call
+  [[nodiscard]] bool syncOnAppend() const {
+    return m_Options.durability == DurabilityPolicy::SyncEveryAppend ||
+           m_Options.durability == DurabilityPolicy::DataSync;
+  }
 
-  bool checkHeader(ErrorCode *o_pErrorCode = nullptr) {
-#ifndef LOCK_FREE
-    LG(m_Mutex);
+  /*!
+   * Write a single container. With io_uring the sync required by the
+   * DurabilityPolicy is linked to the write and o_pSynced is set.
+   * @param i_Container
+   * @param i_u64ByteOffset
+   * @param o_pSynced set to true if the container was synced as well
+   * @param o_pErrorCode
+   * @return false if the write failed
+   */
+  bool writeContainer(const ContainerType &i_Container,
+                      uint64_t i_u64ByteOffset, bool *o_pSynced,
+                      ErrorCode *o_pErrorCode) {
+#ifdef BINFMT_IO_URING
+    if (m_pRing) {
+      return ringWriteContainer(i_Container, i_u64ByteOffset, o_pSynced,
+                                o_pErrorCode);
+    }
+#endif
+    return writeData(i_Container, i_u64ByteOffset, o_pErrorCode);
+  }
+
+#ifdef BINFMT_IO_URING
+  void setupRing() {
+    m_pRing = std::make_unique<IoUring>(std::max(m_Options.ioUringDepth, 2U));
+    if (!m_pRing->isAvailable()) {
+      m_pRing.reset();
+      return;
+    }
+    (void)m_pRing->registerFile(m_Fd);
+    m_RingBuffer.resize(1);
+    m_bRingBufferRegistered = m_pRing->registerBuffer(
+        m_RingBuffer.data(), m_RingBuffer.size() * sizeof(ContainerType));
+    m_RingResults.resize(m_pRing->getDepth());
+  }
+
+  //! Turn a failed io_uring result into an errno based sys call error
+  void onRingError(int32_t i_i32Result, ErrorCode i_ErrorCode,
+                   ErrorCode *o_pErrorCode) {
+    if (i_i32Result < 0) {
+      errno = -i_i32Result;
+    }
+    onSysCallError(i_ErrorCode, o_pErrorCode);
+  }
+
+  bool ringWriteContainer(const ContainerType &i_Container,
+                          uint64_t i_u64ByteOffset, bool *o_pSynced,
+                          ErrorCode *o_pErrorCode) {
+    std::lock_guard<std::mutex> lock(m_RingMutex);
+    // torn down after a submission could not be waited for
+    if (!m_pRing->isAvailable()) {
+      return writeData(i_Container, i_u64ByteOffset, o_pErrorCode);
+    }
+    const bool bSync = syncOnAppend();
+    m_RingBuffer[0] = i_Container;
+    bool bOk = m_bRingBufferRegistered
+                   ? m_pRing->prepareWriteFixed(m_Fd, m_RingBuffer.data(),
+                                                m_u32ContainerSize,
+                                                i_u64ByteOffset, 0, bSync)
+                   : m_pRing->prepareWrite(m_Fd, m_RingBuffer.data(),
+                                           m_u32ContainerSize,
+                                           i_u64ByteOffset, 0, bSync);
+    if (bSync) {
+      bOk = bOk && m_pRing->prepareFsync(
+                       m_Fd,
+                       m_Options.durability == DurabilityPolicy::DataSync, 1);
+    }
+    if (!bOk || !m_pRing->submitAndWait(m_RingResults.data())) {
+      onSysCallError(ErrorCode::WRITE_ERROR, o_pErrorCode);
+      return false;
+    }
+    if (m_RingResults[0] != static_cast<int32_t>(m_u32ContainerSize)) {
+      onRingError(m_RingResults[0], ErrorCode::WRITE_ERROR, o_pErrorCode);
+      return false;
+    }
+    // a failed linked sync is retried by commit
+    *o_pSynced = bSync && m_RingResults[1] == 0;
+    return true;
+  }
+
+  bool ringReadEntries(const std::vector<uint32_t> &i_Indices,
+                       std::vector<ContainerType> &o_Containers,
+                       ErrorCode *o_pErrorCode) {
+    std::lock_guard<std::mutex> lock(m_RingMutex);
+    if (!m_pRing->isAvailable()) {
+      bool bOk = true;
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = 0; bOk && i < i_Indices.size(); i++) {
+        bOk = read(o_Containers[i], getByteOffsetFromIndex(i_Indices[i]),
+                   o_pErrorCode);
+      }
+      return bOk;
+    }
+    const size_t depth = m_pRing->getDepth();
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (size_t begin = 0; begin < i_Indices.size(); begin += depth) {
+      size_t end = std::min(begin + depth, i_Indices.size());
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = begin; i < end; i++) {
+        (void)m_pRing->prepareRead(m_Fd, &o_Containers[i], m_u32ContainerSize,
+                                   getByteOffsetFromIndex(i_Indices[i]),
+                                   i - begin);
+      }
+      if (!m_pRing->submitAndWait(m_RingResults.data())) {
+        onSysCallError(ErrorCode::READ_ERROR, o_pErrorCode);
+        return false;
+      }
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = 0; i < end - begin; i++) {
+        if (m_RingResults[i] != static_cast<int32_t>(m_u32ContainerSize)) {
+          onRingError(m_RingResults[i], ErrorCode::READ_ERROR, o_pErrorCode);
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+#endif
+
+  bool truncate(uint64_t i_u64Size, ErrorCode *o_pErrorCode = nullptr) {
+    bool bOk = ftruncate(m_Fd, static_cast<off_t>(i_u64Size)) == 0;
+    bOk ? (void)sync(o_pErrorCode) : onSysCallError(ErrorCode::TRUNCATE_ERROR);
+    return bOk;
+  }
+
+  template <typename DataType>
+  bool read(DataType &o_Data, uint64_t i_u64ByteOffset,
+            ErrorCode *o_pErrorCode = nullptr) {
+    bool bOk = pread(m_Fd, &o_Data, sizeof(DataType),
+                     static_cast<off_t>(i_u64ByteOffset)) ==
+               static_cast<ssize_t>(sizeof(DataType));
+    if (!bOk) {
+      onSysCallError(ErrorCode::READ_ERROR, o_pErrorCode);
+    }
+    return bOk;
+  }
+
+  template <typename DataType>
+  bool readSpan(Span<DataType> o_Data, off_t i_ByteOffset,
+                ErrorCode *o_pErrorCode = nullptr) {
+    auto expectedReadSize = static_cast<ssize_t>(o_Data.size_bytes());
+    bool bOk = pread(m_Fd, o_Data.data(), expectedReadSize, i_ByteOffset) ==
+               expectedReadSize;
+    if (!bOk) {
+      onSysCallError(ErrorCode::READ_ERROR, o_pErrorCode);
+    }
+    return bOk;
+  }
+
+  template <typename DataType>
+  bool readVector(std::vector<DataType> &o_Data, uint64_t i_u64ByteOffset,
+                  ErrorCode *o_pErrorCode = nullptr) {
+    return readSpan(Span<DataType>(o_Data.data(), o_Data.size()),
+                    static_cast<off_t>(i_u64ByteOffset), o_pErrorCode);
+  }
+
+  //! Byte offsets are 64-bit whatever the header uses, files pass 4 GiB
+  uint64_t getByteOffsetFromIndex(uint64_t index) {
+    return m_u32HeaderSize + index * m_u32ContainerSize;
+  }
+
+  uint64_t getCurrentByteOffset() {
+    return getByteOffsetFromIndex(m_CurrentHeader.offset);
+  }
+
+  using Slot = HeaderSlot<HeaderType>;
+
+  /*!
+   * Read the header, with HeaderSlots::AB from the valid slot with the higher
+   * sequence. A file which is not empty but has no valid slot, or a file with
+   * header slots opened as HeaderSlots::Single, is ErrorCode::LAYOUT_MISMATCH.
+   * @param o_pErrorCode
+   * @return false if there is no header to use
+   */
+  bool readHeader(ErrorCode *o_pErrorCode = nullptr) {
+#ifndef LOCK_FREE
+    LG(m_Mutex);
+#endif
+    if (m_Options.headerSlots == HeaderSlots::Single) {
+      std::array<char, Slot::BYTES> slot{};
+      if (read(slot, 0) && Slot::isValid(slot.data())) {
+        if (o_pErrorCode != nullptr) {
+          *o_pErrorCode = ErrorCode::LAYOUT_MISMATCH;
+        }
+        return false;
+      }
+      return read<HeaderType>(m_CurrentHeader, 0, o_pErrorCode);
+    }
+
+    std::array<char, 2 * Slot::SIZE> slots{};
+    const ssize_t size = pread(m_Fd, slots.data(), slots.size(), 0);
+    const bool bFound =
+        Slot::decodeNewest(slots.data(), m_CurrentHeader, m_u64HeaderSequence);
+    if (!bFound && o_pErrorCode != nullptr) {
+      *o_pErrorCode = size > 0 ? ErrorCode::LAYOUT_MISMATCH
+                               : ErrorCode::READ_ERROR;
+    }
+    return bFound;
+  }
+
+  /*!
+   * Persist i_Header. With HeaderSlots::AB it goes to the older slot with the
+   * next sequence, in a single write which does not cross a sector.
+   * @param i_Header
+   * @param o_pErrorCode
+   * @return false if the write failed
+   */
+  bool writeHeaderData(const HeaderType &i_Header,
+                       ErrorCode *o_pErrorCode = nullptr) {
+    if (m_Options.headerSlots == HeaderSlots::Single) {
+      return writeData(i_Header, 0, o_pErrorCode);
+    }
+    const uint64_t sequence = m_u64HeaderSequence + 1;
+    std::array<char, Slot::BYTES> slot{};
+    Slot::encode(slot.data(), i_Header, sequence);
+    if (!writeData(slot, (sequence % 2) * Slot::SIZE, o_pErrorCode)) {
+      return false;
+    }
+    m_u64HeaderSequence = sequence;
+    return true;
+  }
+
+  virtual void onVersionOlder(){};
+  virtual void onVersionNewer(){};
+
+  virtual void onMaxEntriesChanged(){};
+
+  bool checkHeader(ErrorCode *o_pErrorCode = nullptr) {
+#ifndef LOCK_FREE
+    LG(m_Mutex);
 #endif
 
     if (m_CurrentHeader.magic != m_ExpectedHeader.magic) {
-      *o_pErrorCode = ErrorCode::MAGIC_MISMATCH;
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::MAGIC_MISMATCH;
+      }
+      return false;
+    }
+
+    // a 32-bit header has maxEntries where a 64-bit one has its layout
+    bool bOtherLayout = false;
+    if constexpr (std::is_base_of_v<BinaryFileHeaderBase64, HeaderType>) {
+      bOtherLayout = m_CurrentHeader.layout != BinaryFileHeaderBase64::LAYOUT;
+    } else {
+      bOtherLayout =
+          m_CurrentHeader.maxEntries == BinaryFileHeaderBase64::LAYOUT;
+    }
+    if (bOtherLayout) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::LAYOUT_MISMATCH;
+      }
       return false;
     }
 
@@ -276,7 +1284,489 @@ protected:
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
-    return writeData(m_ExpectedHeader, 0, o_pErrorCode);
+    // the containers start behind both slots even while one is unused
+    std::error_code error;
+    if (m_Options.headerSlots == HeaderSlots::AB &&
+        std::filesystem::file_size(m_Path, error) < m_u32HeaderSize &&
+        ftruncate(m_Fd, m_u32HeaderSize) != 0) {
+      onSysCallError(ErrorCode::TRUNCATE_ERROR, o_pErrorCode);
+      return false;
+    }
+    return writeHeaderData(m_ExpectedHeader, o_pErrorCode) &&
+           sync(o_pErrorCode);
+  }
+
+  //! Align the concurrent append counters with m_CurrentHeader after it was
+  //! modified by a non-concurrent operation
+  void resetReservations() {
+    publishHeader();
+    m_u64Reserved.store(m_CurrentHeader.count, std::memory_order_relaxed);
+    m_bReservationFailed.store(false, std::memory_order_relaxed);
+    m_u64Published.store(m_CurrentHeader.count, std::memory_order_release);
+  }
+
+  //! Make m_CurrentHeader visible to readers
+  void publishHeader() {
+    m_PublishedHeader.store(m_CurrentHeader);
+    checkpointHeader();
+  }
+
+  /*!
+   * Write the header once headerCheckpointRecords more records were synced
+   * since the last time, or if records were removed. It only counts synced
+   * records, those appended after them are left to recoverTail. It is not
+   * synced on its own but by the next sync of the records. Calls are
+   * serialized by publishHeader.
+   */
+  void checkpointHeader() {
+    if (m_Options.headerCheckpointRecords == 0 || m_Fd < 0) {
+      return;
+    }
+    const HeaderType header = getDurableHeader();
+    const uint64_t count = header.count;
+    if (count >= m_u64CheckpointCount &&
+        count - m_u64CheckpointCount < m_Options.headerCheckpointRecords) {
+      return;
+    }
+    if (writeHeaderData(header)) {
+      m_u64CheckpointCount = count;
+    }
+  }
+
+  /*!
+   * After a crash the header on disk is the last checkpoint. Count the valid
+   * containers behind it, stopping at the first one whose checksum does not
+   * match or which was never written, and cut off the rest of the file. Only
+   * the records appended since the checkpoint are read, so this does not
+   * depend on the file size as long as records are synced. With
+   * DurabilityPolicy::OSManaged and no flush() that is everything appended
+   * since the last close. Containers without a checksum cannot be told from
+   * garbage, nothing behind the checkpoint is kept for them. A wrapped ring
+   * cannot tell new containers from old ones, it keeps the checkpoint.
+   * Adopted containers are synced before they are counted.
+   * @param o_pErrorCode
+   * @return false if reading, truncating or syncing the tail failed
+   */
+  bool recoverTail(ErrorCode *o_pErrorCode) {
+    std::error_code error;
+    const uint64_t fileSize = std::filesystem::file_size(m_Path, error);
+    if (error || isWrapped(m_CurrentHeader) || fileSize < m_u32HeaderSize) {
+      return true;
+    }
+    uint64_t end = (fileSize - m_u32HeaderSize) / m_u32ContainerSize;
+    if (m_CurrentHeader.maxEntries != 0) {
+      end = std::min<uint64_t>(end, m_CurrentHeader.maxEntries);
+    }
+    uint64_t count = std::min<uint64_t>(m_CurrentHeader.count, end);
+    if constexpr (std::is_same_v<ContainerType,
+                                 BinaryEntryContainer<EntryType, NoChecksum>>) {
+      end = count;
+    }
+    const uint64_t checkpointCount = count;
+    std::vector<ContainerType> chunk(std::min<uint64_t>(end - count, 4096));
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (count < end) {
+      Span<ContainerType> containers(
+          chunk.data(), std::min<uint64_t>(chunk.size(), end - count));
+      if (!readSpan(containers,
+                    static_cast<off_t>(getByteOffsetFromIndex(count)),
+                    o_pErrorCode)) {
+        return false;
+      }
+      size_t valid = 0;
+      // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+      while (valid < containers.size() && containers[valid].isEntryValid() &&
+             !isZeroFilled(containers[valid])) {
+        valid++;
+      }
+      count += valid;
+      if (valid < containers.size()) {
+        break;
+      }
+    }
+    m_CurrentHeader.count = count;
+    m_CurrentHeader.offset = m_CurrentHeader.maxEntries == 0
+                                 ? count
+                                 : count % m_CurrentHeader.maxEntries;
+    m_u64CheckpointCount = count;
+    if (getByteOffsetFromIndex(count) < fileSize &&
+        ftruncate(m_Fd, static_cast<off_t>(getByteOffsetFromIndex(count))) !=
+            0) {
+      onSysCallError(ErrorCode::TRUNCATE_ERROR, o_pErrorCode);
+      return false;
+    }
+    return count == checkpointCount || sync(o_pErrorCode);
+  }
+
+  /*!
+   * A hole the file system filled with zeros is only told apart if zeros do
+   * not check out, otherwise e.g. EntryType{} with an additive checksum would
+   * be cut off with everything behind it
+   * @return true if the container was never written
+   */
+  static bool isZeroFilled(const ContainerType &i_Container) {
+    static const bool bZerosAreValid = [] {
+      ContainerType container;
+      std::memset(&container, 0, sizeof(ContainerType));
+      return container.isEntryValid();
+    }();
+    const auto *bytes = reinterpret_cast<const char *>(&i_Container);
+    return !bZerosAreValid &&
+           std::all_of(bytes, bytes + sizeof(ContainerType),
+                       [](char c) { return c == 0; });
+  }
+
+  /*!
+   * Write containers to the slots of the records [i_u64First, i_u64First + n),
+   * wrapping at maxEntries. Issues at most two writes, if more than maxEntries
+   * containers are given only the last maxEntries end up in the file.
+   * @param i_u64First
+   * @param i_Containers
+   * @param o_pErrorCode
+   * @return false if a write failed
+   */
+  bool writeSlots(uint64_t i_u64First, Span<const ContainerType> i_Containers,
+                  ErrorCode *o_pErrorCode) {
+    const uint64_t maxEntries = m_CurrentHeader.maxEntries;
+    if (maxEntries != 0 && i_Containers.size() > maxEntries) {
+      auto skipped = i_Containers.size() - maxEntries;
+      i_u64First += skipped;
+      i_Containers = i_Containers.subspan(skipped, maxEntries);
+    }
+
+    size_t written = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (written < i_Containers.size()) {
+      uint64_t slot = i_u64First + written;
+      size_t run = i_Containers.size() - written;
+      if (maxEntries != 0) {
+        slot %= maxEntries;
+        run = std::min<size_t>(run, maxEntries - slot);
+      }
+      auto expectedWriteSize = static_cast<ssize_t>(run * m_u32ContainerSize);
+      if (pwrite(m_Fd, i_Containers.data() + written, expectedWriteSize,
+                 static_cast<off_t>(m_u32HeaderSize +
+                                    slot * m_u32ContainerSize)) !=
+          expectedWriteSize) {
+        onSysCallError(ErrorCode::WRITE_ERROR, o_pErrorCode);
+        return false;
+      }
+      written += run;
+    }
+    return true;
+  }
+
+  void notifyAppended(uint64_t i_u64First,
+                      Span<const ContainerType> i_Containers) {
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto *observer : m_Observers) {
+      observer->onAppended(i_u64First, i_Containers);
+    }
+  }
+
+  void notifyTruncated(uint64_t i_u64Count) {
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto *observer : m_Observers) {
+      observer->onTruncated(i_u64Count);
+    }
+  }
+
+  /*!
+   * A ring maps the records r and r + maxEntries to the same slot. Wait until
+   * every record which the slots of [i_u64First, i_u64First + i_szCount)
+   * held before is published, so an older record never lands on a newer one.
+   */
+  void waitForPreviousLap(uint64_t i_u64First, size_t i_szCount) {
+    const uint64_t maxEntries = m_CurrentHeader.maxEntries;
+    if (maxEntries == 0 || i_u64First + i_szCount <= maxEntries) {
+      return;
+    }
+    // a batch larger than the ring only writes its newest maxEntries, their
+    // slots last held records before i_u64First
+    const uint64_t previous =
+        std::min(i_u64First, i_u64First + i_szCount - maxEntries);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (m_u64Published.load(std::memory_order_acquire) < previous) {
+      std::this_thread::yield();
+    }
+  }
+
+  /*!
+   * Wait until every earlier reservation is published, then publish ours.
+   * A failed reservation is not counted, and neither is any later one until
+   * resetReservations, so count never covers a slot which was not written.
+   * @return false if the reservation was not counted
+   */
+  bool publishReservation(uint64_t i_u64First,
+                          Span<const ContainerType> i_Containers, bool i_bOk) {
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    while (m_u64Published.load(std::memory_order_acquire) != i_u64First) {
+      std::this_thread::yield();
+    }
+    const uint64_t end = i_u64First + i_Containers.size();
+    const bool bCounted =
+        i_bOk && !m_bReservationFailed.load(std::memory_order_relaxed);
+    if (bCounted) {
+      notifyAppended(i_u64First, i_Containers);
+      m_CurrentHeader.count = end;
+      m_CurrentHeader.offset = m_CurrentHeader.maxEntries == 0
+                                   ? end
+                                   : end % m_CurrentHeader.maxEntries;
+      publishHeader();
+    } else {
+      m_bReservationFailed.store(true, std::memory_order_relaxed);
+    }
+    m_u64Published.store(end, std::memory_order_release);
+    return bCounted;
+  }
+
+  //! Give whole file advice, skipped if it is already in effect. Must be
+  //! called with m_AdviceMutex held.
+  void adviseFile(int32_t i_i32Advice) {
+    if (m_i32FileAdvice != i_i32Advice) {
+      m_i32FileAdvice = i_i32Advice;
+      (void)posix_fadvise(m_Fd, 0, 0, i_i32Advice);
+    }
+  }
+
+  void adviseRange(uint32_t i_u32Begin, uint32_t i_u32Count,
+                   int32_t i_i32Advice) {
+    (void)posix_fadvise(
+        m_Fd, static_cast<off_t>(getByteOffsetFromIndex(i_u32Begin)),
+        static_cast<off_t>(i_u32Count) * m_u32ContainerSize, i_i32Advice);
+  }
+
+  struct PhysicalRun {
+    uint32_t begin;
+    uint32_t count;
+  };
+
+  /*!
+   * Split the physical range [i_u32Begin, i_u32Begin + i_u32Count) into the
+   * at most two parts which do not belong to the hotTailEntries most
+   * recently appended containers
+   * @param i_u32Begin
+   * @param i_u32Count
+   * @param o_Runs
+   * @param o_u32RunCount 0 if the whole range is hot
+   */
+  void getColdRuns(uint32_t i_u32Begin, uint32_t i_u32Count,
+                   std::array<PhysicalRun, 2> &o_Runs,
+                   uint32_t &o_u32RunCount) {
+    const auto header = getHeader();
+    const uint64_t stored =
+        isWrapped(header) ? header.maxEntries : header.count;
+    const uint64_t hot = m_Options.hotTailEntries;
+    o_u32RunCount = 0;
+    if (stored <= hot) {
+      return;
+    }
+    // hot slots [hotEnd - hot, hotEnd), wrapping below 0 for rings
+    uint64_t hotEnd = header.offset;
+    if (hotEnd == 0 && header.maxEntries != 0 && header.count > 0) {
+      hotEnd = header.maxEntries;
+    }
+    std::array<PhysicalRun, 2> cold{};
+    uint32_t coldCount = 0;
+    if (hotEnd >= hot) {
+      cold[coldCount++] = {0, static_cast<uint32_t>(hotEnd - hot)};
+      cold[coldCount++] = {static_cast<uint32_t>(hotEnd),
+                           static_cast<uint32_t>(stored - hotEnd)};
+    } else {
+      cold[coldCount++] = {static_cast<uint32_t>(hotEnd),
+                           static_cast<uint32_t>(stored - hot)};
+    }
+    const uint64_t begin = i_u32Begin;
+    const uint64_t end = begin + i_u32Count;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < coldCount; i++) {
+      const uint64_t runBegin = std::max<uint64_t>(begin, cold[i].begin);
+      const uint64_t runEnd =
+          std::min<uint64_t>(end, cold[i].begin + cold[i].count);
+      if (runBegin < runEnd) {
+        o_Runs[o_u32RunCount++] = {static_cast<uint32_t>(runBegin),
+                                   static_cast<uint32_t>(runEnd - runBegin)};
+      }
+    }
+  }
+
+  static bool isWrapped(const HeaderType &i_Header) {
+    return i_Header.maxEntries != 0 && i_Header.count >= i_Header.maxEntries;
+  }
+
+  static uint32_t getOldestIndex(const HeaderType &i_Header) {
+    return isWrapped(i_Header)
+               ? static_cast<uint32_t>(i_Header.offset % i_Header.maxEntries)
+               : 0;
+  }
+
+  /*!
+   * Map the logical range [i_u32First, i_u32First + i_szCount) to at most
+   * two contiguous physical ranges
+   * @return false if the range is not stored
+   */
+  bool getPhysicalRuns(uint32_t i_u32First, size_t i_szCount,
+                       std::array<PhysicalRun, 2> &o_Runs,
+                       uint32_t &o_u32RunCount) {
+    const auto header = getHeader();
+    const uint64_t stored =
+        isWrapped(header) ? header.maxEntries : header.count;
+    o_u32RunCount = 0;
+    if (i_u32First + static_cast<uint64_t>(i_szCount) > stored) {
+      return false;
+    }
+    if (i_szCount == 0) {
+      return true;
+    }
+    const uint64_t begin = (getOldestIndex(header) + i_u32First) % stored;
+    const uint64_t first = std::min<uint64_t>(i_szCount, stored - begin);
+    o_Runs[o_u32RunCount++] = {static_cast<uint32_t>(begin),
+                               static_cast<uint32_t>(first)};
+    if (first < i_szCount) {
+      o_Runs[o_u32RunCount++] = {0, static_cast<uint32_t>(i_szCount - first)};
+    }
+    return true;
+  }
+
+  //! beginLiveRead / endLiveRead for the lifetime of the scope
+  class LiveReadScope {
+    BinaryFile &m_File;
+
+  public:
+    explicit LiveReadScope(BinaryFile &i_File) : m_File(i_File) {
+      m_File.beginLiveRead();
+    }
+    ~LiveReadScope() { m_File.endLiveRead(); }
+    LiveReadScope(const LiveReadScope &) = delete;
+    LiveReadScope &operator=(const LiveReadScope &) = delete;
+  };
+
+  /*!
+   * Read the logical range [i_u32First, i_u32First + o_Containers.size())
+   * and keep the containers the read filter does not hide at the front
+   * @param o_Containers
+   * @param i_u32First
+   * @param o_szLive number of containers kept
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a read failed
+   */
+  bool getLiveLogicalEntriesInto(Span<ContainerType> o_Containers,
+                                 uint32_t i_u32First, size_t &o_szLive,
+                                 ErrorCode *o_pErrorCode) {
+    std::array<PhysicalRun, 2> runs{};
+    uint32_t runCount = 0;
+    o_szLive = 0;
+    if (!getPhysicalRuns(i_u32First, o_Containers.size(), runs, runCount)) {
+      return false;
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < runCount; i++) {
+      auto run = o_Containers.subspan(o_szLive, runs[i].count);
+      if (!getEntriesInto(run, runs[i].begin, o_pErrorCode)) {
+        return false;
+      }
+      o_szLive += keepLive(runs[i].begin, run);
+    }
+    return true;
+  }
+
+  void adviseLogicalBehind(uint32_t i_u32First, uint32_t i_u32Count) {
+    std::array<PhysicalRun, 2> runs{};
+    uint32_t runCount = 0;
+    if (m_Options.scanMode == ScanMode::Streaming &&
+        getPhysicalRuns(i_u32First, i_u32Count, runs, runCount)) {
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (uint32_t i = 0; i < runCount; i++) {
+        adviseScanBehind(runs[i].begin, runs[i].count);
+      }
+    }
+  }
+
+  /*!
+   * Read [i_u32Begin, i_u32End) in chunks on i_Executor, one job and one
+   * buffer per chunk, and block until all of them ran.
+   * @param i_Executor
+   * @param i_u32Begin
+   * @param i_u32End
+   * @param i_u32ChunkSize
+   * @param i_Prepare called with the number of chunks before any job runs
+   * @param i_Process called concurrently with the chunk number, the index of
+   * its first container and the containers
+   * @param o_pErrorCode
+   * @param i_bLive only pass the containers the read filter does not hide,
+   * the caller has to hold a LiveReadScope
+   * @return false if a read failed, its chunk is not processed
+   */
+  template <typename PrepareFunction, typename ProcessFunction>
+  bool forEachChunk(Executor &i_Executor, uint32_t i_u32Begin,
+                    uint32_t i_u32End, uint32_t i_u32ChunkSize,
+                    PrepareFunction i_Prepare, ProcessFunction i_Process,
+                    ErrorCode *o_pErrorCode, bool i_bLive = false) {
+    i_u32ChunkSize = std::max(i_u32ChunkSize, 1U);
+    i_u32End = std::max(i_u32Begin, i_u32End);
+    const uint32_t chunks =
+        (i_u32End - i_u32Begin + i_u32ChunkSize - 1) / i_u32ChunkSize;
+    i_Prepare(chunks);
+    adviseScanBegin();
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    uint32_t remaining = chunks;
+    ErrorCode error = ErrorCode::OK;
+
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+      i_Executor.post([&, chunk] {
+        uint32_t begin = i_u32Begin + chunk * i_u32ChunkSize;
+        uint32_t count = std::min(i_u32ChunkSize, i_u32End - begin);
+        std::vector<ContainerType> containers(count);
+        ErrorCode r = ErrorCode::OK;
+        bool bOk = getEntriesInto(containers, begin, &r);
+        adviseScanBehind(begin, count);
+        if (bOk) {
+          const size_t live = i_bLive ? keepLive(begin, containers) : count;
+          i_Process(chunk, begin,
+                    Span<const ContainerType>(containers.data(), live));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!bOk) {
+          error = r == ErrorCode::OK ? ErrorCode::READ_ERROR : r;
+        }
+        if (--remaining == 0) {
+          finished.notify_one();
+        }
+      });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&remaining] { return remaining == 0; });
+    adviseScanEnd();
+    if (error != ErrorCode::OK && o_pErrorCode != nullptr) {
+      *o_pErrorCode = error;
+    }
+    return error == ErrorCode::OK;
+  }
+
+  /*!
+   * Write i_Containers at the current offset and advance count / offset.
+   * At most two writes, the second one after wrapping at maxEntries.
+   * @param i_Containers
+   * @param o_pErrorCode
+   * @return false if a write failed
+   */
+  bool writeAtOffset(Span<const ContainerType> i_Containers,
+                     ErrorCode *o_pErrorCode) {
+    if (!writeSlots(m_CurrentHeader.offset, i_Containers, o_pErrorCode)) {
+      return false;
+    }
+    notifyAppended(m_CurrentHeader.count, i_Containers);
+    m_CurrentHeader.count += i_Containers.size();
+    m_CurrentHeader.offset =
+        m_CurrentHeader.maxEntries == 0
+            ? m_CurrentHeader.offset + i_Containers.size()
+            : (m_CurrentHeader.offset + i_Containers.size()) %
+                  m_CurrentHeader.maxEntries;
+    return true;
   }
 
   bool fixHeader(ErrorCode *o_pErrorCode = nullptr) {
@@ -300,27 +1790,175 @@ protected:
     }
 
     if (m_ErrorCode == ErrorCode::OK) {
-      if (!readHeader(&m_ErrorCode) || !checkHeader(&m_ErrorCode)) {
-        (void)fixHeader(&m_ErrorCode);
+      // a short read only means there is no header yet
+      ErrorCode headerError = ErrorCode::OK;
+      if (!readHeader(&headerError) || !checkHeader(&m_ErrorCode)) {
+        if (headerError == ErrorCode::LAYOUT_MISMATCH) {
+          m_ErrorCode = headerError;
+        }
+        if (m_ErrorCode == ErrorCode::LAYOUT_MISMATCH) {
+          // needs migrateFile, overwriting the header would lose the records
+          close(m_Fd);
+          m_Fd = -1;
+        } else {
+          (void)fixHeader(&m_ErrorCode);
+        }
+      } else {
+        (void)recoverTail(&m_ErrorCode);
       }
     }
+
+    rebaseDurableCount(m_CurrentHeader.count);
+    resetReservations();
+
+#ifdef BINFMT_IO_URING
+    if (m_ErrorCode == ErrorCode::OK &&
+        m_Options.ioBackend == IoBackend::IoUring) {
+      setupRing();
+    }
+#endif
+
+    if (m_ErrorCode == ErrorCode::OK &&
+        m_Options.durability == DurabilityPolicy::GroupCommit) {
+      m_Flusher = std::thread(&BinaryFile::runFlusher, this);
+    }
   }
 
 public:
-  BinaryFile(Path i_Path, HeaderType i_Header)
-      : m_Path(std::move(i_Path)), m_ExpectedHeader(i_Header) {
+  BinaryFile(Path i_Path, HeaderType i_Header,
+             BinaryFileOptions i_Options = BinaryFileOptions{})
+      : m_u32HeaderSize(getHeaderSize(i_Options.headerSlots)),
+        m_Path(std::move(i_Path)), m_ExpectedHeader(i_Header),
+        m_Options(i_Options) {
     initialize();
   };
 
+  //! @return bytes in front of the first container
+  static constexpr uint32_t getHeaderSize(HeaderSlots i_HeaderSlots) {
+    return i_HeaderSlots == HeaderSlots::AB ? 2 * Slot::SIZE
+                                            : sizeof(HeaderType);
+  }
+
+  BinaryFile(const BinaryFile &) = delete;
+  BinaryFile &operator=(const BinaryFile &) = delete;
+
   ~BinaryFile() {
+    stopFlusher();
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
-    writeData(m_CurrentHeader, 0, nullptr);
+    if (m_Fd < 0) {
+      return;
+    }
+    // the header must not count records which did not make it to disk
+    const bool bSynced = sync(nullptr);
+    writeHeaderData(bSynced ? m_CurrentHeader : getDurableHeader());
+    (void)sync(nullptr);
     close(m_Fd);
   };
 
-  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+  [[nodiscard]] ErrorCode getErrorCode() const { return m_ErrorCode; }
+
+  [[nodiscard]] const BinaryFileOptions &getOptions() const {
+    return m_Options;
+  }
+
+  //! @return true if I/O goes through io_uring
+  [[nodiscard]] bool isIoUringActive() const {
+#ifdef BINFMT_IO_URING
+    return m_pRing != nullptr && m_pRing->isAvailable();
+#else
+    return false;
+#endif
+  }
+
+  /*!
+   * Number of records appended during this session. Record n (1-based) is
+   * durable once getDurableSequence() >= n.
+   * @return sequence of the last appended record
+   */
+  uint64_t getAppendSequence() {
+    std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+    return m_u64WrittenRecords;
+  }
+
+  //! @return sequence of the last record known to be on stable storage
+  uint64_t getDurableSequence() {
+    std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+    return m_u64DurableRecords;
+  }
+
+  /*!
+   * Sync everything appended so far, regardless of the DurabilityPolicy
+   * @param o_pErrorCode
+   * @return false if the sync failed
+   */
+  bool flush(ErrorCode *o_pErrorCode = nullptr) {
+    uint64_t target = getAppendSequence();
+    bool bOk = sync(o_pErrorCode);
+    std::vector<std::function<void(bool)>> ready;
+    {
+      std::lock_guard<std::mutex> lock(m_DurabilityMutex);
+      markDurable(target, bOk, ready);
+    }
+    runDurabilityCallbacks(ready, bOk);
+    return bOk;
+  }
+
+  /*!
+   * Non-blocking counterpart of waitUntilDurable. i_Callback runs once the
+   * record with the given sequence is durable, on the group commit thread or
+   * right away on the calling thread. Any other policy syncs immediately if
+   * the record is not durable yet.
+   * @param i_u64Sequence as returned by getAppendSequence()
+   * @param i_Callback receives false if a sync failed
+   */
+  void notifyWhenDurable(uint64_t i_u64Sequence,
+                         std::function<void(bool)> i_Callback) {
+    std::unique_lock<std::mutex> lock(m_DurabilityMutex);
+    if (m_u64DurableRecords >= i_u64Sequence || m_bSyncFailed) {
+      bool bOk = m_u64DurableRecords >= i_u64Sequence;
+      lock.unlock();
+      i_Callback(bOk);
+      return;
+    }
+    if (!m_Flusher.joinable()) {
+      lock.unlock();
+      i_Callback(flush());
+      return;
+    }
+    m_DurabilityCallbacks.emplace(i_u64Sequence, std::move(i_Callback));
+  }
+
+  /*!
+   * Block until the record with the given sequence is durable.
+   * With GroupCommit this waits for the background flush, any other policy
+   * syncs right away if the record is not durable yet.
+   * @param i_u64Sequence as returned by getAppendSequence()
+   * @param o_pErrorCode
+   * @return false if a sync failed
+   */
+  bool waitUntilDurable(uint64_t i_u64Sequence,
+                        ErrorCode *o_pErrorCode = nullptr) {
+    std::unique_lock<std::mutex> lock(m_DurabilityMutex);
+    if (!m_Flusher.joinable()) {
+      if (m_u64DurableRecords >= i_u64Sequence) {
+        return true;
+      }
+      lock.unlock();
+      return flush(o_pErrorCode);
+    }
+    m_DurableCondition.wait(lock, [this, i_u64Sequence] {
+      return m_u64DurableRecords >= i_u64Sequence || m_bSyncFailed;
+    });
+    if (m_u64DurableRecords < i_u64Sequence) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::SYNC_ERROR;
+      }
+      return false;
+    }
+    return true;
+  }
 
   virtual void beforeAppend(ContainerType /*i_Container*/) {
     if (m_CurrentHeader.maxEntries == 0) {
@@ -333,14 +1971,17 @@ public:
   };
 
   virtual void beforeAppend(const std::vector<ContainerType> &i_Containers){};
+  virtual void beforeAppend(Span<const ContainerType> /*i_Containers*/){};
 
   virtual void onAppendSuccess(ContainerType /*i_Container*/){};
   virtual void
   onAppendSuccess(const std::vector<ContainerType> & /*i_Containers*/){};
+  virtual void onAppendSuccess(Span<const ContainerType> /*i_Containers*/){};
 
   virtual void onAppendFailure(ContainerType i_Container){};
   virtual void
   onAppendFailure(const std::vector<ContainerType> &i_Containers){};
+  virtual void onAppendFailure(Span<const ContainerType> /*i_Containers*/){};
 
   ErrorCode append(ContainerType i_Container) {
 #ifndef LOCK_FREE
@@ -351,10 +1992,14 @@ public:
 
     ErrorCode r = ErrorCode::OK;
 
-    if (writeData<ContainerType>(i_Container, getCurrentByteOffset(), &r)) {
-      (void)sync(&r);
+    bool bSynced = false;
+    if (writeContainer(i_Container, getCurrentByteOffset(), &bSynced, &r)) {
+      notifyAppended(m_CurrentHeader.count,
+                     Span<const ContainerType>(&i_Container, 1));
       m_CurrentHeader.offset++;
       m_CurrentHeader.count++;
+      (void)commit(1, &r, bSynced);
+      resetReservations();
       onAppendSuccess(i_Container);
     } else {
       onAppendFailure(i_Container);
@@ -363,40 +2008,35 @@ public:
     return r;
   }
 
-  bool _append(std::vector<ContainerType> &i_Containers,
-               ErrorCode *o_pErrorCode = nullptr) {
-    bool r = false;
+  ErrorCode append(std::vector<ContainerType> &i_Containers) {
+    ErrorCode r = ErrorCode::OK;
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
 
-    if (m_CurrentHeader.offset + i_Containers.size() >
-            m_CurrentHeader.maxEntries &&
-        m_CurrentHeader.maxEntries != 0) {
-      auto writeableEntries =
-          m_CurrentHeader.maxEntries - m_CurrentHeader.offset;
-      auto entriesToWrite = std::vector<ContainerType>(
-          i_Containers.begin(), i_Containers.begin() + writeableEntries);
-      if (writeVector(entriesToWrite, getCurrentByteOffset(), o_pErrorCode)) {
-        m_CurrentHeader.offset = 0;
-        m_CurrentHeader.count += writeableEntries;
-        i_Containers = std::vector<ContainerType>(
-            i_Containers.begin() + writeableEntries, i_Containers.end());
-        r = _append(i_Containers, o_pErrorCode);
-      }
+    beforeAppend(i_Containers);
+
+    bool bOk = writeAtOffset(i_Containers, &r);
+    if (bOk) {
+      (void)commit(i_Containers.size(), &r);
+    }
+    resetReservations();
+    if (bOk) {
+      onAppendSuccess(i_Containers);
     } else {
-      if (writeVector(i_Containers, getCurrentByteOffset(), o_pErrorCode)) {
-        (i_Containers.size() == m_CurrentHeader.maxEntries)
-            ? m_CurrentHeader.offset = 0
-            : m_CurrentHeader.offset += i_Containers.size();
-        m_CurrentHeader.count += i_Containers.size();
-      }
+      onAppendFailure(i_Containers);
     }
 
     return r;
   }
 
-  ErrorCode append(std::vector<ContainerType> &i_Containers) {
+  /*!
+   * Append a batch without copying it. Issues at most two writes, the second
+   * one only if the batch wraps at maxEntries, and syncs once.
+   * @param i_Containers
+   * @return ErrorCode::OK or the error of the failed write / sync
+   */
+  ErrorCode append(Span<const ContainerType> i_Containers) {
     ErrorCode r = ErrorCode::OK;
 #ifndef LOCK_FREE
     LG(m_Mutex);
@@ -404,7 +2044,12 @@ public:
 
     beforeAppend(i_Containers);
 
-    if (_append(i_Containers, &r)) {
+    bool bOk = writeAtOffset(i_Containers, &r);
+    if (bOk) {
+      (void)commit(i_Containers.size(), &r);
+    }
+    resetReservations();
+    if (bOk) {
       onAppendSuccess(i_Containers);
     } else {
       onAppendFailure(i_Containers);
@@ -418,98 +2063,647 @@ public:
     return append(container);
   }
 
+  /*!
+   * Append a batch of entries. The containers are built in a buffer which is
+   * reused across calls, so after the first call this does not allocate.
+   * Batches larger than appendScratchEntries are written in pieces, the sync
+   * happens once at the end.
+   * @param i_Entries
+   * @return ErrorCode::OK or the error of the failed write / sync
+   */
+  ErrorCode append(Span<const EntryType> i_Entries) {
+    ErrorCode r = ErrorCode::OK;
+#ifndef LOCK_FREE
+    LG(m_Mutex);
+#endif
+
+    const size_t scratchSize = std::min<size_t>(
+        i_Entries.size(), std::max(m_Options.appendScratchEntries, 1U));
+    if (m_ScratchContainers.size() < scratchSize) {
+      m_ScratchContainers.resize(scratchSize);
+    }
+
+    size_t written = 0;
+    bool bOk = true;
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    while (bOk && written < i_Entries.size()) {
+      size_t count = std::min(scratchSize, i_Entries.size() - written);
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = 0; i < count; i++) {
+        m_ScratchContainers[i] = ContainerType(i_Entries[written + i]);
+      }
+      Span<const ContainerType> containers(m_ScratchContainers.data(), count);
+      beforeAppend(containers);
+      bOk = writeAtOffset(containers, &r);
+      if (bOk) {
+        written += count;
+        onAppendSuccess(containers);
+      } else {
+        onAppendFailure(containers);
+      }
+    }
+    if (written > 0) {
+      (void)commit(written, &r);
+    }
+    resetReservations();
+
+    return r;
+  }
+
   ErrorCode append(const std::vector<EntryType> &i_Entries) {
-    std::vector<ContainerType> containers;
-    // NOLINTNEXTLINE(altera-unroll-loops)
-    for (auto &entry : i_Entries) {
-      containers.template emplace_back(ContainerType(entry));
+    return append(Span<const EntryType>(i_Entries.data(), i_Entries.size()));
+  }
+
+  /*!
+   * Append from any number of threads at once. Each call reserves its slots
+   * with an atomic fetch-add, writes them in parallel with other callers and
+   * then publishes count / offset in reservation order.
+   * Must not run at the same time as the other append / remove functions,
+   * virtual append hooks are not called.
+   * Once a write failed, this and every later call fails without being
+   * counted, until append, clear or removeEntriesAtEnd realign the file.
+   * @param i_Containers
+   * @param o_pSequence receives the sequence to pass to waitUntilDurable /
+   * notifyWhenDurable for these containers
+   * @return ErrorCode::OK, the error of the failed write / sync,
+   * ErrorCode::WRITE_ERROR after an earlier write failed or
+   * ErrorCode::COUNT_OVERFLOW if the header cannot count that many records
+   */
+  ErrorCode appendConcurrent(Span<const ContainerType> i_Containers,
+                             uint64_t *o_pSequence = nullptr) {
+    ErrorCode r = ErrorCode::OK;
+    if (i_Containers.empty()) {
+      return r;
+    }
+    if (m_bReservationFailed.load(std::memory_order_relaxed)) {
+      return ErrorCode::WRITE_ERROR;
+    }
+
+    uint64_t first =
+        m_u64Reserved.fetch_add(i_Containers.size(), std::memory_order_relaxed);
+    bool bOk = first + i_Containers.size() <=
+               std::numeric_limits<decltype(HeaderType::count)>::max();
+    if (bOk) {
+      waitForPreviousLap(first, i_Containers.size());
+      bOk = writeSlots(first, i_Containers, &r);
+    } else {
+      r = ErrorCode::COUNT_OVERFLOW;
+    }
+    if (!publishReservation(first, i_Containers, bOk)) {
+      return r == ErrorCode::OK ? ErrorCode::WRITE_ERROR : r;
     }
-    return append(containers);
+    (void)commit(i_Containers.size(), &r, false, o_pSequence);
+    return r;
+  }
+
+  ErrorCode appendConcurrent(const ContainerType &i_Container,
+                             uint64_t *o_pSequence = nullptr) {
+    return appendConcurrent(Span<const ContainerType>(&i_Container, 1),
+                            o_pSequence);
+  }
+
+  ErrorCode appendConcurrent(const EntryType &i_Entry,
+                             uint64_t *o_pSequence = nullptr) {
+    ContainerType container(i_Entry);
+    return appendConcurrent(container, o_pSequence);
   }
 
-  uint32_t getEntryCountFromFileSize() {
+  uint64_t getEntryCountFromFileSize() {
     return (getFileSize() - m_u32HeaderSize) / m_u32ContainerSize;
   }
 
-  uint32_t getEntryCount() { return m_CurrentHeader.count; }
+  //! @return number of containers ever appended, see BinaryFileHeaderBase64
+  uint64_t getEntryCount() { return getHeader().count; }
+
+  //! Number of entries physically present, count is capped by maxEntries
+  uint32_t getStoredEntryCount() {
+    auto header = getHeader();
+    if (header.maxEntries != 0 && header.count > header.maxEntries) {
+      return static_cast<uint32_t>(header.maxEntries);
+    }
+    return static_cast<uint32_t>(header.count);
+  }
+
+  //! @return physical index of the oldest stored container
+  uint32_t getOldestIndex() { return getOldestIndex(getHeader()); }
+
+  //! @return physical index of the container i_u32Logical positions after
+  //! the oldest one
+  uint32_t getPhysicalIndex(uint32_t i_u32Logical) {
+    const auto header = getHeader();
+    if (!isWrapped(header)) {
+      return i_u32Logical;
+    }
+    return static_cast<uint32_t>(
+        (getOldestIndex(header) + static_cast<uint64_t>(i_u32Logical)) %
+        header.maxEntries);
+  }
+
+  /*!
+   * Read o_Containers.size() containers in oldest to newest order, starting
+   * i_u32First positions after the oldest one. A range crossing the end of a
+   * wrapped ring costs two reads, anything else one. Positional, containers
+   * hidden by the read filter are read as well.
+   * @param o_Containers
+   * @param i_u32First
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a read failed
+   */
+  bool getLogicalEntriesInto(Span<ContainerType> o_Containers,
+                             uint32_t i_u32First,
+                             ErrorCode *o_pErrorCode = nullptr) {
+    std::array<PhysicalRun, 2> runs{};
+    uint32_t runCount = 0;
+    if (!getPhysicalRuns(i_u32First, o_Containers.size(), runs, runCount)) {
+      return false;
+    }
+    size_t done = 0;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < runCount; i++) {
+      if (!getEntriesInto(o_Containers.subspan(done, runs[i].count),
+                          runs[i].begin, o_pErrorCode)) {
+        return false;
+      }
+      done += runs[i].count;
+    }
+    return true;
+  }
+
+  /*!
+   * Read the logical range [i_u32First, i_u32First + i_u32Count) in oldest
+   * to newest order, without the containers the read filter hides
+   * @param o_Containers
+   * @param i_u32First logical index, 0 is the oldest stored container
+   * @param i_u32Count
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a read failed
+   */
+  bool getLogicalEntries(std::vector<ContainerType> &o_Containers,
+                         uint32_t i_u32First, uint32_t i_u32Count,
+                         ErrorCode *o_pErrorCode = nullptr) {
+    o_Containers.resize(i_u32Count);
+    size_t live = 0;
+    LiveReadScope scope(*this);
+    const bool bOk = getLiveLogicalEntriesInto(o_Containers, i_u32First, live,
+                                               o_pErrorCode);
+    o_Containers.resize(live);
+    return bOk;
+  }
+
+  /*!
+   * Walk the stored containers from oldest to newest in chunks, reusing one
+   * buffer. Containers hidden by the read filter are left out, chunks with
+   * nothing left are skipped, and none of them move until the walk is done.
+   * @param i_Callback
+   * @param i_u32First logical index to start at
+   * @param i_u32Count 0 means up to the newest container
+   * @param i_u32ChunkSize
+   * @param o_pErrorCode
+   * @return false if the range is not stored or a read failed
+   */
+  bool getLogicalEntriesChunked(
+      const std::function<void(Span<const ContainerType>)> &i_Callback,
+      uint32_t i_u32First = 0, uint32_t i_u32Count = 0,
+      uint32_t i_u32ChunkSize = 100000, ErrorCode *o_pErrorCode = nullptr) {
+    const uint32_t stored = getStoredEntryCount();
+    if (i_u32Count == 0) {
+      i_u32Count = i_u32First < stored ? stored - i_u32First : 0;
+    }
+    i_u32ChunkSize = std::max(i_u32ChunkSize, 1U);
+    std::vector<ContainerType> tmp(std::min(i_u32ChunkSize, i_u32Count));
+
+    bool bOk = true;
+    LiveReadScope scope(*this);
+    adviseScanBegin();
+    // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+    for (uint32_t done = 0; bOk && done < i_u32Count;) {
+      uint32_t count = std::min(i_u32ChunkSize, i_u32Count - done);
+      size_t live = 0;
+      bOk = getLiveLogicalEntriesInto(Span<ContainerType>(tmp.data(), count),
+                                      i_u32First + done, live, o_pErrorCode);
+      if (bOk) {
+        adviseLogicalBehind(i_u32First + done, count);
+        if (live > 0) {
+          i_Callback(Span<const ContainerType>(tmp.data(), live));
+        }
+        done += count;
+      }
+    }
+    adviseScanEnd();
+    return bOk;
+  }
+
+  /*!
+   * Read o_Containers.size() containers starting at physical index
+   * i_u32Index into caller owned memory. Safe to call from several threads.
+   * Positional, containers hidden by the read filter are read as well, see
+   * keepLive.
+   * @param o_Containers
+   * @param i_u32Index
+   * @param o_pErrorCode
+   * @return false if the read failed
+   */
+  bool getEntriesInto(Span<ContainerType> o_Containers, uint32_t i_u32Index,
+                      ErrorCode *o_pErrorCode = nullptr) {
+    return readSpan(o_Containers,
+                    static_cast<off_t>(m_u32HeaderSize) +
+                        static_cast<off_t>(i_u32Index) * m_u32ContainerSize,
+                    o_pErrorCode);
+  }
+
+  //! Keep the read filter from moving containers until endLiveRead, for a
+  //! read made of several parts. Does not nest, no-op without a filter.
+  void beginLiveRead() {
+    if (m_pReadFilter != nullptr) {
+      m_pReadFilter->beginRead();
+    }
+  }
+
+  void endLiveRead() {
+    if (m_pReadFilter != nullptr) {
+      m_pReadFilter->endRead();
+    }
+  }
+
+  /*!
+   * Drop the containers the read filter hides
+   * @param i_u32Index physical index of io_Containers[0], the range must not
+   * wrap
+   * @param io_Containers
+   * @return number of containers left at the front of io_Containers
+   */
+  size_t keepLive(uint32_t i_u32Index, Span<ContainerType> io_Containers) {
+    return m_pReadFilter == nullptr
+               ? io_Containers.size()
+               : m_pReadFilter->keepLive(i_u32Index, io_Containers);
+  }
+
+  //! @return true if the read filter hides any physical index in
+  //! [i_u32Index, i_u32Index + i_u32Count)
+  bool isAnyRemoved(uint32_t i_u32Index, uint32_t i_u32Count) {
+    return m_pReadFilter != nullptr &&
+           m_pReadFilter->isAnyRemoved(i_u32Index, i_u32Count);
+  }
+
+  //! Scan hints, no-ops unless BinaryFileOptions::scanMode is Streaming.
+  //! Call adviseScanBegin once before a scan and adviseScanEnd after it.
+  void adviseScanBegin() {
+    if (m_Options.scanMode == ScanMode::Streaming) {
+      std::lock_guard<std::mutex> lock(m_AdviceMutex);
+      m_u32ActiveScans++;
+      adviseFile(POSIX_FADV_SEQUENTIAL);
+    }
+  }
+
+  //! Prefetch the chunk the scan reads next
+  void adviseScanAhead(uint32_t i_u32Begin, uint32_t i_u32Count) {
+    if (m_Options.scanMode == ScanMode::Streaming && i_u32Count > 0) {
+      adviseRange(i_u32Begin, i_u32Count, POSIX_FADV_WILLNEED);
+    }
+  }
+
+  //! Drop a chunk the scan already copied out, except for its part in the
+  //! hot tail
+  void adviseScanBehind(uint32_t i_u32Begin, uint32_t i_u32Count) {
+    if (m_Options.scanMode != ScanMode::Streaming || i_u32Count == 0) {
+      return;
+    }
+    std::array<PhysicalRun, 2> runs{};
+    uint32_t runCount = 0;
+    getColdRuns(i_u32Begin, i_u32Count, runs, runCount);
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 0; i < runCount; i++) {
+      adviseRange(runs[i].begin, runs[i].count, POSIX_FADV_DONTNEED);
+    }
+  }
+
+  //! Back to NORMAL once no other scan is running
+  void adviseScanEnd() {
+    if (m_Options.scanMode == ScanMode::Streaming) {
+      std::lock_guard<std::mutex> lock(m_AdviceMutex);
+      if (m_u32ActiveScans > 0 && --m_u32ActiveScans == 0) {
+        adviseFile(POSIX_FADV_NORMAL);
+      }
+    }
+  }
+
+  //! Called by the point lookups, turns off readahead in Streaming mode
+  //! while no scan is running
+  void adviseLookup() {
+    if (m_Options.scanMode == ScanMode::Streaming) {
+      std::lock_guard<std::mutex> lock(m_AdviceMutex);
+      if (m_u32ActiveScans == 0) {
+        adviseFile(POSIX_FADV_RANDOM);
+      }
+    }
+  }
+
+  /*!
+   * Read every stored container on i_Executor, i_u32ChunkSize containers
+   * per job, and check their checksums. Blocks until all jobs finished.
+   * Containers hidden by the read filter are checked as well.
+   * @param o_Result
+   * @param i_Executor
+   * @param i_u32ChunkSize
+   * @param o_pErrorCode
+   * @return false if a read failed, o_Result then only covers the chunks
+   * which could be read
+   */
+  bool verify(VerifyResult &o_Result, Executor &i_Executor,
+              uint32_t i_u32ChunkSize = 65536,
+              ErrorCode *o_pErrorCode = nullptr) {
+    std::vector<std::vector<uint32_t>> invalid;
+    std::atomic<uint64_t> checked{0};
+    bool bOk = forEachChunk(
+        i_Executor, 0, getStoredEntryCount(), i_u32ChunkSize,
+        [&invalid](uint32_t i_u32Chunks) { invalid.resize(i_u32Chunks); },
+        [&invalid, &checked](uint32_t i_u32Chunk, uint32_t i_u32Begin,
+                             Span<const ContainerType> i_Containers) {
+          // NOLINTNEXTLINE(altera-unroll-loops)
+          for (uint32_t i = 0; i < i_Containers.size(); i++) {
+            if (!i_Containers[i].isEntryValid()) {
+              invalid[i_u32Chunk].push_back(i_u32Begin + i);
+            }
+          }
+          checked += i_Containers.size();
+        },
+        o_pErrorCode);
+
+    o_Result = VerifyResult{};
+    o_Result.checked = checked;
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (const auto &indices : invalid) {
+      o_Result.invalidIndices.insert(o_Result.invalidIndices.end(),
+                                     indices.begin(), indices.end());
+    }
+    return bOk;
+  }
+
+  /*!
+   * Same as above on a temporary ThreadPool
+   * @param o_Result
+   * @param i_u32ThreadCount defaults to std::thread::hardware_concurrency
+   * @param i_u32ChunkSize
+   * @param o_pErrorCode
+   * @return false if a read failed
+   */
+  bool verify(VerifyResult &o_Result, uint32_t i_u32ThreadCount = 0,
+              uint32_t i_u32ChunkSize = 65536,
+              ErrorCode *o_pErrorCode = nullptr) {
+    ThreadPool pool(i_u32ThreadCount);
+    return verify(o_Result, pool, i_u32ChunkSize, o_pErrorCode);
+  }
+
+  /*!
+   * Parallel scan of the physical range [i_u32Begin, i_u32End). Every chunk
+   * is read and mapped on i_Executor, the partial results are then folded
+   * into io_Result in chunk order on the calling thread. i_Map does not get
+   * the containers the read filter hides, a chunk may end up empty.
+   * @tparam ResultType
+   * @tparam MapFunction ResultType(Span<const ContainerType>)
+   * @tparam ReduceFunction ResultType(ResultType, ResultType)
+   * @param io_Result initial value of the fold, receives the result
+   * @param i_Map
+   * @param i_Reduce
+   * @param i_Executor
+   * @param i_u32Begin
+   * @param i_u32End 0 means up to the stored entry count
+   * @param i_u32ChunkSize
+   * @param o_pErrorCode
+   * @return false if a read failed, io_Result is left untouched then
+   */
+  template <typename ResultType, typename MapFunction, typename ReduceFunction>
+  bool mapReduce(ResultType &io_Result, MapFunction i_Map,
+                 ReduceFunction i_Reduce, Executor &i_Executor,
+                 uint32_t i_u32Begin = 0, uint32_t i_u32End = 0,
+                 uint32_t i_u32ChunkSize = 65536,
+                 ErrorCode *o_pErrorCode = nullptr) {
+    if (i_u32End == 0) {
+      i_u32End = getStoredEntryCount();
+    }
+    std::vector<std::optional<ResultType>> partials;
+    LiveReadScope scope(*this);
+    if (!forEachChunk(
+            i_Executor, i_u32Begin, i_u32End, i_u32ChunkSize,
+            [&partials](uint32_t i_u32Chunks) { partials.resize(i_u32Chunks); },
+            [&partials, &i_Map](uint32_t i_u32Chunk, uint32_t /*i_u32Begin*/,
+                                Span<const ContainerType> i_Containers) {
+              partials[i_u32Chunk].emplace(i_Map(i_Containers));
+            },
+            o_pErrorCode, true)) {
+      return false;
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (auto &partial : partials) {
+      io_Result = i_Reduce(std::move(io_Result), std::move(*partial));
+    }
+    return true;
+  }
+
+  //! Same as above on a temporary ThreadPool with one thread per core
+  template <typename ResultType, typename MapFunction, typename ReduceFunction>
+  bool mapReduce(ResultType &io_Result, MapFunction i_Map,
+                 ReduceFunction i_Reduce, uint32_t i_u32Begin = 0,
+                 uint32_t i_u32End = 0, uint32_t i_u32ChunkSize = 65536,
+                 ErrorCode *o_pErrorCode = nullptr) {
+    ThreadPool pool;
+    return mapReduce(io_Result, std::move(i_Map), std::move(i_Reduce), pool,
+                     i_u32Begin, i_u32End, i_u32ChunkSize, o_pErrorCode);
+  }
 
+  //! The physical range [i_u32Start, i_u32End) without the containers the
+  //! read filter hides
   bool getEntriesFromTo(std::vector<ContainerType> &o_Containers,
                         uint32_t i_u32Start, uint32_t i_u32End,
                         ErrorCode *o_pErrorCode = nullptr) {
-#ifndef LOCK_FREE
-    LG(m_Mutex);
-#endif
     o_Containers.resize(i_u32End - i_u32Start);
-    return readVector(o_Containers, getByteOffsetFromIndex(i_u32Start),
-                      o_pErrorCode);
+    LiveReadScope scope(*this);
+    if (!readVector(o_Containers, getByteOffsetFromIndex(i_u32Start),
+                    o_pErrorCode)) {
+      return false;
+    }
+    o_Containers.resize(keepLive(i_u32Start, o_Containers));
+    return true;
   }
 
+  /*!
+   * @param i_u32Index physical index
+   * @param o_Container
+   * @param o_pErrorCode ErrorCode::ENTRY_REMOVED if the read filter hides it
+   * @return false if the read failed or the container is hidden
+   */
   bool getEntry(uint32_t i_u32Index, ContainerType &o_Container,
                 ErrorCode *o_pErrorCode = nullptr) {
-#ifndef LOCK_FREE
-    LG(m_Mutex);
+    adviseLookup();
+    LiveReadScope scope(*this);
+    if (!read(o_Container, getByteOffsetFromIndex(i_u32Index), o_pErrorCode)) {
+      return false;
+    }
+    if (keepLive(i_u32Index, Span<ContainerType>(&o_Container, 1)) == 0) {
+      if (o_pErrorCode != nullptr) {
+        *o_pErrorCode = ErrorCode::ENTRY_REMOVED;
+      }
+      return false;
+    }
+    return true;
+  }
+
+  /*!
+   * Read the containers at arbitrary physical indices. With the io_uring
+   * backend every batch of up to ioUringDepth reads costs one system call.
+   * @param i_Indices
+   * @param o_Containers resized to i_Indices.size()
+   * @param o_pErrorCode ErrorCode::ENTRY_REMOVED if the read filter hides
+   * any of them
+   * @return false if any read failed or any container is hidden
+   */
+  bool getEntries(const std::vector<uint32_t> &i_Indices,
+                  std::vector<ContainerType> &o_Containers,
+                  ErrorCode *o_pErrorCode = nullptr) {
+    o_Containers.resize(i_Indices.size());
+    adviseLookup();
+    LiveReadScope scope(*this);
+    bool bOk = true;
+#ifdef BINFMT_IO_URING
+    if (m_pRing) {
+      bOk = ringReadEntries(i_Indices, o_Containers, o_pErrorCode);
+    } else
 #endif
-    return read(o_Container, getByteOffsetFromIndex(i_u32Index), o_pErrorCode);
+    {
+      // NOLINTNEXTLINE(altera-unroll-loops)
+      for (size_t i = 0; bOk && i < i_Indices.size(); i++) {
+        bOk = read(o_Containers[i], getByteOffsetFromIndex(i_Indices[i]),
+                   o_pErrorCode);
+      }
+    }
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (size_t i = 0; bOk && i < i_Indices.size(); i++) {
+      if (keepLive(i_Indices[i], Span<ContainerType>(&o_Containers[i], 1)) ==
+          0) {
+        if (o_pErrorCode != nullptr) {
+          *o_pErrorCode = ErrorCode::ENTRY_REMOVED;
+        }
+        bOk = false;
+      }
+    }
+    return bOk;
   }
 
+  //! i_u32Count containers from physical index i_u32Index on, without the
+  //! ones the read filter hides
   bool getEntriesFrom(std::vector<ContainerType> &o_Containers,
                       uint32_t i_u32Index, uint32_t i_u32Count,
                       ErrorCode *o_pErrorCode = nullptr) {
-#ifndef LOCK_FREE
-    LG(m_Mutex);
-#endif
-    o_Containers.resize(i_u32Count);
-    return readVector(o_Containers, getByteOffsetFromIndex(i_u32Index),
-                      o_pErrorCode);
+    return getEntriesFromTo(o_Containers, i_u32Index, i_u32Index + i_u32Count,
+                            o_pErrorCode);
   }
 
-  bool
-  getEntriesChunked(std::function<void(std::vector<ContainerType>)> i_Callback,
-                    uint32_t i_u32Begin = 0, uint32_t i_u32End = 0,
-                    uint32_t i_u32ChunkSize = 100000,
-                    ErrorCode *o_pErrorCode = nullptr) {
-    std::vector<ContainerType> tmp(i_u32ChunkSize);
-
-    uint32_t entryCount = getEntryCount();
-
+  //! Walk the physical range [i_u32Begin, i_u32End) in chunks, without the
+  //! containers the read filter hides. Chunks with nothing left are skipped,
+  //! none of them move until the walk is done.
+  bool getEntriesChunked(
+      const std::function<void(const std::vector<ContainerType> &)> &i_Callback,
+      uint32_t i_u32Begin = 0, uint32_t i_u32End = 0,
+      uint32_t i_u32ChunkSize = 100000, ErrorCode *o_pErrorCode = nullptr) {
     if (i_u32End == 0) {
-      i_u32End = entryCount;
+      i_u32End = getStoredEntryCount();
     }
 
-    uint32_t rdCnt = 0;
+    i_u32ChunkSize = std::max(i_u32ChunkSize, 1U);
+    std::vector<ContainerType> tmp;
+    LiveReadScope scope(*this);
+    adviseScanBegin();
     // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
     while (i_u32Begin < i_u32End) {
-      if (entryCount < i_u32ChunkSize) {
-        rdCnt = entryCount;
-      } else {
-        rdCnt = i_u32ChunkSize;
+      uint32_t rdCnt = std::min(i_u32ChunkSize, i_u32End - i_u32Begin);
+      uint32_t next = i_u32Begin + rdCnt;
+      adviseScanAhead(next, std::min(i_u32ChunkSize, i_u32End - next));
+      tmp.resize(rdCnt);
+      if (!readVector(tmp, getByteOffsetFromIndex(i_u32Begin), o_pErrorCode)) {
+        adviseScanEnd();
+        return false;
       }
-      if (getEntriesFromTo(tmp, i_u32Begin, i_u32Begin + rdCnt, o_pErrorCode)) {
-        i_u32Begin += rdCnt;
+      adviseScanBehind(i_u32Begin, rdCnt);
+      tmp.resize(keepLive(i_u32Begin, tmp));
+      i_u32Begin = next;
+      if (!tmp.empty()) {
         i_Callback(tmp);
-      } else {
-        return false;
       }
     }
+    adviseScanEnd();
 
     return true;
   }
 
-  bool removeEntryAtEnd() {
-    m_CurrentHeader.count--;
-    m_CurrentHeader.offset--;
-    return truncate(m_CurrentHeader.offset * m_u32ContainerSize +
-                    m_u32HeaderSize);
+  bool removeEntryAtEnd() { return removeEntriesAtEnd(1); }
+
+  /*!
+   * Overwrite stored containers in place, count and offset stay as they are.
+   * AppendObservers are not told, sidecars which summarize the overwritten
+   * positions go stale. Not synced, see flush().
+   * @param i_Containers
+   * @param i_u32Index physical index of the first one
+   * @param o_pErrorCode
+   * @return false if the range is not stored or the write failed
+   */
+  bool setEntriesAt(Span<const ContainerType> i_Containers,
+                    uint32_t i_u32Index, ErrorCode *o_pErrorCode = nullptr) {
+#ifndef LOCK_FREE
+    LG(m_Mutex);
+#endif
+    const uint64_t stored =
+        isWrapped(m_CurrentHeader) ? m_CurrentHeader.maxEntries
+                                   : m_CurrentHeader.count;
+    if (i_u32Index + static_cast<uint64_t>(i_Containers.size()) > stored) {
+      return false;
+    }
+    auto expectedWriteSize =
+        static_cast<ssize_t>(i_Containers.size() * m_u32ContainerSize);
+    if (pwrite(m_Fd, i_Containers.data(), expectedWriteSize,
+               static_cast<off_t>(getByteOffsetFromIndex(i_u32Index))) !=
+        expectedWriteSize) {
+      onSysCallError(ErrorCode::WRITE_ERROR, o_pErrorCode);
+      return false;
+    }
+    return true;
   }
 
-  uint32_t getOffset() {
+  /*!
+   * Drop the i_u32Count newest containers with one truncate
+   * @param i_u32Count
+   * @param i_u64IfCount only if the file holds this many containers, so a
+   * concurrent append is never cut off
+   * @return false if fewer are stored, the ring has wrapped, the count did
+   * not match or the truncate failed
+   */
+  bool removeEntriesAtEnd(uint32_t i_u32Count,
+                          uint64_t i_u64IfCount = UINT64_MAX) {
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
-    return m_CurrentHeader.offset;
+    if (i_u32Count > m_CurrentHeader.count ||
+        (m_CurrentHeader.maxEntries != 0 &&
+         m_CurrentHeader.count > m_CurrentHeader.maxEntries) ||
+        (i_u64IfCount != UINT64_MAX &&
+         i_u64IfCount != m_CurrentHeader.count)) {
+      return false;
+    }
+    m_CurrentHeader.count -= i_u32Count;
+    m_CurrentHeader.offset = m_CurrentHeader.maxEntries == 0
+                                 ? m_CurrentHeader.count
+                                 : m_CurrentHeader.count %
+                                       m_CurrentHeader.maxEntries;
+    rebaseDurableCount(std::min<uint64_t>(
+        m_u64DurableCount.load(std::memory_order_relaxed),
+        m_CurrentHeader.count));
+    resetReservations();
+    notifyTruncated(m_CurrentHeader.count);
+    return truncate(getByteOffsetFromIndex(m_CurrentHeader.count));
   }
 
-  virtual uint32_t getFileSize() {
+  uint64_t getOffset() { return getHeader().offset; }
+
+  virtual uint64_t getFileSize() {
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
@@ -517,18 +2711,51 @@ public:
   }
 
   bool deleteFile() {
+    stopFlusher();
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
     close(m_Fd);
+    m_Fd = -1;
     return std::filesystem::remove(m_Path);
   }
 
-  HeaderType getHeader() {
-#ifndef LOCK_FREE
-    LG(m_Mutex);
-#endif
-    return m_CurrentHeader;
+  /*!
+   * Consistent snapshot of the header as published by the last completed
+   * append. Never blocks, safe to call while another thread appends.
+   * @return HeaderType
+   */
+  HeaderType getHeader() { return m_PublishedHeader.load(); }
+
+  /*!
+   * Register before appending, the observer has to outlive its registration.
+   * Not synchronized with appends.
+   * @param i_pObserver
+   */
+  void addAppendObserver(AppendObserver<ContainerType> *i_pObserver) {
+    m_Observers.emplace_back(i_pObserver);
+  }
+
+  void removeAppendObserver(AppendObserver<ContainerType> *i_pObserver) {
+    m_Observers.erase(
+        std::remove(m_Observers.begin(), m_Observers.end(), i_pObserver),
+        m_Observers.end());
+  }
+
+  [[nodiscard]] size_t getAppendObserverCount() const {
+    return m_Observers.size();
+  }
+
+  /*!
+   * Hide the containers i_pFilter reports as removed from getEntry,
+   * getEntries, getEntriesFrom, getEntriesFromTo, getEntriesChunked,
+   * getLogicalEntries, getLogicalEntriesChunked, getAllEntries and
+   * mapReduce. getEntriesInto, getLogicalEntriesInto and verify still see
+   * every container. Set before reading, nullptr detaches it.
+   * @param i_pFilter has to outlive its registration
+   */
+  void setReadFilter(ReadFilter<ContainerType> *i_pFilter) {
+    m_pReadFilter = i_pFilter;
   }
 
   Path getPath() { return m_Path; }
@@ -543,16 +2770,175 @@ public:
 #ifndef LOCK_FREE
     LG(m_Mutex);
 #endif
+    m_CurrentHeader.count = 0;
+    m_CurrentHeader.offset = 0;
+    rebaseDurableCount(0);
+    resetReservations();
+    notifyTruncated(0);
     return truncate(m_u32HeaderSize);
   }
 
   bool isEmpty() { return getEntryCount() == 0; }
 
+  //! Every stored container the read filter does not hide, oldest first
   bool getAllEntries(std::vector<ContainerType> &o_Containers) {
-    return getEntriesFrom(o_Containers, 0, getEntryCount());
+    const uint32_t count = getStoredEntryCount();
+    adviseScanBegin();
+    bool bOk = getLogicalEntries(o_Containers, 0, count);
+    adviseLogicalBehind(0, count);
+    adviseScanEnd();
+    return bOk;
   }
 };
 
+/*!
+ * fsync the directory holding i_Path, so a rename into it survives a crash
+ * @param i_Path
+ * @return false if the directory could not be opened or synced
+ */
+inline bool syncParentDirectory(const Path &i_Path) {
+  const Path parent =
+      i_Path.has_parent_path() ? i_Path.parent_path() : Path(".");
+  int32_t fd = ::open(parent.c_str(),
+                      O_RDONLY | O_DIRECTORY); // NOLINT(hicpp-signed-bitwise)
+  if (fd < 0) {
+    return false;
+  }
+  const bool bOk = fsync(fd) == 0;
+  close(fd);
+  return bOk;
+}
+
+/*!
+ * Rewrite a file written with OldHeaderType for BinaryFile<NewHeaderType, ...>,
+ * e.g. BinaryFileHeaderBase to BinaryFileHeaderBase64. Has to run before the
+ * file is opened with the new header. magic, version and any other fields are
+ * taken from i_Header, count, offset and maxEntries from the old header.
+ * A file with HeaderSlots::AB keeps that layout, the newest slot is migrated.
+ * The containers are copied (copy_file_range where the file system can) into
+ * a temporary file which replaces i_Path once it is synced.
+ * @tparam OldHeaderType
+ * @tparam NewHeaderType
+ * @param i_Path
+ * @param i_Header
+ * @param o_pErrorCode ErrorCode::COUNT_OVERFLOW if count, offset or
+ * maxEntries do not fit into NewHeaderType, ErrorCode::SYNC_ERROR if the
+ * directory could not be synced after the rename
+ * @return false if i_Path could not be read, its counts do not fit or the
+ * copy failed, i_Path is unchanged then. Also false if only syncing the
+ * directory failed, i_Path is migrated but may come back after a crash.
+ */
+template <typename OldHeaderType, typename NewHeaderType>
+bool migrateFile(const Path &i_Path, NewHeaderType i_Header,
+                 ErrorCode *o_pErrorCode = nullptr) {
+  auto fail = [o_pErrorCode](ErrorCode i_Error) {
+    if (o_pErrorCode != nullptr) {
+      *o_pErrorCode = i_Error;
+    }
+    return false;
+  };
+  int32_t in = ::open(i_Path.c_str(), O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+  if (in < 0) {
+    return fail(ErrorCode::OPEN_ERROR);
+  }
+  using OldSlot = HeaderSlot<OldHeaderType>;
+  using NewSlot = HeaderSlot<NewHeaderType>;
+  OldHeaderType old;
+  std::error_code error;
+  const uint64_t fileSize = std::filesystem::file_size(i_Path, error);
+  std::array<char, 2 * OldSlot::SIZE> oldSlots{};
+  uint64_t sequence = 0;
+  const bool bSlots =
+      !error && pread(in, oldSlots.data(), oldSlots.size(), 0) > 0 &&
+      OldSlot::decodeNewest(oldSlots.data(), old, sequence);
+  if (error || (!bSlots && (fileSize < sizeof(OldHeaderType) ||
+                            pread(in, &old, sizeof(old), 0) !=
+                                static_cast<ssize_t>(sizeof(old))))) {
+    close(in);
+    return fail(ErrorCode::READ_ERROR);
+  }
+  const uint64_t oldHeaderSize =
+      bSlots ? 2 * OldSlot::SIZE : sizeof(OldHeaderType);
+  if (old.magic != i_Header.magic) {
+    close(in);
+    return fail(ErrorCode::MAGIC_MISMATCH);
+  }
+  auto fits = [](auto i_Value, auto i_Target) {
+    return static_cast<uint64_t>(i_Value) <=
+           static_cast<uint64_t>(
+               std::numeric_limits<decltype(i_Target)>::max());
+  };
+  if (!fits(old.maxEntries, i_Header.maxEntries) ||
+      !fits(old.count, i_Header.count) || !fits(old.offset, i_Header.offset)) {
+    close(in);
+    return fail(ErrorCode::COUNT_OVERFLOW);
+  }
+  i_Header.maxEntries =
+      static_cast<decltype(i_Header.maxEntries)>(old.maxEntries);
+  i_Header.count = static_cast<decltype(i_Header.count)>(old.count);
+  i_Header.offset = static_cast<decltype(i_Header.offset)>(old.offset);
+
+  const Path temporary = i_Path.string() + ".migrate";
+  int32_t out = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                       0644); // NOLINT(hicpp-signed-bitwise)
+  if (out < 0) {
+    close(in);
+    return fail(ErrorCode::OPEN_ERROR);
+  }
+  bool bOk = false;
+  off_t outOffset = 0;
+  if (bSlots) {
+    // slot 0 stays empty, sequence 1 goes to slot 1
+    std::array<char, NewSlot::BYTES> slot{};
+    NewSlot::encode(slot.data(), i_Header, 1);
+    bOk = pwrite(out, slot.data(), slot.size(), NewSlot::SIZE) ==
+          static_cast<ssize_t>(slot.size());
+    outOffset = static_cast<off_t>(2 * NewSlot::SIZE);
+  } else {
+    bOk = pwrite(out, &i_Header, sizeof(i_Header), 0) ==
+          static_cast<ssize_t>(sizeof(i_Header));
+    outOffset = static_cast<off_t>(sizeof(NewHeaderType));
+  }
+  auto inOffset = static_cast<off_t>(oldHeaderSize);
+  uint64_t remaining = fileSize > oldHeaderSize ? fileSize - oldHeaderSize : 0;
+#ifdef __linux__
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (bOk && remaining > 0) {
+    const ssize_t copied =
+        copy_file_range(in, &inOffset, out, &outOffset,
+                        std::min<uint64_t>(remaining, 1U << 30U), 0);
+    if (copied <= 0) {
+      break; // not supported here, copy the rest through a buffer
+    }
+    remaining -= static_cast<uint64_t>(copied);
+  }
+#endif
+  std::vector<char> buffer(std::min<uint64_t>(remaining, 1U << 20U));
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (bOk && remaining > 0) {
+    const size_t size = std::min<uint64_t>(remaining, buffer.size());
+    bOk = pread(in, buffer.data(), size, inOffset) ==
+              static_cast<ssize_t>(size) &&
+          pwrite(out, buffer.data(), size, outOffset) ==
+              static_cast<ssize_t>(size);
+    inOffset += static_cast<off_t>(size);
+    outOffset += static_cast<off_t>(size);
+    remaining -= size;
+  }
+  bOk = bOk && fsync(out) == 0;
+  close(out);
+  close(in);
+  if (bOk) {
+    std::filesystem::rename(temporary, i_Path, error);
+    bOk = !error;
+  }
+  if (!bOk) {
+    std::filesystem::remove(temporary, error);
+    return fail(ErrorCode::WRITE_ERROR);
+  }
+  return syncParentDirectory(i_Path) || fail(ErrorCode::SYNC_ERROR);
+}
+
 } // namespace binfmt
 
 /*! @} */
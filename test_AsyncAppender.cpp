@@ -0,0 +1,112 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <set>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "AsyncAppender.h"
+#include "test_common.h"
+
+using TestAsyncAppender =
+    binfmt::AsyncAppender<TestBinaryHeader, TestBinaryEntry,
+                          TestBinaryEntryContainer>;
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BoundedMPSCQueue, testPushPop) {
+  binfmt::BoundedMPSCQueue<uint32_t> queue(5);
+  EXPECT_EQ(queue.getCapacity(), 4);
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.tryPush(uint32_t(i)));
+  }
+  EXPECT_FALSE(queue.tryPush(4));
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(queue.tryPop(value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.tryPop(value));
+  EXPECT_TRUE(queue.tryPush(5));
+  EXPECT_EQ(queue.getEnqueuedCount(), 5);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncAppender, testManyProducers) {
+  auto t = getRandomTestFile();
+  {
+    binfmt::AsyncAppenderOptions options;
+    options.maxQueueBytes = 1024;
+    TestAsyncAppender appender(t, options);
+    EXPECT_LE(appender.getQueueCapacity(), 64);
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < 4; p++) {
+      producers.emplace_back([&appender, p]() {
+        for (uint32_t i = 0; i < 1000; i++) {
+          EXPECT_EQ(appender.append(TestBinaryEntry{p * 1000 + i}),
+                    binfmt::ErrorCode::OK);
+        }
+      });
+    }
+    for (auto &producer : producers) {
+      producer.join();
+    }
+    EXPECT_TRUE(appender.flush());
+    EXPECT_EQ(t.getEntryCount(), 4000);
+  }
+  std::vector<TestBinaryEntryContainer> entries;
+  EXPECT_TRUE(t.getAllEntries(entries));
+  std::set<uint32_t> numbers;
+  for (const auto &entry : entries) {
+    EXPECT_TRUE(entry.isEntryValid());
+    numbers.insert(entry.entry.m_u32Number);
+  }
+  EXPECT_EQ(numbers.size(), 4000);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncAppender, testFuturesAndDrain) {
+  auto t = getRandomTestFile();
+  {
+    TestAsyncAppender appender(t);
+    std::vector<std::future<binfmt::ErrorCode>> futures;
+    for (uint32_t i = 0; i < 100; i++) {
+      futures.emplace_back(appender.appendWithFuture(TestBinaryEntry{i}));
+    }
+    for (auto &future : futures) {
+      EXPECT_EQ(future.get(), binfmt::ErrorCode::OK);
+    }
+    EXPECT_EQ(t.getEntryCount(), 100);
+
+    EXPECT_TRUE(appender.drain());
+    EXPECT_EQ(appender.append(TestBinaryEntry{0}), binfmt::ErrorCode::CLOSED);
+    EXPECT_EQ(appender.appendWithFuture(TestBinaryEntry{0}).get(),
+              binfmt::ErrorCode::CLOSED);
+  }
+  EXPECT_EQ(t.getEntryCount(), 100);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncAppender, testRejectWhenFull) {
+  auto t = getRandomTestFile();
+  {
+    binfmt::AsyncAppenderOptions options;
+    options.maxQueueBytes = 0;
+    options.backpressure = binfmt::Backpressure::Reject;
+    TestAsyncAppender appender(t, options);
+    EXPECT_EQ(appender.getQueueCapacity(), 2);
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < 10000; i++) {
+      auto r = appender.append(TestBinaryEntry{i});
+      EXPECT_TRUE(r == binfmt::ErrorCode::OK ||
+                  r == binfmt::ErrorCode::QUEUE_FULL);
+      accepted += r == binfmt::ErrorCode::OK;
+    }
+    EXPECT_TRUE(appender.flush());
+    EXPECT_EQ(t.getEntryCount(), accepted);
+  }
+  cleanupTestFile(t);
+}
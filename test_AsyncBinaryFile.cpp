@@ -0,0 +1,102 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <atomic>
+
+#include <gtest/gtest.h>
+
+#include "AsyncBinaryFile.h"
+#include "test_common.h"
+
+using TestAsyncBinaryFile =
+    binfmt::AsyncBinaryFile<TestBinaryHeader, TestBinaryEntry,
+                            TestBinaryEntryContainer>;
+
+binfmt::Task<uint32_t> appendAndReadBack(TestAsyncBinaryFile &f,
+                                         uint32_t i_u32Count) {
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    EXPECT_EQ(co_await f.append(TestBinaryEntry{i}), binfmt::ErrorCode::OK);
+  }
+  TestBinaryEntryContainer c{};
+  EXPECT_EQ(co_await f.getEntry(i_u32Count - 1, c), binfmt::ErrorCode::OK);
+  EXPECT_TRUE(c.isEntryValid());
+  co_return c.entry.m_u32Number;
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncBinaryFile, testAppendAndRead) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::GroupCommit, 8,
+                              std::chrono::microseconds(500)});
+  {
+    TestAsyncBinaryFile f(t, 2);
+    EXPECT_EQ(binfmt::syncWait(appendAndReadBack(f, 20)), 19);
+    EXPECT_GE(t.getDurableSequence(), 20);
+
+    std::vector<TestBinaryEntryContainer> entries;
+    EXPECT_EQ(binfmt::syncWait(f.getEntriesFrom(entries, 5, 10)),
+              binfmt::ErrorCode::OK);
+    EXPECT_EQ(entries.size(), 10);
+    EXPECT_EQ(entries[0].entry.m_u32Number, 5);
+
+    uint32_t chunks = 0;
+    uint32_t sum = 0;
+    EXPECT_EQ(binfmt::syncWait(f.getEntriesChunked(
+                  [&](const std::vector<TestBinaryEntryContainer> &chunk) {
+                    chunks++;
+                    for (const auto &c : chunk) {
+                      sum += c.entry.m_u32Number;
+                    }
+                  },
+                  0, 0, 6)),
+              binfmt::ErrorCode::OK);
+    EXPECT_EQ(chunks, 4);
+    EXPECT_EQ(sum, 190);
+
+    // a chunk size of 0 reads one container at a time instead of spinning
+    chunks = 0;
+    EXPECT_EQ(binfmt::syncWait(f.getEntriesChunked(
+                  [&](const std::vector<TestBinaryEntryContainer> &chunk) {
+                    EXPECT_EQ(chunk.size(), 1);
+                    chunks++;
+                  },
+                  10, 15, 0)),
+              binfmt::ErrorCode::OK);
+    EXPECT_EQ(chunks, 5);
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncBinaryFile, testManyInFlight) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::GroupCommit, 64,
+                              std::chrono::microseconds(1000)});
+  binfmt::ThreadPool pool(4);
+  {
+    TestAsyncBinaryFile f(t, pool);
+    std::atomic<uint32_t> done{0};
+    std::promise<void> allDone;
+    const uint32_t count = 1000;
+    for (uint32_t i = 0; i < count; i++) {
+      binfmt::spawn(f.append(TestBinaryEntry{i}), [&](binfmt::ErrorCode r) {
+        EXPECT_EQ(r, binfmt::ErrorCode::OK);
+        if (++done == count) {
+          allDone.set_value();
+        }
+      });
+    }
+    allDone.get_future().wait();
+    EXPECT_EQ(t.getEntryCount(), count);
+    EXPECT_GE(t.getDurableSequence(), count);
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(AsyncBinaryFile, testExceptionPropagates) {
+  auto task = []() -> binfmt::Task<int> {
+    throw std::runtime_error("failed");
+    co_return 0;
+  };
+  EXPECT_THROW(binfmt::syncWait(task()), std::runtime_error);
+}
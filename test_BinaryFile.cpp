@@ -3,6 +3,10 @@
 //
 
 #include <gtest/gtest.h>
+#include <future>
+#include <set>
+#include <sys/wait.h>
+#include <thread>
 
 #include "FileUtils.h"
 #include "binfmt.h"
@@ -77,6 +81,31 @@ TEST(binfmt, removeEntryAtEnd) {
   EXPECT_TRUE(file.deleteFile());
 }
 
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(binfmt, removeEntriesAtEnd) {
+  TestBinaryFile file("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 10));
+  std::vector<TestBinaryEntry> entries = {TestBinaryEntry{1}, TestBinaryEntry{2}, TestBinaryEntry{3},
+                                          TestBinaryEntry{4}, TestBinaryEntry{5}, TestBinaryEntry{6},
+                                          TestBinaryEntry{7}, TestBinaryEntry{8}, TestBinaryEntry{9},
+                                          TestBinaryEntry{10}};
+  EXPECT_EQ(file.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_FALSE(file.removeEntriesAtEnd(11));
+  EXPECT_TRUE(file.removeEntriesAtEnd(4));
+  EXPECT_EQ(file.getEntryCount(), 6);
+  EXPECT_EQ(file.getOffset(), 6);
+  EXPECT_EQ(file.getFileSize(), file.getHeaderSize() + 6 * file.getContainerSize());
+  EXPECT_EQ(file.append(TestBinaryEntry{42}), binfmt::ErrorCode::OK);
+  TestBinaryEntryContainer container;
+  EXPECT_TRUE(file.getEntry(6, container));
+  EXPECT_EQ(container.entry.m_u32Number, 42);
+
+  // overwritten records can not be restored
+  EXPECT_EQ(file.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_FALSE(file.removeEntriesAtEnd(1));
+  EXPECT_EQ(file.getEntryCount(), 17);
+  EXPECT_TRUE(file.deleteFile());
+}
+
 // NOLINTNEXTLINE(cert-err58-cpp)
 TEST(binfmt, rollover10Entries) {
   TestBinaryFile file("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 10));
@@ -167,6 +196,63 @@ TEST(binfmt, getEntriesChunked) {
   EXPECT_TRUE(file.deleteFile());
 }
 
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(binfmt, getEntriesChunkedPartialChunk) {
+  TestBinaryFile file("/tmp/test.bin", TestBinaryHeader{});
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 1000; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(file.append(entries), binfmt::ErrorCode::OK);
+  std::vector<size_t> chunkSizes;
+  EXPECT_TRUE(file.getEntriesChunked(
+      [&chunkSizes](const std::vector<TestBinaryEntryContainer> &i_Entries) {
+        chunkSizes.push_back(i_Entries.size());
+      },
+      100, 0, 300));
+  EXPECT_EQ(chunkSizes, (std::vector<size_t>{300, 300, 300}));
+  EXPECT_TRUE(file.deleteFile());
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(binfmt, mapReduce) {
+  TestBinaryFile file("/tmp/test.bin", TestBinaryHeader{});
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 10000; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(file.append(entries), binfmt::ErrorCode::OK);
+
+  auto sum = [](binfmt::Span<const TestBinaryEntryContainer> i_Containers) {
+    uint64_t r = 0;
+    for (const auto &container : i_Containers) {
+      r += container.entry.m_u32Number;
+    }
+    return r;
+  };
+  auto add = [](uint64_t a, uint64_t b) { return a + b; };
+
+  uint64_t total = 0;
+  EXPECT_TRUE(file.mapReduce(total, sum, add));
+  EXPECT_EQ(total, 49995000);
+
+  // partial range, chunks are folded in order
+  binfmt::ThreadPool pool(4);
+  std::vector<uint32_t> firsts;
+  EXPECT_TRUE(file.mapReduce(
+      firsts,
+      [](binfmt::Span<const TestBinaryEntryContainer> i_Containers) {
+        return std::vector<uint32_t>{i_Containers[0].entry.m_u32Number};
+      },
+      [](std::vector<uint32_t> a, std::vector<uint32_t> b) {
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+      },
+      pool, 100, 1100, 250));
+  EXPECT_EQ(firsts, (std::vector<uint32_t>{100, 350, 600, 850}));
+  EXPECT_TRUE(file.deleteFile());
+}
+
 // ----------------------- BinaryFile tests
 // NOLINTNEXTLINE(cert-err58-cpp)
 TEST(BinaryFile, testDeleteFile) {
@@ -362,4 +448,823 @@ TEST(BinaryFile, testReopen) {
   }
 
   getRandomTestFile().deleteFile();
-}
\ No newline at end of file
+}
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testDurabilitySyncEveryAppend) {
+  auto t = getRandomTestFile();
+  EXPECT_EQ(t.append(generateRandomTestEntry()), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getAppendSequence(), 1);
+  EXPECT_EQ(t.getDurableSequence(), 1);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testDurabilityDataSync) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::DataSync});
+  appendExactAmountOfEntriesV(t, 3);
+  EXPECT_EQ(t.getDurableSequence(), 3);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testDurabilityOSManaged) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  appendExactAmountOfEntriesV(t, 5);
+  EXPECT_EQ(t.getAppendSequence(), 5);
+  EXPECT_EQ(t.getDurableSequence(), 0);
+  EXPECT_TRUE(t.waitUntilDurable(5));
+  EXPECT_EQ(t.getDurableSequence(), 5);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testDurabilityGroupCommit) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::GroupCommit, 8,
+                              std::chrono::microseconds(500)});
+  appendExactAmountOfEntriesV(t, 20);
+  std::vector<TestBinaryEntry> entries = {generateRandomTestEntry(),
+                                          generateRandomTestEntry()};
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+  auto sequence = t.getAppendSequence();
+  EXPECT_EQ(sequence, 22);
+  // the last group is below the record threshold and gets synced by the
+  // interval timeout
+  EXPECT_TRUE(t.waitUntilDurable(sequence));
+  EXPECT_GE(t.getDurableSequence(), sequence);
+  EXPECT_EQ(t.getEntryCount(), 22);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testNotifyWhenDurable) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::GroupCommit, 1000,
+                              std::chrono::microseconds(500)});
+  uint64_t sequence = 0;
+  EXPECT_EQ(t.appendConcurrent(generateRandomTestEntry(), &sequence),
+            binfmt::ErrorCode::OK);
+  EXPECT_EQ(sequence, 1);
+  std::promise<bool> durable;
+  t.notifyWhenDurable(sequence, [&](bool ok) { durable.set_value(ok); });
+  EXPECT_TRUE(durable.get_future().get());
+  EXPECT_GE(t.getDurableSequence(), sequence);
+
+  // already durable, runs on the calling thread
+  bool called = false;
+  t.notifyWhenDurable(sequence, [&](bool ok) { called = ok; });
+  EXPECT_TRUE(called);
+  cleanupTestFile(t);
+}
+
+template <typename ChecksumPolicy> void testChecksumPolicy() {
+  using Container = binfmt::BinaryEntryContainer<TestBinaryEntry, ChecksumPolicy>;
+  using File = binfmt::BinaryFile<TestBinaryHeader, TestBinaryEntry, Container>;
+  Container c(TestBinaryEntry{42});
+  EXPECT_TRUE(c.isEntryValid());
+  c.entry.m_u32Number++;
+  EXPECT_FALSE(c.isEntryValid());
+
+  File file("/tmp/test.bin", TestBinaryHeader{});
+  EXPECT_EQ(file.append(TestBinaryEntry{7}), binfmt::ErrorCode::OK);
+  Container read{};
+  EXPECT_TRUE(file.getEntry(0, read));
+  EXPECT_TRUE(read.isEntryValid());
+  EXPECT_EQ(read.entry.m_u32Number, 7);
+  EXPECT_TRUE(file.deleteFile());
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryEntryContainer, testChecksumPolicies) {
+  testChecksumPolicy<binfmt::AdditiveChecksum>();
+  testChecksumPolicy<binfmt::CRC32CChecksum>();
+  testChecksumPolicy<binfmt::Hash64Checksum>();
+  EXPECT_EQ(sizeof(binfmt::BinaryEntryContainer<TestBinaryEntry>),
+            sizeof(TestBinaryEntryContainer));
+  EXPECT_EQ(sizeof(binfmt::BinaryEntryContainer<TestBinaryEntry, binfmt::Hash64Checksum>),
+            2 * sizeof(uint64_t));
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryEntryContainer, testNoChecksum) {
+  using Container = binfmt::BinaryEntryContainer<TestBinaryEntry, binfmt::NoChecksum>;
+  using File = binfmt::BinaryFile<TestBinaryHeader, TestBinaryEntry, Container>;
+  EXPECT_EQ(sizeof(Container), sizeof(TestBinaryEntry));
+  File file("/tmp/test.bin", TestBinaryHeader{});
+  std::vector<TestBinaryEntry> entries = {TestBinaryEntry{1}, TestBinaryEntry{2}};
+  EXPECT_EQ(file.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_EQ(file.getFileSize(), sizeof(TestBinaryHeader) + 2 * sizeof(TestBinaryEntry));
+  std::vector<Container> read;
+  EXPECT_TRUE(file.getAllEntries(read));
+  EXPECT_EQ(read[1].entry.m_u32Number, 2);
+  EXPECT_TRUE(read[1].isEntryValid());
+  EXPECT_TRUE(file.deleteFile());
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testAppendConcurrent) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  t.append(TestBinaryEntry{0});
+  std::vector<std::thread> writers;
+  for (uint32_t w = 0; w < 8; w++) {
+    writers.emplace_back([&t, w]() {
+      for (uint32_t i = 0; i < 250; i++) {
+        if (i % 50 == 0) {
+          std::vector<TestBinaryEntryContainer> batch;
+          for (uint32_t b = 0; b < 5; b++) {
+            batch.emplace_back(TestBinaryEntry{1 + w * 10000 + i * 10 + b});
+          }
+          EXPECT_EQ(t.appendConcurrent(batch), binfmt::ErrorCode::OK);
+        } else {
+          EXPECT_EQ(t.appendConcurrent(TestBinaryEntry{1 + w * 10000 + i * 10}),
+                    binfmt::ErrorCode::OK);
+        }
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+
+  uint32_t expected = 1 + 8 * (245 + 5 * 5);
+  EXPECT_EQ(t.getEntryCount(), expected);
+  EXPECT_EQ(t.getOffset(), expected);
+  std::vector<TestBinaryEntryContainer> entries;
+  EXPECT_TRUE(t.getAllEntries(entries));
+  std::set<uint32_t> numbers;
+  for (const auto &e : entries) {
+    EXPECT_TRUE(e.isEntryValid());
+    numbers.insert(e.entry.m_u32Number);
+  }
+  EXPECT_EQ(numbers.size(), expected);
+  EXPECT_EQ(t.append(TestBinaryEntry{1}), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), expected + 1);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(EntryLimitedBinaryFile, testAppendConcurrentRollover) {
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 100),
+                   {binfmt::DurabilityPolicy::OSManaged});
+  std::vector<std::thread> writers;
+  for (uint32_t w = 0; w < 4; w++) {
+    writers.emplace_back([&t]() {
+      for (uint32_t i = 0; i < 60; i++) {
+        EXPECT_EQ(t.appendConcurrent(generateRandomTestEntry()), binfmt::ErrorCode::OK);
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  EXPECT_EQ(t.getEntryCount(), 240);
+  EXPECT_EQ(t.getOffset(), 40);
+  EXPECT_EQ(t.getFileSize(), sizeof(TestBinaryHeader) + 100 * sizeof(TestBinaryEntryContainer));
+
+  // a batch larger than the ring only keeps its newest maxEntries containers
+  std::vector<TestBinaryEntryContainer> batch;
+  for (uint32_t i = 0; i < 150; i++) {
+    batch.emplace_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.appendConcurrent(batch), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getOffset(), 90);
+  TestBinaryEntryContainer c;
+  EXPECT_TRUE(t.getEntry(89, c));
+  EXPECT_EQ(c.entry.m_u32Number, 149);
+  EXPECT_TRUE(t.getEntry(90, c));
+  EXPECT_EQ(c.entry.m_u32Number, 50);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(EntryLimitedBinaryFile, testAppendConcurrentFailureIsNotCounted) {
+  // a ring two records short of what a 32-bit header can count
+  TestBinaryHeader header(0xABC, 0, 4);
+  header.count = std::numeric_limits<uint32_t>::max() - 1;
+  header.offset = header.count % 4;
+  {
+    std::ofstream out("/tmp/test.bin", std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    std::vector<TestBinaryEntryContainer> slots(4);
+    out.write(reinterpret_cast<const char *>(slots.data()),
+              static_cast<std::streamsize>(slots.size() * sizeof(slots[0])));
+  }
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 4),
+                   {binfmt::DurabilityPolicy::OSManaged});
+  ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.appendConcurrent(TestBinaryEntry{1}), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), std::numeric_limits<uint32_t>::max());
+  std::vector<TestBinaryEntryContainer> batch(2);
+  EXPECT_EQ(t.appendConcurrent(batch), binfmt::ErrorCode::COUNT_OVERFLOW);
+  EXPECT_EQ(t.getEntryCount(), std::numeric_limits<uint32_t>::max());
+  // nothing after a reservation which was not counted is counted either
+  EXPECT_EQ(t.appendConcurrent(TestBinaryEntry{2}),
+            binfmt::ErrorCode::WRITE_ERROR);
+  EXPECT_EQ(t.getEntryCount(), std::numeric_limits<uint32_t>::max());
+
+  EXPECT_TRUE(t.clear());
+  EXPECT_EQ(t.appendConcurrent(TestBinaryEntry{3}), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), 1);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(EntryLimitedBinaryFile, testAppendSpanRollover) {
+  binfmt::BinaryFileOptions options;
+  options.appendScratchEntries = 16;
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 100), options);
+  std::vector<TestBinaryEntryContainer> containers;
+  for (uint32_t i = 0; i < 70; i++) {
+    containers.emplace_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(binfmt::Span<const TestBinaryEntryContainer>(containers)),
+            binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getOffset(), 70);
+
+  // wraps, written through the scratch buffer in pieces of 16
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 70; i < 120; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(binfmt::Span<const TestBinaryEntry>(entries)),
+            binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), 120);
+  EXPECT_EQ(t.getOffset(), 20);
+
+  std::vector<TestBinaryEntryContainer> read;
+  EXPECT_TRUE(t.getEntriesFrom(read, 0, 100));
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_TRUE(read[i].isEntryValid());
+    EXPECT_EQ(read[i].entry.m_u32Number, i < 20 ? 100 + i : i);
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testVerify) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 1000; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  binfmt::VerifyResult result;
+  EXPECT_TRUE(t.verify(result, 4, 64));
+  EXPECT_EQ(result.checked, 1000);
+  EXPECT_TRUE(result.isValid());
+
+  // flip the entries of two containers behind the back of the BinaryFile
+  {
+    std::fstream file(t.getPath(), std::ios::in | std::ios::out | std::ios::binary);
+    for (uint32_t index : {5U, 700U}) {
+      file.seekp(sizeof(TestBinaryHeader) + index * sizeof(TestBinaryEntryContainer));
+      uint32_t garbage = 0xDEADBEEF;
+      file.write(reinterpret_cast<const char *>(&garbage), sizeof(garbage));
+    }
+  }
+
+  binfmt::ThreadPool pool(3);
+  EXPECT_TRUE(t.verify(result, pool, 100));
+  EXPECT_EQ(result.checked, 1000);
+  EXPECT_EQ(result.invalidIndices, (std::vector<uint32_t>{5, 700}));
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(EntryLimitedBinaryFile, testStreamingScanMode) {
+  binfmt::BinaryFileOptions options;
+  options.scanMode = binfmt::ScanMode::Streaming;
+  options.hotTailEntries = 100;
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 1000), options);
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 1500; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  // the hints must not change what is read
+  uint32_t scanned = 0;
+  EXPECT_TRUE(t.getEntriesChunked(
+      [&scanned](const std::vector<TestBinaryEntryContainer> &i_Chunk) {
+        for (const auto &container : i_Chunk) {
+          EXPECT_TRUE(container.isEntryValid());
+          uint32_t expected = scanned < 500 ? 1000 + scanned : scanned;
+          EXPECT_EQ(container.entry.m_u32Number, expected);
+          scanned++;
+        }
+      },
+      0, 1000, 64));
+  EXPECT_EQ(scanned, 1000);
+
+  TestBinaryEntryContainer c;
+  EXPECT_TRUE(t.getEntry(10, c));
+  EXPECT_EQ(c.entry.m_u32Number, 1010);
+  std::vector<TestBinaryEntryContainer> read;
+  EXPECT_TRUE(t.getEntries({999, 0}, read));
+  EXPECT_EQ(read[0].entry.m_u32Number, 999);
+  EXPECT_EQ(read[1].entry.m_u32Number, 1000);
+
+  binfmt::VerifyResult result;
+  EXPECT_TRUE(t.verify(result, 2, 128));
+  EXPECT_EQ(result.checked, 1000);
+  EXPECT_TRUE(result.isValid());
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(EntryLimitedBinaryFile, testLogicalOrder) {
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 10));
+  for (uint32_t i = 0; i < 7; i++) {
+    EXPECT_EQ(t.append(TestBinaryEntry{i}), binfmt::ErrorCode::OK);
+  }
+  std::vector<TestBinaryEntryContainer> read;
+  EXPECT_TRUE(t.getAllEntries(read));
+  EXPECT_EQ(read.size(), 7);
+  EXPECT_EQ(t.getOldestIndex(), 0);
+
+  for (uint32_t i = 7; i < 25; i++) {
+    EXPECT_EQ(t.append(TestBinaryEntry{i}), binfmt::ErrorCode::OK);
+  }
+  // slots hold 20..24 followed by 15..19
+  EXPECT_EQ(t.getOldestIndex(), 5);
+  EXPECT_EQ(t.getPhysicalIndex(7), 2);
+  EXPECT_TRUE(t.getAllEntries(read));
+  ASSERT_EQ(read.size(), 10);
+  for (uint32_t i = 0; i < 10; i++) {
+    EXPECT_EQ(read[i].entry.m_u32Number, 15 + i);
+  }
+
+  // crosses the end of the ring
+  EXPECT_TRUE(t.getLogicalEntries(read, 3, 5));
+  for (uint32_t i = 0; i < 5; i++) {
+    EXPECT_EQ(read[i].entry.m_u32Number, 18 + i);
+  }
+  EXPECT_FALSE(t.getLogicalEntries(read, 8, 3));
+
+  std::vector<uint32_t> numbers;
+  std::vector<size_t> chunkSizes;
+  EXPECT_TRUE(t.getLogicalEntriesChunked(
+      [&numbers, &chunkSizes](binfmt::Span<const TestBinaryEntryContainer> i_Chunk) {
+        chunkSizes.push_back(i_Chunk.size());
+        for (const auto &container : i_Chunk) {
+          numbers.push_back(container.entry.m_u32Number);
+        }
+      },
+      1, 0, 4));
+  EXPECT_EQ(chunkSizes, (std::vector<size_t>{4, 4, 1}));
+  EXPECT_EQ(numbers, (std::vector<uint32_t>{16, 17, 18, 19, 20, 21, 22, 23, 24}));
+
+  // getEntriesChunked stays physical but stops at the stored count
+  uint32_t scanned = 0;
+  EXPECT_TRUE(t.getEntriesChunked(
+      [&scanned](const std::vector<TestBinaryEntryContainer> &i_Chunk) { scanned += i_Chunk.size(); },
+      0, 0, 3));
+  EXPECT_EQ(scanned, 10);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testReadersDuringAppend) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([&t, &done]() {
+      uint32_t lastCount = 0;
+      while (!done.load()) {
+        auto header = t.getHeader();
+        // count and offset always come from the same append
+        EXPECT_EQ(header.count, header.offset);
+        EXPECT_GE(header.count, lastCount);
+        lastCount = header.count;
+        if (header.count > 10) {
+          std::vector<TestBinaryEntryContainer> entries;
+          EXPECT_TRUE(t.getEntriesFrom(entries, header.count - 10, 10));
+          for (const auto &e : entries) {
+            EXPECT_TRUE(e.isEntryValid());
+          }
+        }
+      }
+    });
+  }
+  for (uint32_t i = 0; i < 200; i++) {
+    if (i % 10 == 0) {
+      std::vector<TestBinaryEntry> entries(7, generateRandomTestEntry());
+      EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+    } else {
+      EXPECT_EQ(t.append(generateRandomTestEntry()), binfmt::ErrorCode::OK);
+    }
+  }
+  done = true;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(t.getEntryCount(), 180 + 20 * 7);
+  cleanupTestFile(t);
+}
+
+void testIoBackend(binfmt::BinaryFileOptions i_Options) {
+  auto t = getRandomTestFile(i_Options);
+  auto ae = appendExactAmountOfEntriesV(t, 150);
+  EXPECT_EQ(t.getDurableSequence(), 150);
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 150; i++) {
+    indices.push_back((i * 37) % 150);
+  }
+  std::vector<TestBinaryEntryContainer> entries;
+  EXPECT_TRUE(t.getEntries(indices, entries));
+  EXPECT_EQ(entries.size(), indices.size());
+  for (uint32_t i = 0; i < indices.size(); i++) {
+    EXPECT_EQ(entries[i].checksum, ae[indices[i]].checksum);
+  }
+  EXPECT_FALSE(t.getEntries({150}, entries));
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testIoBackendSyscalls) {
+  testIoBackend({});
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testIoBackendIoUring) {
+  binfmt::BinaryFileOptions options;
+  options.ioBackend = binfmt::IoBackend::IoUring;
+  options.ioUringDepth = 16;
+  testIoBackend(options);
+  options.durability = binfmt::DurabilityPolicy::DataSync;
+  testIoBackend(options);
+}
+
+using TestBinaryFile64 =
+    binfmt::BinaryFile<binfmt::BinaryFileHeaderBase64, TestBinaryEntry,
+                       TestBinaryEntryContainer>;
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testHeader64Past4GiB) {
+  // a sparse file of 600M containers, 4.8GB
+  const uint64_t count = 600000000;
+  {
+    std::ofstream out("/tmp/test.bin", std::ios::binary);
+    binfmt::BinaryFileHeaderBase64 header(0xBEEF, 1, count, count, 0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+  std::filesystem::resize_file("/tmp/test.bin",
+                               sizeof(binfmt::BinaryFileHeaderBase64) +
+                                   count * sizeof(TestBinaryEntryContainer));
+
+  {
+    TestBinaryFile64 t("/tmp/test.bin", binfmt::BinaryFileHeaderBase64{},
+                       {binfmt::DurabilityPolicy::OSManaged});
+    ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+    EXPECT_EQ(t.getEntryCount(), count);
+    EXPECT_EQ(t.append(std::vector<TestBinaryEntry>{{1}, {2}, {3}}),
+              binfmt::ErrorCode::OK);
+    EXPECT_EQ(t.getEntryCountFromFileSize(), count + 3);
+    EXPECT_GT(t.getFileSize(), UINT32_MAX);
+  }
+
+  TestBinaryFile64 t("/tmp/test.bin", binfmt::BinaryFileHeaderBase64{});
+  EXPECT_EQ(t.getEntryCount(), count + 3);
+  EXPECT_EQ(t.getOffset(), count + 3);
+  TestBinaryEntryContainer container;
+  EXPECT_TRUE(t.getEntry(static_cast<uint32_t>(count + 2), container));
+  EXPECT_EQ(container.entry.m_u32Number, 3);
+  EXPECT_TRUE(container.isEntryValid());
+  EXPECT_TRUE(t.removeEntriesAtEnd(2));
+  EXPECT_EQ(t.getFileSize(), sizeof(binfmt::BinaryFileHeaderBase64) +
+                                 (count + 1) *
+                                     sizeof(TestBinaryEntryContainer));
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testMigrateFileTo64) {
+  std::vector<TestBinaryEntryContainer> ae;
+  {
+    auto t = getRandomTestFile();
+    ae = appendExactAmountOfEntriesV(t, 1000);
+  }
+  const auto size = std::filesystem::file_size("/tmp/test.bin");
+
+  // the old file is left alone until it is migrated
+  {
+    TestBinaryFile64 t("/tmp/test.bin", binfmt::BinaryFileHeaderBase64{});
+    EXPECT_EQ(t.getErrorCode(), binfmt::ErrorCode::LAYOUT_MISMATCH);
+  }
+  EXPECT_EQ(std::filesystem::file_size("/tmp/test.bin"), size);
+
+  binfmt::ErrorCode error = binfmt::ErrorCode::OK;
+  EXPECT_FALSE(binfmt::migrateFile<TestBinaryHeader>(
+      "/tmp/test.bin", binfmt::BinaryFileHeaderBase64(0xABC, 1, 0), &error));
+  EXPECT_EQ(error, binfmt::ErrorCode::MAGIC_MISMATCH);
+  EXPECT_TRUE(binfmt::migrateFile<TestBinaryHeader>(
+      "/tmp/test.bin", binfmt::BinaryFileHeaderBase64{}, &error));
+  EXPECT_FALSE(std::filesystem::exists("/tmp/test.bin.migrate"));
+
+  {
+    TestBinaryFile64 t("/tmp/test.bin", binfmt::BinaryFileHeaderBase64{});
+    ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+    EXPECT_EQ(t.getEntryCount(), 1000);
+    std::vector<TestBinaryEntryContainer> entries;
+    EXPECT_TRUE(t.getAllEntries(entries));
+    ASSERT_EQ(entries.size(), ae.size());
+    for (uint32_t i = 0; i < ae.size(); i++) {
+      EXPECT_EQ(entries[i].entry.m_u32Number, ae[i].entry.m_u32Number);
+    }
+    EXPECT_EQ(t.append(TestBinaryEntry{7}), binfmt::ErrorCode::OK);
+    EXPECT_EQ(t.getEntryCount(), 1001);
+  }
+
+  // and a 64-bit file is not mistaken for a 32-bit one
+  {
+    auto t = getRandomTestFile();
+    EXPECT_EQ(t.getErrorCode(), binfmt::ErrorCode::LAYOUT_MISMATCH);
+  }
+  cleanup("/tmp/test.bin");
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testMigrateFileTo32) {
+  // a count a 32-bit header cannot hold
+  const uint64_t count = uint64_t{UINT32_MAX} + 2;
+  {
+    std::ofstream out("/tmp/test.bin", std::ios::binary);
+    binfmt::BinaryFileHeaderBase64 header(0xBEEF, 1, count, count, 0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+  binfmt::ErrorCode error = binfmt::ErrorCode::OK;
+  EXPECT_FALSE(binfmt::migrateFile<binfmt::BinaryFileHeaderBase64>(
+      "/tmp/test.bin", TestBinaryHeader{}, &error));
+  EXPECT_EQ(error, binfmt::ErrorCode::COUNT_OVERFLOW);
+  EXPECT_EQ(std::filesystem::file_size("/tmp/test.bin"),
+            sizeof(binfmt::BinaryFileHeaderBase64));
+  EXPECT_FALSE(std::filesystem::exists("/tmp/test.bin.migrate"));
+  cleanup("/tmp/test.bin");
+
+  // one that fits goes through
+  {
+    TestBinaryFile64 t("/tmp/test.bin", binfmt::BinaryFileHeaderBase64{});
+    appendExactAmountOfEntriesV(t, 10);
+  }
+  EXPECT_TRUE(binfmt::migrateFile<binfmt::BinaryFileHeaderBase64>(
+      "/tmp/test.bin", TestBinaryHeader{}, &error));
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{});
+  ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), 10);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testMigrateFileWithHeaderSlots) {
+  binfmt::BinaryFileOptions options;
+  options.headerSlots = binfmt::HeaderSlots::AB;
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+    appendExactAmountOfEntriesV(t, 100);
+    // a few header writes, so the newest slot is not the first one written
+    EXPECT_TRUE(t.removeEntriesAtEnd(10));
+  }
+
+  EXPECT_TRUE(binfmt::migrateFile<TestBinaryHeader>(
+      "/tmp/test.bin", binfmt::BinaryFileHeaderBase64{}));
+  TestBinaryFile64 t("/tmp/test.bin", binfmt::BinaryFileHeaderBase64{},
+                     options);
+  ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), 90);
+  EXPECT_EQ(t.getFileSize(),
+            t.getHeaderSize() + 90 * sizeof(TestBinaryEntryContainer));
+  std::vector<TestBinaryEntryContainer> entries;
+  EXPECT_TRUE(t.getAllEntries(entries));
+  ASSERT_EQ(entries.size(), 90);
+  for (const auto &entry : entries) {
+    EXPECT_TRUE(entry.isEntryValid());
+  }
+  cleanupTestFile(t);
+}
+
+//! Append in a child process which exits without closing the file,
+//! flushing once i_u32FlushAt records were appended if it is not 0
+template <typename BinaryFileType, typename HeaderType>
+void appendAndCrash(HeaderType i_Header, binfmt::BinaryFileOptions i_Options,
+                    uint32_t i_u32Count, uint32_t i_u32FlushAt = 0) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    BinaryFileType t("/tmp/test.bin", i_Header, i_Options);
+    for (uint32_t i = 0; i < i_u32Count; i++) {
+      if (i_u32FlushAt != 0 && i == i_u32FlushAt) {
+        (void)t.flush();
+      }
+      (void)t.append(TestBinaryEntry{i});
+    }
+    _exit(0);
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+}
+
+TestBinaryHeader readRawHeader() {
+  TestBinaryHeader header;
+  std::ifstream in("/tmp/test.bin", std::ios::binary);
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  return header;
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testRecoverTailAfterCrash) {
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::SyncEveryAppend;
+  options.headerCheckpointRecords = 100;
+  appendAndCrash<TestBinaryFile>(TestBinaryHeader{}, options, 250);
+  EXPECT_EQ(readRawHeader().count, 200);
+
+  // a torn write
+  const uint64_t size = std::filesystem::file_size("/tmp/test.bin");
+  {
+    std::ofstream out("/tmp/test.bin", std::ios::binary | std::ios::app);
+    out << "xy";
+  }
+
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+    ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+    EXPECT_EQ(t.getEntryCount(), 250);
+    EXPECT_EQ(t.getFileSize(), size);
+    EXPECT_EQ(t.append(TestBinaryEntry{250}), binfmt::ErrorCode::OK);
+  }
+
+  // recovery stops at the first container which does not check out
+  {
+    std::fstream io("/tmp/test.bin",
+                    std::ios::binary | std::ios::in | std::ios::out);
+    TestBinaryHeader stale(0xBEEF, 1, 200, 200, 0);
+    io.write(reinterpret_cast<const char *>(&stale), sizeof(stale));
+    io.seekp(sizeof(TestBinaryHeader) + 240 * sizeof(TestBinaryEntryContainer));
+    io.write("\xFF", 1);
+  }
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+  EXPECT_EQ(t.getEntryCount(), 240);
+  EXPECT_EQ(t.getEntryCountFromFileSize(), 240);
+  std::vector<TestBinaryEntryContainer> entries;
+  EXPECT_TRUE(t.getAllEntries(entries));
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    EXPECT_EQ(entries[i].entry.m_u32Number, i);
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(EntryLimitedBinaryFile, testRecoverTailAfterCrash) {
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::SyncEveryAppend;
+  options.headerCheckpointRecords = 20;
+  const TestBinaryHeader header(0xBEEF, 1, 100);
+  appendAndCrash<TestBinaryFile>(header, options, 50);
+  EXPECT_EQ(readRawHeader().count, 40);
+  {
+    TestBinaryFile t("/tmp/test.bin", header, options);
+    EXPECT_EQ(t.getEntryCount(), 50);
+    EXPECT_EQ(t.getOffset(), 50);
+  }
+
+  // once wrapped, the checkpoint is all there is
+  appendAndCrash<TestBinaryFile>(header, options, 75);
+  EXPECT_EQ(readRawHeader().count, 110);
+  TestBinaryFile t("/tmp/test.bin", header, options);
+  EXPECT_EQ(t.getEntryCount(), 110);
+  EXPECT_EQ(t.getOffset(), 10);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testRecoverZeroFilledTail) {
+  using CRC32CContainer =
+      binfmt::BinaryEntryContainer<TestBinaryEntry, binfmt::CRC32CChecksum>;
+  using CRC32CFile =
+      binfmt::BinaryFile<TestBinaryHeader, TestBinaryEntry, CRC32CContainer>;
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::OSManaged;
+  options.headerCheckpointRecords = 100;
+  // nothing was synced, so nothing was checkpointed
+  appendAndCrash<CRC32CFile>(TestBinaryHeader{}, options, 150);
+  EXPECT_EQ(readRawHeader().count, 0);
+  cleanup("/tmp/test.bin");
+
+  options.durability = binfmt::DurabilityPolicy::SyncEveryAppend;
+  appendAndCrash<CRC32CFile>(TestBinaryHeader{}, options, 150);
+  EXPECT_EQ(readRawHeader().count, 100);
+  // the file system may extend a file with zeros which were never written
+  const uint64_t size = std::filesystem::file_size("/tmp/test.bin");
+  std::filesystem::resize_file("/tmp/test.bin",
+                               size + 100 * sizeof(CRC32CContainer));
+
+  CRC32CFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+  EXPECT_EQ(t.getEntryCount(), 150);
+  EXPECT_EQ(t.getFileSize(), size);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testCheckpointWithOSManaged) {
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::OSManaged;
+  options.headerCheckpointRecords = 100;
+  // never synced, opening has to check everything
+  appendAndCrash<TestBinaryFile>(TestBinaryHeader{}, options, 250);
+  EXPECT_EQ(readRawHeader().count, 0);
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+    EXPECT_EQ(t.getEntryCount(), 250);
+  }
+  cleanup("/tmp/test.bin");
+
+  // flush makes the records durable, the next append checkpoints them
+  appendAndCrash<TestBinaryFile>(TestBinaryHeader{}, options, 250, 150);
+  EXPECT_EQ(readRawHeader().count, 150);
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+  EXPECT_EQ(t.getEntryCount(), 250);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testRecoverZeroEntryAfterCheckpoint) {
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::SyncEveryAppend;
+  options.headerCheckpointRecords = 100;
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+    appendExactAmountOfEntriesV(t, 100);
+    // all zeros with an additive checksum, but written
+    EXPECT_EQ(t.append(TestBinaryEntry{}), binfmt::ErrorCode::OK);
+    appendExactAmountOfEntriesV(t, 49);
+  }
+  {
+    std::fstream io("/tmp/test.bin",
+                    std::ios::binary | std::ios::in | std::ios::out);
+    TestBinaryHeader stale(0xBEEF, 1, 100, 100, 0);
+    io.write(reinterpret_cast<const char *>(&stale), sizeof(stale));
+  }
+
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+  EXPECT_EQ(t.getEntryCount(), 150);
+  TestBinaryEntryContainer container;
+  EXPECT_TRUE(t.getEntry(100, container));
+  EXPECT_EQ(container.entry.m_u32Number, 0);
+  EXPECT_TRUE(t.getEntry(149, container));
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(BinaryFile, testHeaderSlotsAB) {
+  binfmt::BinaryFileOptions options;
+  options.durability = binfmt::DurabilityPolicy::OSManaged;
+  options.headerCheckpointRecords = 0;
+  options.headerSlots = binfmt::HeaderSlots::AB;
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+    ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+    EXPECT_EQ(t.getHeaderSize(), 1024);
+    EXPECT_EQ(t.getEntryCountFromFileSize(), 0);
+    appendExactAmountOfEntriesV(t, 100);
+  }
+  EXPECT_EQ(std::filesystem::file_size("/tmp/test.bin"),
+            1024 + 100 * sizeof(TestBinaryEntryContainer));
+
+  // the other layout is refused, not overwritten
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{});
+    EXPECT_EQ(t.getErrorCode(), binfmt::ErrorCode::LAYOUT_MISMATCH);
+  }
+
+  {
+    TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+    EXPECT_EQ(t.getEntryCount(), 100);
+    appendExactAmountOfEntriesV(t, 5);
+  }
+
+  // a torn update of the newest slot falls back to the other one, the tail
+  // recovery then starts at its count of 100 and stops at a bad container
+  {
+    std::fstream io("/tmp/test.bin",
+                    std::ios::binary | std::ios::in | std::ios::out);
+    io.seekp(512 + 4);
+    io.write("\xFF\xFF\xFF\xFF", 4);
+    io.seekp(1024 + 102 * sizeof(TestBinaryEntryContainer));
+    io.write("\xFF\xFF\xFF\xFF", 4);
+  }
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader{}, options);
+  ASSERT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(t.getEntryCount(), 102);
+  cleanupTestFile(t);
+
+  {
+    auto single = getRandomTestFile();
+    appendExactAmountOfEntriesV(single, 10);
+  }
+  {
+    TestBinaryFile ab("/tmp/test.bin", TestBinaryHeader{}, options);
+    EXPECT_EQ(ab.getErrorCode(), binfmt::ErrorCode::LAYOUT_MISMATCH);
+  }
+  EXPECT_EQ(getRandomTestFile().getEntryCount(), 10);
+  cleanup("/tmp/test.bin");
+}
@@ -0,0 +1,161 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <gtest/gtest.h>
+
+#include "ColumnarFile.h"
+#include "test_common.h"
+
+#define TEST_COLUMNAR_FILE "/tmp/test.columns"
+
+struct Reading {
+  uint32_t timestamp;
+  float temperature;
+  uint8_t sensor;
+};
+
+using ReadingFile =
+    binfmt::ColumnarFile<TestBinaryHeader, Reading, &Reading::timestamp,
+                         &Reading::temperature>;
+
+std::vector<Reading> getReadings(uint32_t i_u32Begin, uint32_t i_u32End) {
+  std::vector<Reading> r;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    r.push_back(Reading{i, static_cast<float>(i % 100), 7});
+  }
+  return r;
+}
+
+void cleanupColumnarFile(ReadingFile &f) {
+  EXPECT_TRUE(f.deleteFiles());
+  EXPECT_FALSE(std::filesystem::exists(
+      ReadingFile::getColumnPath(TEST_COLUMNAR_FILE, 0)));
+  EXPECT_FALSE(std::filesystem::exists(
+      ReadingFile::getColumnPath(TEST_COLUMNAR_FILE, 1)));
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ColumnarFile, testAppendAndScan) {
+  ReadingFile f(TEST_COLUMNAR_FILE, TestBinaryHeader{},
+                {binfmt::DurabilityPolicy::OSManaged});
+  ASSERT_EQ(f.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.append(getReadings(0, 9999)), binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.append(Reading{9999, 99.0F, 7}), binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.getRowCount(), 10000);
+
+  // one plain array of floats per column file
+  auto &temperatures = f.getColumn<&Reading::temperature>();
+  EXPECT_EQ(temperatures.getFileSize(),
+            temperatures.getHeaderSize() + 10000 * sizeof(float));
+
+  double sum = 0;
+  std::vector<size_t> sizes;
+  EXPECT_TRUE(f.scanColumns<&Reading::temperature>(
+      [&sum, &sizes](binfmt::Span<const float> i_Temperatures) {
+        sizes.push_back(i_Temperatures.size());
+        for (float temperature : i_Temperatures) {
+          sum += temperature;
+        }
+      },
+      0, 0, 4096));
+  EXPECT_EQ(sum, 100 * 4950.0);
+  EXPECT_EQ(sizes, (std::vector<size_t>{4096, 4096, 1808}));
+
+  uint32_t expected = 500;
+  EXPECT_TRUE((f.scanColumns<&Reading::temperature, &Reading::timestamp>(
+      [&expected](binfmt::Span<const float> i_Temperatures,
+                  binfmt::Span<const uint32_t> i_Timestamps) {
+        ASSERT_EQ(i_Temperatures.size(), i_Timestamps.size());
+        for (size_t i = 0; i < i_Timestamps.size(); i++) {
+          EXPECT_EQ(i_Timestamps[i], expected);
+          EXPECT_EQ(i_Temperatures[i], static_cast<float>(expected % 100));
+          expected++;
+        }
+      },
+      500, 1000, 300)));
+  EXPECT_EQ(expected, 1500);
+  EXPECT_FALSE(f.scanColumns<&Reading::timestamp>(
+      [](binfmt::Span<const uint32_t>) { FAIL(); }, 9000, 1001));
+
+  // sensor is not stored
+  Reading reading{};
+  EXPECT_TRUE(f.getEntry(1234, reading));
+  EXPECT_EQ(reading.timestamp, 1234);
+  EXPECT_EQ(reading.temperature, 34.0F);
+  EXPECT_EQ(reading.sensor, 0);
+  std::vector<Reading> readings;
+  EXPECT_TRUE(f.getEntries(readings, 9990, 10));
+  ASSERT_EQ(readings.size(), 10);
+  EXPECT_EQ(readings.back().timestamp, 9999);
+  EXPECT_FALSE(f.getEntry(10000, reading));
+
+  EXPECT_TRUE(f.clear());
+  EXPECT_EQ(f.getRowCount(), 0);
+  cleanupColumnarFile(f);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ColumnarFile, testReopenDropsPartialRows) {
+  {
+    ReadingFile f(TEST_COLUMNAR_FILE, TestBinaryHeader{},
+                  {binfmt::DurabilityPolicy::OSManaged});
+    EXPECT_EQ(f.append(getReadings(0, 100)), binfmt::ErrorCode::OK);
+    // as if the process died before the second column got these rows
+    EXPECT_EQ(f.getColumn<&Reading::timestamp>().append(
+                  std::vector<uint32_t>{100, 101, 102}),
+              binfmt::ErrorCode::OK);
+    EXPECT_EQ(f.getRowCount(), 100);
+  }
+
+  ReadingFile f(TEST_COLUMNAR_FILE, TestBinaryHeader{},
+                {binfmt::DurabilityPolicy::OSManaged});
+  EXPECT_EQ(f.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.getColumn<&Reading::timestamp>().getEntryCount(), 100);
+  EXPECT_EQ(f.append(getReadings(100, 101)), binfmt::ErrorCode::OK);
+  Reading reading{};
+  EXPECT_TRUE(f.getEntry(100, reading));
+  EXPECT_EQ(reading.timestamp, 100);
+  EXPECT_EQ(reading.temperature, 0.0F);
+  cleanupColumnarFile(f);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ColumnarFile, testAppendRefusedAfterError) {
+  {
+    // the second column belongs to another format
+    std::ofstream out(ReadingFile::getColumnPath(TEST_COLUMNAR_FILE, 1),
+                      std::ios::binary);
+    TestBinaryHeader other(0xABC, 1, 0);
+    out.write(reinterpret_cast<const char *>(&other), sizeof(other));
+  }
+  ReadingFile f(TEST_COLUMNAR_FILE, TestBinaryHeader{},
+                {binfmt::DurabilityPolicy::OSManaged});
+  const binfmt::ErrorCode error = f.getErrorCode();
+  EXPECT_NE(error, binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.append(getReadings(0, 10)), error);
+  EXPECT_EQ(f.getColumn<&Reading::timestamp>().getEntryCount(), 0);
+  cleanupColumnarFile(f);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ColumnarFile, testRing) {
+  ReadingFile f(TEST_COLUMNAR_FILE, TestBinaryHeader(0xABC, 0, 1000),
+                {binfmt::DurabilityPolicy::OSManaged});
+  EXPECT_EQ(f.append(getReadings(0, 2400)), binfmt::ErrorCode::OK);
+  for (const auto &reading : getReadings(2400, 2500)) {
+    EXPECT_EQ(f.append(reading), binfmt::ErrorCode::OK);
+  }
+  EXPECT_EQ(f.getRowCount(), 1000);
+
+  uint32_t expected = 1500;
+  EXPECT_TRUE(f.scanColumns<&Reading::timestamp>(
+      [&expected](binfmt::Span<const uint32_t> i_Timestamps) {
+        for (uint32_t timestamp : i_Timestamps) {
+          EXPECT_EQ(timestamp, expected++);
+        }
+      },
+      0, 0, 128));
+  EXPECT_EQ(expected, 2500);
+  cleanupColumnarFile(f);
+}
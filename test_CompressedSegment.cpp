@@ -0,0 +1,210 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "CompressedSegment.h"
+#include "test_common.h"
+
+#define TEST_SEGMENT_FILE "/tmp/test.segment"
+
+struct LogEntry {
+  char message[128];
+};
+
+using LogContainer = binfmt::BinaryEntryContainer<LogEntry>;
+using LogFile = binfmt::BinaryFile<TestBinaryHeader, LogEntry, LogContainer>;
+using LogSegment =
+    binfmt::CompressedSegment<TestBinaryHeader, LogEntry, LogContainer>;
+
+LogEntry getLogEntry(uint32_t i_u32Number) {
+  LogEntry r{};
+  std::snprintf(r.message, sizeof(r.message), "message number %u",
+                i_u32Number);
+  return r;
+}
+
+std::string roundTrip(const std::string &i_Data) {
+  std::vector<char> compressed(binfmt::lz4::compressBound(i_Data.size()));
+  size_t size = binfmt::lz4::compress(i_Data.data(), i_Data.size(),
+                                      compressed.data(), compressed.size());
+  EXPECT_GT(size, 0);
+  std::string r(i_Data.size(), '\0');
+  EXPECT_TRUE(
+      binfmt::lz4::decompress(compressed.data(), size, r.data(), r.size()));
+  return r;
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(Lz4, testRoundTrip) {
+  std::mt19937 random(42); // NOLINT(cert-msc51-cpp)
+  std::string noise(100000, '\0');
+  for (auto &c : noise) {
+    c = static_cast<char>(random());
+  }
+  std::string text;
+  for (uint32_t i = 0; i < 5000; i++) {
+    text += "entry " + std::to_string(i % 97) + " of the log;";
+  }
+  for (const auto &data :
+       {std::string(), std::string("a"), std::string(12, 'x'),
+        std::string(13, 'x'), std::string("abcdabcdabcdabcd"),
+        std::string(100000, '\0'), noise, text}) {
+    EXPECT_EQ(roundTrip(data), data);
+  }
+
+  std::vector<char> compressed(binfmt::lz4::compressBound(text.size()));
+  size_t size = binfmt::lz4::compress(text.data(), text.size(),
+                                      compressed.data(), compressed.size());
+  EXPECT_LT(size, text.size() / 4);
+  // too small for the output
+  EXPECT_EQ(binfmt::lz4::compress(text.data(), text.size(), compressed.data(),
+                                  size - 1),
+            0);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(Lz4, testRejectsMalformedInput) {
+  std::string data(1000, 'z');
+  std::vector<char> compressed(binfmt::lz4::compressBound(data.size()));
+  size_t size = binfmt::lz4::compress(data.data(), data.size(),
+                                      compressed.data(), compressed.size());
+  std::string out(data.size(), '\0');
+  EXPECT_FALSE(
+      binfmt::lz4::decompress(compressed.data(), size, out.data(), 999));
+  EXPECT_FALSE(
+      binfmt::lz4::decompress(compressed.data(), size - 1, out.data(), 1000));
+  // an offset reaching before the start of the output
+  const char bad[] = {0x10, 'a', 0x05, 0x00};
+  EXPECT_FALSE(binfmt::lz4::decompress(bad, sizeof(bad), out.data(), 5));
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(CompressedSegment, testWriteAndRead) {
+  LogFile f("/tmp/test.bin", TestBinaryHeader{},
+            {binfmt::DurabilityPolicy::OSManaged});
+  std::vector<LogEntry> entries;
+  for (uint32_t i = 0; i < 10000; i++) {
+    entries.push_back(getLogEntry(i));
+  }
+  EXPECT_EQ(f.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_TRUE(LogSegment::write(f, TEST_SEGMENT_FILE, 256));
+
+  {
+    LogSegment segment(TEST_SEGMENT_FILE);
+    ASSERT_TRUE(segment.isOpen());
+    EXPECT_EQ(segment.getEntryCount(), 10000);
+    EXPECT_EQ(segment.getBlockCount(), 40);
+    EXPECT_EQ(segment.getSourceHeader().count, 10000);
+    // mostly zero padding
+    EXPECT_LT(segment.getCompressedSize() * 8, 10000 * sizeof(LogContainer));
+
+    LogContainer container;
+    for (uint32_t i : {0U, 1U, 255U, 256U, 9999U, 5000U}) {
+      EXPECT_TRUE(segment.getEntry(i, container));
+      EXPECT_TRUE(container.isEntryValid());
+      EXPECT_STREQ(container.entry.message, getLogEntry(i).message);
+    }
+    EXPECT_FALSE(segment.getEntry(10000, container));
+
+    std::vector<LogContainer> containers;
+    EXPECT_TRUE(segment.getEntries(containers, 250, 300));
+    ASSERT_EQ(containers.size(), 300);
+    EXPECT_STREQ(containers.front().entry.message, getLogEntry(250).message);
+    EXPECT_STREQ(containers.back().entry.message, getLogEntry(549).message);
+    EXPECT_FALSE(segment.getEntries(containers, 9999, 2));
+
+    // restores an identical file
+    EXPECT_TRUE(f.clear());
+    EXPECT_TRUE(segment.appendTo(f));
+    std::vector<LogContainer> restored;
+    EXPECT_TRUE(f.getAllEntries(restored));
+    ASSERT_EQ(restored.size(), 10000);
+    for (uint32_t i = 0; i < 10000; i++) {
+      EXPECT_EQ(std::memcmp(&restored[i].entry, &entries[i], sizeof(LogEntry)), 0);
+    }
+  }
+  cleanupTestFile(f);
+  cleanup(TEST_SEGMENT_FILE);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(CompressedSegment, testRingOrderAndIncompressible) {
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 1000),
+                   {binfmt::DurabilityPolicy::OSManaged});
+  std::mt19937 random(7); // NOLINT(cert-msc51-cpp)
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 1500; i++) {
+    entries.push_back(TestBinaryEntry{static_cast<uint32_t>(random())});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+  using Segment = binfmt::CompressedSegment<TestBinaryHeader, TestBinaryEntry,
+                                            TestBinaryEntryContainer>;
+  EXPECT_TRUE(Segment::write(t, TEST_SEGMENT_FILE, 300));
+
+  {
+    Segment segment(TEST_SEGMENT_FILE);
+    ASSERT_TRUE(segment.isOpen());
+    // random data hardly shrinks, but never grows
+    EXPECT_LE(segment.getCompressedSize(),
+              1000 * sizeof(TestBinaryEntryContainer));
+    EXPECT_GT(segment.getCompressedSize(),
+              900 * sizeof(TestBinaryEntryContainer));
+    std::vector<size_t> sizes;
+    uint32_t i = 500;
+    EXPECT_TRUE(segment.getEntriesChunked(
+        [&sizes, &i, &entries](
+            binfmt::Span<const TestBinaryEntryContainer> i_Block) {
+          sizes.push_back(i_Block.size());
+          for (const auto &container : i_Block) {
+            EXPECT_EQ(container.entry.m_u32Number, entries[i++].m_u32Number);
+          }
+        }));
+    EXPECT_EQ(sizes, (std::vector<size_t>{300, 300, 300, 100}));
+  }
+  cleanupTestFile(t);
+
+  // not a segment
+  {
+    std::ofstream out(TEST_SEGMENT_FILE, std::ios::binary | std::ios::trunc);
+    out << std::string(64, 'x');
+  }
+  Segment broken(TEST_SEGMENT_FILE);
+  EXPECT_EQ(broken.getErrorCode(), binfmt::ErrorCode::MAGIC_MISMATCH);
+  TestBinaryEntryContainer container;
+  EXPECT_FALSE(broken.getEntry(0, container));
+  cleanup(TEST_SEGMENT_FILE);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(CompressedSegment, testCorruptBlock) {
+  LogFile f("/tmp/test.bin", TestBinaryHeader{},
+            {binfmt::DurabilityPolicy::OSManaged});
+  std::vector<LogEntry> entries;
+  for (uint32_t i = 0; i < 1000; i++) {
+    entries.push_back(getLogEntry(i));
+  }
+  EXPECT_EQ(f.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_TRUE(LogSegment::write(f, TEST_SEGMENT_FILE, 500));
+  cleanupTestFile(f);
+
+  {
+    // scribble over the start of the first block
+    std::fstream io(TEST_SEGMENT_FILE,
+                    std::ios::in | std::ios::out | std::ios::binary);
+    io.seekp(sizeof(LogSegment::SegmentHeader) + sizeof(TestBinaryHeader));
+    io << std::string(16, '\xFF');
+  }
+  LogSegment segment(TEST_SEGMENT_FILE);
+  ASSERT_TRUE(segment.isOpen());
+  LogContainer container;
+  binfmt::ErrorCode error = binfmt::ErrorCode::OK;
+  EXPECT_FALSE(segment.getEntry(10, container, &error));
+  EXPECT_EQ(error, binfmt::ErrorCode::READ_ERROR);
+  EXPECT_TRUE(segment.getEntry(600, container));
+  EXPECT_STREQ(container.entry.message, getLogEntry(600).message);
+  cleanup(TEST_SEGMENT_FILE);
+}
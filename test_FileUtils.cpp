@@ -17,6 +17,46 @@ TEST(Checksum, testGenerate) {
   EXPECT_TRUE(c.isEntryValid());
 }
 
+// Tests
+// - Every Generate implementation agrees with the scalar loop
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(Checksum, testGenerateImplementations) {
+  std::vector<char> data(4096 + 64);
+  for (auto &c : data) {
+    c = static_cast<char>(std::rand()); // NOLINT(cert-msc50-cpp)
+  }
+  for (uint32_t length = 0; length < 300; length++) {
+    for (uint32_t offset = 0; offset < 3; offset++) {
+      auto expected = binfmt::Checksum::GenerateScalar(&data[offset], length);
+      EXPECT_EQ(binfmt::Checksum::Generate(&data[offset], length), expected);
+#ifdef BINFMT_X86_SIMD
+      EXPECT_EQ(binfmt::Checksum::GenerateSSE2(&data[offset], length), expected);
+      if (__builtin_cpu_supports("avx2")) {
+        EXPECT_EQ(binfmt::Checksum::GenerateAVX2(&data[offset], length), expected);
+      }
+#endif
+    }
+  }
+  EXPECT_EQ(binfmt::Checksum::Generate(data.data(), data.size()),
+            binfmt::Checksum::GenerateScalar(data.data(), data.size()));
+}
+
+// Tests
+// - CRC32C check value and hardware / software agreement
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(Checksum, testCRC32C) {
+  EXPECT_EQ(binfmt::Checksum::GenerateCRC32C("123456789", 9), 0xE3069283);
+  EXPECT_EQ(binfmt::Checksum::GenerateCRC32CSoftware("123456789", 9), 0xE3069283);
+  std::vector<char> data(1031);
+  for (auto &c : data) {
+    c = static_cast<char>(std::rand()); // NOLINT(cert-msc50-cpp)
+  }
+  for (uint32_t length = 0; length < data.size(); length += 7) {
+    EXPECT_EQ(binfmt::Checksum::GenerateCRC32C(data.data(), length),
+              binfmt::Checksum::GenerateCRC32CSoftware(data.data(), length));
+  }
+}
+
 // Tests
 // - CreateDirectory
 // - DeleteDirectory
@@ -165,4 +205,79 @@ TEST(FileUtils, testRemoveAt) {
                                             TestBinaryEntryContainer>(1);
   EXPECT_EQ(fs1, fs2);
   binfmt::FileUtils::DeleteFile(TEST_BINARY_FILE);
-}
\ No newline at end of file
+}
+// writes a header and the containers 0 .. i_u32Count - 1
+void createNumbered(const std::string &FilePath, uint32_t i_u32Count) {
+  EXPECT_TRUE(binfmt::FileUtils::WriteHeader(FilePath, TestBinaryHeader{}));
+  std::vector<TestBinaryEntryContainer> containers;
+  for (uint32_t i = 0; i < i_u32Count; i++) {
+    containers.emplace_back(TestBinaryEntry{i});
+  }
+  EXPECT_TRUE(binfmt::FileUtils::WriteDataVector<TestBinaryHeader>(
+      FilePath, containers));
+}
+
+std::vector<uint32_t> readNumbered(const std::string &FilePath) {
+  std::vector<TestBinaryEntryContainer> containers;
+  EXPECT_TRUE((binfmt::FileUtils::ReadData<TestBinaryHeader,
+                                           TestBinaryEntryContainer>(
+      containers, FilePath)));
+  std::vector<uint32_t> r;
+  for (const auto &container : containers) {
+    EXPECT_TRUE(container.isEntryValid());
+    r.push_back(container.entry.m_u32Number);
+  }
+  return r;
+}
+
+// Tests
+// - RemoveEntries with a position, a range and a set
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(FileUtils, testRemoveEntries) {
+  using Utils = binfmt::FileUtils;
+  createNumbered(TEST_BINARY_FILE, 10);
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, 3)));
+  EXPECT_EQ(readNumbered(TEST_BINARY_FILE),
+            (std::vector<uint32_t>{0, 1, 2, 4, 5, 6, 7, 8, 9}));
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, 1, 3)));
+  EXPECT_EQ(readNumbered(TEST_BINARY_FILE),
+            (std::vector<uint32_t>{0, 5, 6, 7, 8, 9}));
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, std::vector<uint32_t>{5, 0, 3, 2, 3, 4})));
+  EXPECT_EQ(readNumbered(TEST_BINARY_FILE), (std::vector<uint32_t>{5}));
+
+  // nothing happens if any of them is out of bounds
+  EXPECT_FALSE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, 1)));
+  EXPECT_FALSE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, 0, 2)));
+  EXPECT_FALSE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, std::vector<uint32_t>{0, 1})));
+  EXPECT_EQ(readNumbered(TEST_BINARY_FILE), (std::vector<uint32_t>{5}));
+
+  // nothing to remove is fine, like a Count of 0
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, 0, 0)));
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, std::vector<uint32_t>{})));
+  EXPECT_EQ(readNumbered(TEST_BINARY_FILE), (std::vector<uint32_t>{5}));
+  Utils::DeleteFile(TEST_BINARY_FILE);
+
+  // moves larger than the buffer
+  const uint32_t count = 2000000;
+  createNumbered(TEST_BINARY_FILE, count);
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, 10, 700000)));
+  EXPECT_TRUE((Utils::RemoveEntries<TestBinaryHeader, TestBinaryEntryContainer>(
+      TEST_BINARY_FILE, std::vector<uint32_t>{0, 5})));
+  auto numbers = readNumbered(TEST_BINARY_FILE);
+  ASSERT_EQ(numbers.size(), count - 700002);
+  EXPECT_EQ(numbers[4], 6);
+  EXPECT_EQ(numbers[8], 700010);
+  for (uint32_t i = 8; i < numbers.size(); i++) {
+    EXPECT_EQ(numbers[i], i + 700002);
+  }
+  Utils::DeleteFile(TEST_BINARY_FILE);
+}
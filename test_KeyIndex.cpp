@@ -0,0 +1,203 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <gtest/gtest.h>
+
+#include "KeyIndex.h"
+#include "test_common.h"
+
+using TestKeyIndex =
+    binfmt::KeyIndex<TestBinaryHeader, TestBinaryEntry,
+                     TestBinaryEntryContainer, uint32_t>;
+
+uint32_t getNumber(const TestBinaryEntry &i_Entry) {
+  return i_Entry.m_u32Number;
+}
+
+void appendNumbers(TestBinaryFile &f, uint32_t i_u32Begin, uint32_t i_u32End,
+                   uint32_t i_u32Step = 1) {
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    entries.push_back(TestBinaryEntry{i * i_u32Step});
+  }
+  EXPECT_EQ(f.append(entries), binfmt::ErrorCode::OK);
+}
+
+std::vector<uint32_t> getNumbers(TestKeyIndex &i_Index, uint32_t i_u32Low,
+                                 uint32_t i_u32High) {
+  std::vector<TestBinaryEntryContainer> containers;
+  EXPECT_TRUE(i_Index.getEntries(i_u32Low, i_u32High, containers));
+  std::vector<uint32_t> r;
+  for (const auto &container : containers) {
+    r.push_back(container.entry.m_u32Number);
+  }
+  return r;
+}
+
+void cleanupIndexedFile(TestBinaryFile &f, const TestKeyIndex &i_Index) {
+  auto path = i_Index.getPath();
+  cleanupTestFile(f);
+  cleanup(path);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(KeyIndex, testFindRange) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  TestKeyIndex index(t, getNumber, 64);
+  // even keys, record i holds 2 * i
+  appendNumbers(t, 0, 5000, 2);
+  for (uint32_t i = 5000; i < 5100; i++) {
+    EXPECT_EQ(t.append(TestBinaryEntry{i * 2}), binfmt::ErrorCode::OK);
+  }
+  EXPECT_EQ(index.getSampleCount(), (5100 + 63) / 64);
+  EXPECT_EQ(index.getErrorCode(), binfmt::ErrorCode::OK);
+
+  std::vector<TestKeyIndex::IndexRange> ranges;
+  EXPECT_TRUE(index.findRange(1001, 2000, ranges));
+  ASSERT_EQ(ranges.size(), 1);
+  EXPECT_LE(ranges[0].begin, 501);
+  EXPECT_GE(ranges[0].end, 1001);
+  EXPECT_LE(ranges[0].end - ranges[0].begin, 500 + 2 * 64);
+
+  auto numbers = getNumbers(index, 1001, 2000);
+  ASSERT_EQ(numbers.size(), 500);
+  EXPECT_EQ(numbers.front(), 1002);
+  EXPECT_EQ(numbers.back(), 2000);
+
+  EXPECT_EQ(getNumbers(index, 0, 0), (std::vector<uint32_t>{0}));
+  EXPECT_EQ(getNumbers(index, 10198, 20000), (std::vector<uint32_t>{10198}));
+  // the tail after the last sample is always a candidate
+  EXPECT_TRUE(getNumbers(index, 10199, 20000).empty());
+  EXPECT_FALSE(index.findRange(2000, 1000, ranges));
+  EXPECT_TRUE(getNumbers(index, 1, 1).empty());
+
+  cleanupIndexedFile(t, index);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(KeyIndex, testDuplicateKeys) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  TestKeyIndex index(t, getNumber, 8);
+  // every key shows up 20 times, spanning sample boundaries
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 1000; i++) {
+    entries.push_back(TestBinaryEntry{i / 20});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+  EXPECT_EQ(getNumbers(index, 7, 7), std::vector<uint32_t>(20, 7));
+  EXPECT_EQ(getNumbers(index, 7, 8).size(), 40);
+  cleanupIndexedFile(t, index);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(KeyIndex, testSidecarCatchUp) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  binfmt::Path path;
+  {
+    TestKeyIndex index(t, getNumber, 16);
+    appendNumbers(t, 0, 1000);
+    path = index.getPath();
+  }
+  EXPECT_EQ(std::filesystem::file_size(path),
+            sizeof(TestKeyIndex::SidecarHeader) +
+                63 * sizeof(TestKeyIndex::Sample));
+
+  // appended while no index was attached
+  appendNumbers(t, 1000, 2000);
+  {
+    TestKeyIndex index(t, getNumber, 16);
+    EXPECT_EQ(index.getSampleCount(), 125);
+    EXPECT_EQ(getNumbers(index, 1500, 1502),
+              (std::vector<uint32_t>{1500, 1501, 1502}));
+    // the last sample is record 1984
+    for (uint32_t i = 0; i < 15; i++) {
+      EXPECT_TRUE(t.removeEntryAtEnd());
+    }
+    EXPECT_EQ(index.getSampleCount(), 125);
+    EXPECT_TRUE(t.removeEntryAtEnd());
+    EXPECT_EQ(index.getSampleCount(), 124);
+  }
+
+  // refilled with other keys, the stale sidecar gets rebuilt
+  EXPECT_TRUE(t.clear());
+  appendNumbers(t, 0, 500, 3);
+  {
+    TestKeyIndex index(t, getNumber, 16);
+    EXPECT_EQ(index.getSampleCount(), 32);
+    EXPECT_EQ(getNumbers(index, 300, 306),
+              (std::vector<uint32_t>{300, 303, 306}));
+  }
+
+  // a different stride rebuilds it as well
+  {
+    TestKeyIndex index(t, getNumber, 100);
+    EXPECT_EQ(index.getSampleCount(), 5);
+    EXPECT_EQ(getNumbers(index, 1497, 2000), (std::vector<uint32_t>{1497}));
+    cleanupIndexedFile(t, index);
+  }
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(KeyIndex, testRing) {
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 100),
+                   {binfmt::DurabilityPolicy::OSManaged});
+  TestKeyIndex index(t, getNumber, 10);
+  appendNumbers(t, 0, 130);
+  for (uint32_t i = 130; i < 150; i++) {
+    EXPECT_EQ(t.appendConcurrent(TestBinaryEntryContainer(TestBinaryEntry{i})),
+              binfmt::ErrorCode::OK);
+  }
+
+  // records 50..149 are stored, 50..99 in slots 50..99, 100..149 in 0..49
+  std::vector<TestKeyIndex::IndexRange> ranges;
+  EXPECT_TRUE(index.findRange(0, 200, ranges));
+  ASSERT_EQ(ranges.size(), 2);
+  EXPECT_EQ(ranges[0].begin, 50);
+  EXPECT_EQ(ranges[0].end, 100);
+  EXPECT_EQ(ranges[1].begin, 0);
+  EXPECT_EQ(ranges[1].end, 50);
+
+  auto numbers = getNumbers(index, 0, 200);
+  ASSERT_EQ(numbers.size(), 100);
+  EXPECT_EQ(numbers.front(), 50);
+  EXPECT_EQ(numbers.back(), 149);
+  EXPECT_EQ(getNumbers(index, 95, 104),
+            (std::vector<uint32_t>{95, 96, 97, 98, 99, 100, 101, 102, 103,
+                                   104}));
+  EXPECT_TRUE(getNumbers(index, 0, 49).empty());
+
+  cleanupIndexedFile(t, index);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(KeyIndex, testRingDropsOverwrittenSamples) {
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 100),
+                   {binfmt::DurabilityPolicy::OSManaged});
+  binfmt::Path path;
+  {
+    TestKeyIndex index(t, getNumber, 10);
+    path = index.getPath();
+    // wraps the ring a hundred times
+    for (uint32_t i = 0; i < 10000; i += 7) {
+      appendNumbers(t, i, std::min(i + 7, 10000U));
+      EXPECT_LE(index.getSampleCount(), 21);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path),
+              sizeof(TestKeyIndex::SidecarHeader) +
+                  index.getSampleCount() * sizeof(TestKeyIndex::Sample));
+    EXPECT_EQ(getNumbers(index, 9895, 9905),
+              (std::vector<uint32_t>{9900, 9901, 9902, 9903, 9904, 9905}));
+    EXPECT_TRUE(getNumbers(index, 0, 9899).empty());
+  }
+
+  // and on open
+  appendNumbers(t, 10000, 10500);
+  TestKeyIndex index(t, getNumber, 10);
+  EXPECT_LE(index.getSampleCount(), 21);
+  auto numbers = getNumbers(index, 0, 20000);
+  ASSERT_EQ(numbers.size(), 100);
+  EXPECT_EQ(numbers.front(), 10400);
+  EXPECT_EQ(numbers.back(), 10499);
+  cleanupIndexedFile(t, index);
+}
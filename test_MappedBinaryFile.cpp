@@ -0,0 +1,60 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <gtest/gtest.h>
+
+#include "MappedBinaryFile.h"
+#include "test_common.h"
+
+using TestMappedBinaryFile =
+    binfmt::MappedBinaryFile<TestBinaryHeader, TestBinaryEntry,
+                             TestBinaryEntryContainer>;
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(MappedBinaryFile, testViewMatchesRead) {
+  TestMappedBinaryFile t("/tmp/test.bin", TestBinaryHeader{});
+  EXPECT_EQ(t.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_TRUE(t.getAllEntriesView().empty());
+  auto ae = appendExactAmountOfEntriesV(t, 100);
+
+  auto view = t.getAllEntriesView();
+  EXPECT_EQ(view.size(), 100);
+  std::vector<TestBinaryEntryContainer> entries;
+  EXPECT_TRUE(t.getAllEntries(entries));
+  for (uint32_t i = 0; i < ae.size(); i++) {
+    EXPECT_EQ(view[i].checksum, ae[i].checksum);
+    EXPECT_EQ(view[i].entry.m_u32Number, entries[i].entry.m_u32Number);
+  }
+
+  auto range = t.getEntriesView(10, 5);
+  EXPECT_EQ(range.size(), 5);
+  EXPECT_EQ(range[0].checksum, ae[10].checksum);
+  EXPECT_TRUE(t.getEntriesView(99, 2).empty());
+  EXPECT_EQ(t.getEntryView(100), nullptr);
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(MappedBinaryFile, testRemapAfterAppend) {
+  TestMappedBinaryFile t("/tmp/test.bin", TestBinaryHeader{},
+                         {binfmt::DurabilityPolicy::OSManaged});
+  appendExactAmountOfEntriesV(t, 10);
+  EXPECT_EQ(t.getAllEntriesView().size(), 10);
+
+  // grow well past the first mapping, which only covered a single page
+  std::vector<TestBinaryEntryContainer> more(10000);
+  for (uint32_t i = 0; i < more.size(); i++) {
+    more[i] = TestBinaryEntryContainer(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(more), binfmt::ErrorCode::OK);
+
+  auto view = t.getAllEntriesView();
+  EXPECT_EQ(view.size(), 10010);
+  EXPECT_EQ(view.back().entry.m_u32Number, 9999);
+  EXPECT_TRUE(view.back().isEntryValid());
+  const auto *entry = t.getEntryView(10 + 1234);
+  EXPECT_NE(entry, nullptr);
+  EXPECT_EQ(entry->entry.m_u32Number, 1234);
+  cleanupTestFile(t);
+}
@@ -0,0 +1,186 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "SegmentedBinaryFile.h"
+#include "test_common.h"
+
+#define TEST_SEGMENTED_DIRECTORY "/tmp/test.segments"
+
+using TestSegmentedFile =
+    binfmt::SegmentedBinaryFile<TestBinaryHeader, TestBinaryEntry,
+                                TestBinaryEntryContainer>;
+
+binfmt::SegmentOptions getSegmentOptions(uint32_t i_u32MaxEntries) {
+  binfmt::SegmentOptions r;
+  r.maxEntries = i_u32MaxEntries;
+  r.fileOptions.durability = binfmt::DurabilityPolicy::OSManaged;
+  return r;
+}
+
+std::vector<TestBinaryEntry> getSequence(uint32_t i_u32Begin,
+                                         uint32_t i_u32End) {
+  std::vector<TestBinaryEntry> r;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    r.push_back(TestBinaryEntry{i});
+  }
+  return r;
+}
+
+std::vector<uint64_t>
+getFirstSequences(const std::vector<TestSegmentedFile::SegmentInfo> &i_Segments) {
+  std::vector<uint64_t> r;
+  for (const auto &segment : i_Segments) {
+    r.push_back(segment.firstSequence);
+  }
+  return r;
+}
+
+void cleanupSegmentedFile(TestSegmentedFile &f) {
+  EXPECT_TRUE(f.deleteFiles());
+  EXPECT_FALSE(std::filesystem::exists(TEST_SEGMENTED_DIRECTORY));
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SegmentedBinaryFile, testRollAndRead) {
+  TestSegmentedFile f(TEST_SEGMENTED_DIRECTORY, TestBinaryHeader{},
+                      getSegmentOptions(1000));
+  ASSERT_EQ(f.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.append(getSequence(0, 2500)), binfmt::ErrorCode::OK);
+  for (const auto &entry : getSequence(2500, 2510)) {
+    EXPECT_EQ(f.append(entry), binfmt::ErrorCode::OK);
+  }
+  EXPECT_EQ(f.getNextSequence(), 2510);
+  EXPECT_EQ(getFirstSequences(f.getSegments()),
+            (std::vector<uint64_t>{0, 1000, 2000}));
+  EXPECT_EQ(f.getSegments()[1].count, 1000);
+  EXPECT_TRUE(std::filesystem::exists(f.getSegmentPath(1000)));
+
+  TestBinaryEntryContainer container;
+  for (uint32_t sequence : {0U, 999U, 1000U, 1999U, 2509U}) {
+    EXPECT_TRUE(f.getEntry(sequence, container));
+    EXPECT_EQ(container.entry.m_u32Number, sequence);
+  }
+  EXPECT_FALSE(f.getEntry(2510, container));
+
+  std::vector<TestBinaryEntryContainer> containers;
+  EXPECT_TRUE(f.getEntries(containers, 950, 1100));
+  ASSERT_EQ(containers.size(), 1100);
+  for (uint32_t i = 0; i < containers.size(); i++) {
+    EXPECT_EQ(containers[i].entry.m_u32Number, 950 + i);
+  }
+  EXPECT_FALSE(f.getEntries(containers, 2500, 11));
+
+  // an empty active segment is not sealed
+  EXPECT_TRUE(f.seal());
+  EXPECT_TRUE(f.seal());
+  EXPECT_EQ(getFirstSequences(f.getSegments()),
+            (std::vector<uint64_t>{0, 1000, 2000, 2510}));
+  cleanupSegmentedFile(f);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SegmentedBinaryFile, testReopen) {
+  auto options = getSegmentOptions(0);
+  options.maxBytes = sizeof(TestBinaryHeader) +
+                     100 * sizeof(TestBinaryEntryContainer) + 3;
+  {
+    TestSegmentedFile f(TEST_SEGMENTED_DIRECTORY, TestBinaryHeader{}, options);
+    EXPECT_EQ(f.append(getSequence(0, 250)), binfmt::ErrorCode::OK);
+    EXPECT_EQ(getFirstSequences(f.getSegments()),
+              (std::vector<uint64_t>{0, 100, 200}));
+    EXPECT_EQ(std::filesystem::file_size(f.getSegmentPath(0)),
+              sizeof(TestBinaryHeader) + 100 * sizeof(TestBinaryEntryContainer));
+  }
+
+  TestSegmentedFile f(TEST_SEGMENTED_DIRECTORY, TestBinaryHeader{}, options);
+  ASSERT_EQ(f.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(f.getNextSequence(), 250);
+  EXPECT_EQ(f.append(getSequence(250, 320)), binfmt::ErrorCode::OK);
+  EXPECT_EQ(getFirstSequences(f.getSegments()),
+            (std::vector<uint64_t>{0, 100, 200, 300}));
+  std::vector<TestBinaryEntryContainer> containers;
+  EXPECT_TRUE(f.getEntries(containers, 0, 320));
+  for (uint32_t i = 0; i < containers.size(); i++) {
+    EXPECT_EQ(containers[i].entry.m_u32Number, i);
+  }
+  cleanupSegmentedFile(f);
+
+  // not a manifest
+  std::filesystem::create_directories(TEST_SEGMENTED_DIRECTORY);
+  {
+    std::ofstream out(TEST_SEGMENTED_DIRECTORY "/manifest", std::ios::binary);
+    out << std::string(64, 'x');
+  }
+  TestSegmentedFile broken(TEST_SEGMENTED_DIRECTORY, TestBinaryHeader{},
+                           options);
+  EXPECT_EQ(broken.getErrorCode(), binfmt::ErrorCode::MAGIC_MISMATCH);
+  EXPECT_EQ(broken.append(TestBinaryEntry{1}),
+            binfmt::ErrorCode::MAGIC_MISMATCH);
+  std::filesystem::remove_all(TEST_SEGMENTED_DIRECTORY);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SegmentedBinaryFile, testScanSealedWhileAppending) {
+  TestSegmentedFile f(TEST_SEGMENTED_DIRECTORY, TestBinaryHeader{},
+                      getSegmentOptions(1000));
+  EXPECT_EQ(f.append(getSequence(0, 8500)), binfmt::ErrorCode::OK);
+
+  std::atomic<bool> bStop{false};
+  std::thread appender([&f, &bStop] {
+    uint32_t sequence = 8500;
+    while (!bStop) {
+      EXPECT_EQ(f.append(TestBinaryEntry{sequence++}), binfmt::ErrorCode::OK);
+    }
+  });
+
+  std::mutex mutex;
+  std::vector<uint32_t> seen;
+  EXPECT_TRUE(f.scanSealed(
+      [&mutex, &seen](uint64_t i_u64First,
+                      binfmt::Span<const TestBinaryEntryContainer> i_Chunk) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < i_Chunk.size(); i++) {
+          EXPECT_EQ(i_Chunk[i].entry.m_u32Number, i_u64First + i);
+          seen.push_back(i_Chunk[i].entry.m_u32Number);
+        }
+      },
+      4, 300));
+  bStop = true;
+  appender.join();
+
+  // at least the 8 segments sealed before the scan started
+  std::sort(seen.begin(), seen.end());
+  ASSERT_GE(seen.size(), 8000);
+  EXPECT_EQ(seen.size() % 1000, 0);
+  for (uint32_t i = 0; i < seen.size(); i++) {
+    EXPECT_EQ(seen[i], i);
+  }
+  cleanupSegmentedFile(f);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SegmentedBinaryFile, testDropSegmentsBefore) {
+  TestSegmentedFile f(TEST_SEGMENTED_DIRECTORY, TestBinaryHeader{},
+                      getSegmentOptions(1000));
+  EXPECT_EQ(f.append(getSequence(0, 3500)), binfmt::ErrorCode::OK);
+  EXPECT_TRUE(f.dropSegmentsBefore(2100));
+  EXPECT_EQ(f.getFirstSequence(), 2000);
+  EXPECT_FALSE(std::filesystem::exists(f.getSegmentPath(0)));
+  EXPECT_FALSE(std::filesystem::exists(f.getSegmentPath(1000)));
+  TestBinaryEntryContainer container;
+  EXPECT_FALSE(f.getEntry(1999, container));
+  EXPECT_TRUE(f.getEntry(2000, container));
+  EXPECT_EQ(container.entry.m_u32Number, 2000);
+
+  // never the active segment
+  EXPECT_TRUE(f.dropSegmentsBefore(10000));
+  EXPECT_EQ(getFirstSequences(f.getSegments()), (std::vector<uint64_t>{3000}));
+  EXPECT_EQ(f.getNextSequence(), 3500);
+  cleanupSegmentedFile(f);
+}
@@ -0,0 +1,70 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "SequentialReader.h"
+#include "test_common.h"
+
+using TestSequentialReader =
+    binfmt::SequentialReader<TestBinaryHeader, TestBinaryEntry,
+                             TestBinaryEntryContainer>;
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SequentialReader, testReadsRangeInOrder) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = 0; i < 1000; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(t.append(entries), binfmt::ErrorCode::OK);
+
+  {
+    TestSequentialReader reader(t, 0, 0, 64);
+    uint32_t expected = 0;
+    const TestBinaryEntryContainer *previous = nullptr;
+    std::set<const TestBinaryEntryContainer *> buffers;
+    for (auto chunk = reader.next(); !chunk.empty(); chunk = reader.next()) {
+      EXPECT_NE(chunk.data(), previous);
+      previous = chunk.data();
+      buffers.insert(chunk.data());
+      for (const auto &container : chunk) {
+        EXPECT_TRUE(container.isEntryValid());
+        EXPECT_EQ(container.entry.m_u32Number, expected++);
+      }
+    }
+    EXPECT_EQ(expected, 1000);
+    // the two buffers are reused for the whole scan
+    EXPECT_EQ(buffers.size(), 2);
+    EXPECT_TRUE(reader.next().empty());
+  }
+
+  {
+    TestSequentialReader reader(t, 100, 350, 100);
+    std::vector<size_t> sizes;
+    EXPECT_TRUE(reader.forEach([&sizes](binfmt::Span<const TestBinaryEntryContainer> i_Chunk) {
+      sizes.push_back(i_Chunk.size());
+    }));
+    EXPECT_EQ(sizes, (std::vector<size_t>{100, 100, 50}));
+  }
+
+  {
+    // stopping early joins the reader
+    TestSequentialReader reader(t, 0, 0, 10);
+    EXPECT_EQ(reader.next().size(), 10);
+  }
+  cleanupTestFile(t);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(SequentialReader, testEmptyFile) {
+  auto t = getRandomTestFile();
+  TestSequentialReader reader(t);
+  binfmt::ErrorCode r = binfmt::ErrorCode::OK;
+  EXPECT_TRUE(reader.next(&r).empty());
+  EXPECT_EQ(r, binfmt::ErrorCode::OK);
+  cleanupTestFile(t);
+}
@@ -0,0 +1,331 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "CompressedSegment.h"
+#include "SequentialReader.h"
+#include "TombstoneMap.h"
+#include "test_common.h"
+
+using TestTombstoneMap =
+    binfmt::TombstoneMap<TestBinaryHeader, TestBinaryEntry,
+                         TestBinaryEntryContainer>;
+
+void appendNumbers(TestBinaryFile &f, uint32_t i_u32Begin, uint32_t i_u32End) {
+  std::vector<TestBinaryEntry> entries;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    entries.push_back(TestBinaryEntry{i});
+  }
+  EXPECT_EQ(f.append(entries), binfmt::ErrorCode::OK);
+}
+
+std::vector<uint32_t> getLiveNumbers(TestBinaryFile &f) {
+  std::vector<TestBinaryEntryContainer> containers;
+  EXPECT_TRUE(f.getAllEntries(containers));
+  std::vector<uint32_t> r;
+  for (const auto &container : containers) {
+    EXPECT_TRUE(container.isEntryValid());
+    r.push_back(container.entry.m_u32Number);
+  }
+  return r;
+}
+
+std::vector<uint32_t> getExpectedNumbers(uint32_t i_u32Begin,
+                                         uint32_t i_u32End,
+                                         uint32_t i_u32RemovedEvery) {
+  std::vector<uint32_t> r;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    if (i % i_u32RemovedEvery != 0) {
+      r.push_back(i);
+    }
+  }
+  return r;
+}
+
+void cleanupTombstonedFile(TestBinaryFile &f, const TestTombstoneMap &i_Map) {
+  auto path = i_Map.getPath();
+  cleanupTestFile(f);
+  cleanup(path);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testRemoveAndReopen) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  {
+    TestTombstoneMap map(t);
+    ASSERT_EQ(map.getErrorCode(), binfmt::ErrorCode::OK);
+    appendNumbers(t, 0, 1000);
+    EXPECT_TRUE(map.remove(5));
+    EXPECT_TRUE(map.remove({100, 200, 300, 100}));
+    EXPECT_FALSE(map.remove({10, 1000}));
+    EXPECT_FALSE(map.isRemoved(10));
+    EXPECT_TRUE(map.isRemoved(200));
+    EXPECT_EQ(map.getRemovedCount(), 4);
+    EXPECT_EQ(map.getLiveCount(), 996);
+
+    TestBinaryEntryContainer container;
+    binfmt::ErrorCode r = binfmt::ErrorCode::OK;
+    EXPECT_FALSE(t.getEntry(100, container, &r));
+    EXPECT_EQ(r, binfmt::ErrorCode::ENTRY_REMOVED);
+    EXPECT_TRUE(t.getEntry(101, container));
+    EXPECT_EQ(container.entry.m_u32Number, 101);
+    // the raw reads still see it
+    EXPECT_TRUE(t.getEntriesInto(binfmt::Span<TestBinaryEntryContainer>(
+                                     &container, 1),
+                                 100));
+    EXPECT_EQ(container.entry.m_u32Number, 100);
+
+    std::vector<TestBinaryEntryContainer> containers;
+    EXPECT_TRUE(t.getEntriesFrom(containers, 195, 10));
+    EXPECT_EQ(containers.size(), 9);
+    EXPECT_EQ(containers[5].entry.m_u32Number, 201);
+    EXPECT_FALSE(t.getEntriesFrom(containers, 995, 10));
+    EXPECT_FALSE(t.getEntries({99, 100}, containers, &r));
+    EXPECT_EQ(r, binfmt::ErrorCode::ENTRY_REMOVED);
+
+    uint64_t sum = 0;
+    EXPECT_TRUE(t.mapReduce(
+        sum,
+        [](binfmt::Span<const TestBinaryEntryContainer> i_Containers) {
+          uint64_t r = 0;
+          for (const auto &container : i_Containers) {
+            r += container.entry.m_u32Number;
+          }
+          return r;
+        },
+        [](uint64_t a, uint64_t b) { return a + b; }, 0, 0, 64));
+    EXPECT_EQ(sum, 999 * 1000 / 2 - 5 - 100 - 200 - 300);
+    EXPECT_TRUE(map.flush());
+  }
+
+  // the bits of truncated containers do not come back
+  EXPECT_TRUE(t.removeEntriesAtEnd(700));
+  TestTombstoneMap map(t);
+  EXPECT_EQ(map.getErrorCode(), binfmt::ErrorCode::OK);
+  EXPECT_EQ(map.getRemovedCount(), 3);
+  EXPECT_TRUE(map.isRemoved(200));
+  EXPECT_FALSE(map.isRemoved(300));
+  auto numbers = getLiveNumbers(t);
+  EXPECT_EQ(numbers.size(), 297);
+  EXPECT_EQ(std::count(numbers.begin(), numbers.end(), 200), 0);
+  EXPECT_EQ(numbers.back(), 299);
+  cleanupTombstonedFile(t, map);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testReadersSkipRemoved) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  TestTombstoneMap map(t);
+  appendNumbers(t, 0, 1000);
+  std::vector<uint32_t> indices;
+  // every container of the chunk [64, 128) and every fifth one
+  for (uint32_t i = 0; i < 1000; i++) {
+    if (i % 5 == 0 || (i >= 64 && i < 128)) {
+      indices.push_back(i);
+    }
+  }
+  EXPECT_TRUE(map.remove(indices));
+  auto expected = getLiveNumbers(t);
+  ASSERT_EQ(expected.size(), map.getLiveCount());
+
+  std::vector<uint32_t> numbers;
+  binfmt::SequentialReader<TestBinaryHeader, TestBinaryEntry,
+                           TestBinaryEntryContainer>
+      reader(t, 0, 0, 64);
+  EXPECT_TRUE(reader.forEach(
+      [&numbers](binfmt::Span<const TestBinaryEntryContainer> i_Chunk) {
+        EXPECT_FALSE(i_Chunk.empty());
+        for (const auto &container : i_Chunk) {
+          numbers.push_back(container.entry.m_u32Number);
+        }
+      }));
+  EXPECT_EQ(numbers, expected);
+
+  // the blocks of a segment stay full
+  using Segment = binfmt::CompressedSegment<TestBinaryHeader, TestBinaryEntry,
+                                            TestBinaryEntryContainer>;
+  auto segmentPath = t.getPath().string() + ".segment";
+  EXPECT_TRUE(Segment::write(t, segmentPath, 64));
+  {
+    Segment segment(segmentPath);
+    ASSERT_TRUE(segment.isOpen());
+    EXPECT_EQ(segment.getEntryCount(), expected.size());
+    std::vector<TestBinaryEntryContainer> containers;
+    EXPECT_TRUE(segment.getEntries(containers, 0, expected.size()));
+    ASSERT_EQ(containers.size(), expected.size());
+    for (size_t i = 0; i < containers.size(); i++) {
+      EXPECT_EQ(containers[i].entry.m_u32Number, expected[i]);
+    }
+  }
+  cleanup(segmentPath);
+  cleanupTombstonedFile(t, map);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testCompact) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  TestTombstoneMap map(t);
+  appendNumbers(t, 0, 10000);
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 10000; i += 7) {
+    indices.push_back(i);
+  }
+  // the whole tail, so the last step is a truncate
+  for (uint32_t i = 9990; i < 10000; i++) {
+    indices.push_back(i);
+  }
+  EXPECT_TRUE(map.remove(indices));
+  auto expected = getLiveNumbers(t);
+  ASSERT_EQ(expected.size(), map.getLiveCount());
+
+  uint32_t steps = 0;
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (map.getRemovedCount() > 0 && steps < 100000) {
+    EXPECT_TRUE(map.compact(64));
+    EXPECT_EQ(getLiveNumbers(t), expected);
+    steps++;
+  }
+  EXPECT_EQ(map.getRemovedCount(), 0);
+  EXPECT_EQ(t.getEntryCount(), expected.size());
+  EXPECT_EQ(t.getFileSize(),
+            t.getHeaderSize() +
+                expected.size() * sizeof(TestBinaryEntryContainer));
+  std::vector<TestBinaryEntryContainer> containers;
+  EXPECT_TRUE(t.getAllEntries(containers));
+  ASSERT_EQ(containers.size(), expected.size());
+  for (size_t i = 0; i < containers.size(); i++) {
+    EXPECT_EQ(containers[i].entry.m_u32Number, expected[i]);
+  }
+  // nothing left to do
+  EXPECT_TRUE(map.compact());
+  EXPECT_EQ(map.getErrorCode(), binfmt::ErrorCode::OK);
+  cleanupTombstonedFile(t, map);
+}
+
+struct CountingObserver : binfmt::AppendObserver<TestBinaryEntryContainer> {
+  uint64_t count = 0;
+
+  void onAppended(uint64_t /*i_u64FirstRecord*/,
+                  binfmt::Span<const TestBinaryEntryContainer> i_Containers)
+      override {
+    count += i_Containers.size();
+  }
+};
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testCompactWithOtherObserver) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  TestTombstoneMap map(t);
+  CountingObserver observer;
+  t.addAppendObserver(&observer);
+  appendNumbers(t, 0, 10);
+  EXPECT_TRUE(map.remove({0, 1}));
+  // moving containers would go unnoticed by the observer
+  EXPECT_FALSE(map.compact());
+  EXPECT_EQ(map.getRemovedCount(), 2);
+  t.removeAppendObserver(&observer);
+  EXPECT_TRUE(map.compact());
+  EXPECT_EQ(observer.count, 10);
+  cleanupTombstonedFile(t, map);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testCrashDuringCompact) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  auto path = t.getPath().string() + ".tomb";
+  {
+    TestTombstoneMap map(t);
+    appendNumbers(t, 0, 10);
+    EXPECT_TRUE(map.remove({0, 1}));
+    EXPECT_TRUE(map.flush());
+    std::filesystem::copy_file(path, path + ".before");
+    // the two removed slots take 2 and 3, the rest stays where it is
+    EXPECT_TRUE(map.compact());
+    EXPECT_EQ(getLiveNumbers(t),
+              (std::vector<uint32_t>{2, 3, 4, 5, 6, 7, 8, 9}));
+  }
+
+  // the moved containers are synced, their bits are not
+  std::filesystem::rename(path + ".before", path);
+  TestTombstoneMap map(t);
+  EXPECT_EQ(map.getRemovedCount(), 2);
+  EXPECT_EQ(getLiveNumbers(t),
+            (std::vector<uint32_t>{2, 3, 4, 5, 6, 7, 8, 9}));
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (map.getRemovedCount() > 0) {
+    ASSERT_TRUE(map.compact());
+  }
+  EXPECT_EQ(getLiveNumbers(t),
+            (std::vector<uint32_t>{2, 3, 4, 5, 6, 7, 8, 9}));
+  EXPECT_EQ(t.getEntryCount(), 8);
+  cleanupTombstonedFile(t, map);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testCompactWhileAppending) {
+  auto t = getRandomTestFile({binfmt::DurabilityPolicy::OSManaged});
+  TestTombstoneMap map(t);
+  appendNumbers(t, 0, 5000);
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < 5000; i += 3) {
+    indices.push_back(i);
+  }
+  EXPECT_TRUE(map.remove(indices));
+
+  // the gap moves towards the end with every step, it only closes once
+  // compaction outpaces the appends
+  std::thread appender([&t] {
+    // NOLINTNEXTLINE(altera-unroll-loops)
+    for (uint32_t i = 5000; i < 20000; i++) {
+      EXPECT_EQ(t.append(TestBinaryEntry{i}), binfmt::ErrorCode::OK);
+    }
+  });
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (map.getRemovedCount() > 0) {
+    ASSERT_TRUE(map.compact(100));
+  }
+  appender.join();
+  // NOLINTNEXTLINE(altera-unroll-loops,altera-id-dependent-backward-branch)
+  while (map.getRemovedCount() > 0) {
+    ASSERT_TRUE(map.compact(100));
+  }
+
+  // every live number once, in append order
+  std::vector<uint32_t> expected = getExpectedNumbers(0, 5000, 3);
+  for (uint32_t i = 5000; i < 20000; i++) {
+    expected.push_back(i);
+  }
+  EXPECT_EQ(getLiveNumbers(t), expected);
+  EXPECT_EQ(t.getEntryCount(), expected.size());
+  cleanupTombstonedFile(t, map);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(TombstoneMap, testRing) {
+  TestBinaryFile t("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 100),
+                   {binfmt::DurabilityPolicy::OSManaged});
+  TestTombstoneMap map(t);
+  appendNumbers(t, 0, 150);
+  // physical 60 holds 60, physical 10 holds 110
+  EXPECT_TRUE(map.remove({60, 10}));
+  EXPECT_FALSE(map.compact());
+  auto numbers = getLiveNumbers(t);
+  ASSERT_EQ(numbers.size(), 98);
+  EXPECT_EQ(numbers.front(), 50);
+  EXPECT_EQ(std::count(numbers.begin(), numbers.end(), 60), 0);
+  EXPECT_EQ(std::count(numbers.begin(), numbers.end(), 110), 0);
+
+  // overwriting physical 60 brings it back
+  appendNumbers(t, 150, 161);
+  EXPECT_FALSE(map.isRemoved(60));
+  EXPECT_TRUE(map.isRemoved(10));
+  EXPECT_EQ(map.getRemovedCount(), 1);
+  TestBinaryEntryContainer container;
+  EXPECT_TRUE(t.getEntry(60, container));
+  EXPECT_EQ(container.entry.m_u32Number, 160);
+  cleanupTombstonedFile(t, map);
+}
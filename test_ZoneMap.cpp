@@ -0,0 +1,190 @@
+//
+// Created by nbdy on 15.10.26.
+//
+
+#include <gtest/gtest.h>
+
+#include "ZoneMap.h"
+#include "test_common.h"
+
+struct SensorEntry {
+  float temperature;
+  uint32_t timestamp;
+};
+
+using SensorContainer = binfmt::BinaryEntryContainer<SensorEntry>;
+using SensorFile =
+    binfmt::BinaryFile<TestBinaryHeader, SensorEntry, SensorContainer>;
+using SensorZoneMap =
+    binfmt::ZoneMap<TestBinaryHeader, SensorEntry, SensorContainer,
+                    &SensorEntry::temperature, &SensorEntry::timestamp>;
+
+// 20 degrees, except for the records in [i_u32HotBegin, i_u32HotEnd)
+std::vector<SensorEntry> getReadings(uint32_t i_u32Begin, uint32_t i_u32End,
+                                     uint32_t i_u32HotBegin = 0,
+                                     uint32_t i_u32HotEnd = 0) {
+  std::vector<SensorEntry> r;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    bool bHot = i >= i_u32HotBegin && i < i_u32HotEnd;
+    r.push_back(SensorEntry{bHot ? 80.0F : 20.0F + (i % 7), i});
+  }
+  return r;
+}
+
+std::vector<uint32_t> getHotTimestamps(SensorZoneMap &i_Map,
+                                       uint64_t *o_pBlocksRead = nullptr) {
+  std::vector<uint32_t> r;
+  EXPECT_TRUE(i_Map.scan(
+      SensorZoneMap::above<&SensorEntry::temperature>(50.0F),
+      [&r](binfmt::Span<const SensorContainer> i_Block) {
+        for (const auto &container : i_Block) {
+          if (container.entry.temperature > 50.0F) {
+            r.push_back(container.entry.timestamp);
+          }
+        }
+      },
+      o_pBlocksRead));
+  return r;
+}
+
+std::vector<uint32_t> getTimestamps(uint32_t i_u32Begin, uint32_t i_u32End) {
+  std::vector<uint32_t> r;
+  for (uint32_t i = i_u32Begin; i < i_u32End; i++) {
+    r.push_back(i);
+  }
+  return r;
+}
+
+void cleanupZoneMappedFile(SensorFile &f, const SensorZoneMap &i_Map) {
+  auto path = i_Map.getPath();
+  cleanupTestFile(f);
+  cleanup(path);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ZoneMap, testSkipsBlocks) {
+  SensorFile f("/tmp/test.bin", TestBinaryHeader{},
+               {binfmt::DurabilityPolicy::OSManaged});
+  SensorZoneMap map(f, 100);
+  EXPECT_EQ(f.append(getReadings(0, 9950, 4210, 4230)),
+            binfmt::ErrorCode::OK);
+  for (const auto &entry : getReadings(9950, 10000, 9990, 9991)) {
+    EXPECT_EQ(f.append(entry), binfmt::ErrorCode::OK);
+  }
+  EXPECT_EQ(map.getErrorCode(), binfmt::ErrorCode::OK);
+
+  uint64_t blocksRead = 0;
+  auto expected = getTimestamps(4210, 4230);
+  expected.push_back(9990);
+  EXPECT_EQ(getHotTimestamps(map, &blocksRead), expected);
+  EXPECT_EQ(blocksRead, 2);
+
+  // nothing is that cold
+  EXPECT_TRUE(map.scan(SensorZoneMap::below<&SensorEntry::temperature>(10.0F),
+                       [](binfmt::Span<const SensorContainer>) { FAIL(); },
+                       &blocksRead));
+  EXPECT_EQ(blocksRead, 0);
+
+  std::vector<SensorContainer> containers;
+  EXPECT_TRUE(map.getEntries(
+      SensorZoneMap::between<&SensorEntry::timestamp>(250U, 349U),
+      [](const SensorEntry &i_Entry) {
+        return i_Entry.timestamp >= 250 && i_Entry.timestamp <= 349;
+      },
+      containers));
+  ASSERT_EQ(containers.size(), 100);
+  EXPECT_EQ(containers.front().entry.timestamp, 250);
+  EXPECT_EQ(containers.back().entry.timestamp, 349);
+
+  cleanupZoneMappedFile(f, map);
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ZoneMap, testSidecarCatchUp) {
+  SensorFile f("/tmp/test.bin", TestBinaryHeader{},
+               {binfmt::DurabilityPolicy::OSManaged});
+  binfmt::Path path;
+  {
+    SensorZoneMap map(f, 64);
+    EXPECT_EQ(f.append(getReadings(0, 1000, 100, 110)), binfmt::ErrorCode::OK);
+    path = map.getPath();
+  }
+  EXPECT_EQ(std::filesystem::file_size(path),
+            sizeof(SensorZoneMap::SidecarHeader) +
+                16 * sizeof(SensorZoneMap::Zone));
+
+  // appended while no zone map was attached, fills the partial last block
+  EXPECT_EQ(f.append(getReadings(1000, 2000, 1500, 1501)),
+            binfmt::ErrorCode::OK);
+  {
+    SensorZoneMap map(f, 64);
+    uint64_t blocksRead = 0;
+    auto expected = getTimestamps(100, 110);
+    expected.push_back(1500);
+    EXPECT_EQ(getHotTimestamps(map, &blocksRead), expected);
+    EXPECT_EQ(blocksRead, 2);
+
+    // the last block gets summarized again without the removed entry
+    EXPECT_EQ(f.append(getReadings(2000, 2001, 2000, 2001)),
+              binfmt::ErrorCode::OK);
+    EXPECT_EQ(getHotTimestamps(map, &blocksRead).back(), 2000);
+    EXPECT_EQ(blocksRead, 3);
+    EXPECT_TRUE(f.removeEntryAtEnd());
+    EXPECT_EQ(getHotTimestamps(map, &blocksRead), expected);
+    EXPECT_EQ(blocksRead, 2);
+  }
+
+  // refilled with other readings while detached, the last block gives the
+  // stale sidecar away and it gets rebuilt
+  EXPECT_TRUE(f.clear());
+  EXPECT_EQ(f.append(getReadings(0, 1024, 1020, 1024)), binfmt::ErrorCode::OK);
+  {
+    SensorZoneMap map(f, 64);
+    uint64_t blocksRead = 0;
+    EXPECT_EQ(getHotTimestamps(map, &blocksRead), getTimestamps(1020, 1024));
+    EXPECT_EQ(blocksRead, 1);
+  }
+
+  // as does a different block size
+  {
+    SensorZoneMap map(f, 500);
+    uint64_t blocksRead = 0;
+    EXPECT_EQ(getHotTimestamps(map, &blocksRead), getTimestamps(1020, 1024));
+    EXPECT_EQ(blocksRead, 1);
+    EXPECT_TRUE(f.clear());
+    EXPECT_TRUE(getHotTimestamps(map, &blocksRead).empty());
+    EXPECT_EQ(blocksRead, 0);
+    cleanupZoneMappedFile(f, map);
+  }
+}
+
+// NOLINTNEXTLINE(cert-err58-cpp)
+TEST(ZoneMap, testRing) {
+  SensorFile f("/tmp/test.bin", TestBinaryHeader(0xABC, 0, 1000),
+               {binfmt::DurabilityPolicy::OSManaged});
+  SensorZoneMap map(f, 100);
+  // the hot records 100..149 get overwritten
+  EXPECT_EQ(f.append(getReadings(0, 2500, 100, 150)), binfmt::ErrorCode::OK);
+  for (const auto &entry : getReadings(2500, 2550, 2520, 2530)) {
+    EXPECT_EQ(f.appendConcurrent(entry), binfmt::ErrorCode::OK);
+  }
+  EXPECT_EQ(f.append(getReadings(2550, 2560, 2555, 2556)),
+            binfmt::ErrorCode::OK);
+
+  // records 1560..2559 are stored
+  uint64_t blocksRead = 0;
+  auto expected = getTimestamps(2520, 2530);
+  expected.push_back(2555);
+  EXPECT_EQ(getHotTimestamps(map, &blocksRead), expected);
+  EXPECT_EQ(blocksRead, 1);
+
+  std::vector<SensorContainer> containers;
+  EXPECT_TRUE(map.getEntries(
+      [](const SensorEntry &, const SensorEntry &) { return true; },
+      [](const SensorEntry &) { return true; }, containers));
+  ASSERT_EQ(containers.size(), 1000);
+  EXPECT_EQ(containers.front().entry.timestamp, 1560);
+  EXPECT_EQ(containers.back().entry.timestamp, 2559);
+
+  cleanupZoneMappedFile(f, map);
+}
@@ -72,19 +72,18 @@ appendExactAmountOfEntriesV(BinaryFileType &f, uint32_t count = 42) {
   return r;
 }
 
-TestBinaryFile getRandomTestFile() {
-  TestBinaryFile r("/tmp/test.bin", TestBinaryHeader {});
-  EXPECT_TRUE(std::filesystem::exists(r.getPath()));
-  return r;
+// BinaryFile is neither copyable nor movable, so these rely on guaranteed
+// copy elision and the existence check happens in cleanupTestFile
+TestBinaryFile getRandomTestFile(binfmt::BinaryFileOptions options = {}) {
+  return TestBinaryFile("/tmp/test.bin", TestBinaryHeader {}, options);
 }
 
 TestBinaryFile getRandomTestEntryLimitedFile() {
-  TestBinaryFile r("/tmp/test.bin", TestBinaryHeader {0, 0, TEST_MAX_ENTRIES});
-  EXPECT_TRUE(std::filesystem::exists(r.getPath()));
-  return r;
+  return TestBinaryFile("/tmp/test.bin", TestBinaryHeader {0, 0, TEST_MAX_ENTRIES});
 }
 
 template <typename BinaryFileType> void cleanupTestFile(BinaryFileType& f) {
+  EXPECT_TRUE(std::filesystem::exists(f.getPath()));
   f.deleteFile();
   EXPECT_FALSE(std::filesystem::exists(f.getPath()));
 }